@@ -0,0 +1,152 @@
+#pragma once
+#include <condition_variable>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <filesystem.h>
+
+#include "AssetPack.h"
+#include "TextureCache.h"
+
+// decodes images on a small pool of worker threads, the caller collects
+// finished images with waitNext() and uploads them on the thread owning the gl context.
+// images come preprocessed from the asset pack when one is open, otherwise the loose
+// file goes through the texture cache, so a warm start never decodes a png.
+// requests start before the gl context exists, so S3TC is assumed until setCompression says
+// otherwise. images already decoded for S3TC by then go back to the workers with requestAgain
+struct AssetLoader {
+	struct ImageRequest {
+		int handle;
+		std::string name;
+		bool hasAlpha;
+	};
+
+	const AssetPack* pack;
+	std::vector<std::thread> workers;
+	// every request by handle, for requestAgain
+	std::vector<ImageRequest> issued;
+	std::deque<ImageRequest> requests;
+	std::deque<DecodedImage> decoded;
+	std::mutex mutex;
+	std::condition_variable requestReady;
+	std::condition_variable imageReady;
+	int requestCount;
+	int collectedCount;
+	bool compress;
+	bool stopping;
+
+	AssetLoader(const AssetPack* pack = nullptr, unsigned int threadCount = 0) : pack(pack), requestCount(0), collectedCount(0), compress(true), stopping(false) {
+		if (threadCount == 0) {
+			unsigned int cores = std::thread::hardware_concurrency();
+			threadCount = cores > 1 ? cores - 1 : 1;
+		}
+		for (unsigned int i = 0; i < threadCount; i++) {
+			workers.emplace_back(&AssetLoader::workerLoop, this);
+		}
+	}
+
+	~AssetLoader() {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		requestReady.notify_all();
+		for (std::thread& worker : workers) {
+			worker.join();
+		}
+	}
+
+	// name is relative to the project root, e.g. "resources/pinball.png".
+	// returns the handle the decoded image will carry
+	int requestImage(const std::string& name, bool hasAlpha) {
+		int handle;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			handle = requestCount++;
+			issued.push_back({ handle, name, hasAlpha });
+			requests.push_back(issued.back());
+		}
+		requestReady.notify_one();
+		return handle;
+	}
+
+	// whether the driver takes S3TC, images not started yet are decoded for it
+	void setCompression(bool enabled) {
+		std::lock_guard<std::mutex> lock(mutex);
+		compress = enabled;
+	}
+
+	bool isCompressing() {
+		std::lock_guard<std::mutex> lock(mutex);
+		return compress;
+	}
+
+	// decodes a collected image once more with the current setting, it comes out of waitNext again
+	void requestAgain(int handle) {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			requestCount++;
+			requests.push_back(issued[handle]);
+		}
+		requestReady.notify_one();
+	}
+
+	bool hasPending() {
+		std::lock_guard<std::mutex> lock(mutex);
+		return collectedCount < requestCount;
+	}
+
+	// blocks until any requested image finishes decoding, in completion order
+	DecodedImage waitNext() {
+		std::unique_lock<std::mutex> lock(mutex);
+		imageReady.wait(lock, [this] { return !decoded.empty(); });
+		DecodedImage image = std::move(decoded.front());
+		decoded.pop_front();
+		collectedCount++;
+		return image;
+	}
+
+	void workerLoop() {
+		while (true) {
+			ImageRequest request;
+			bool compressImage;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				requestReady.wait(lock, [this] { return stopping || !requests.empty(); });
+				if (stopping) return;
+				request = requests.front();
+				requests.pop_front();
+				compressImage = compress;
+			}
+
+			DecodedImage image;
+			image.handle = request.handle;
+			image.hasAlpha = request.hasAlpha;
+			if (!loadImage(request.name, image, compressImage)) {
+				std::cout << "ERROR::ASSET_LOADER::FAILED_TO_DECODE: " << request.name << std::endl;
+			}
+
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				decoded.push_back(std::move(image));
+			}
+			imageReady.notify_one();
+		}
+	}
+
+	// the pack holds S3TC entries, without S3TC its png goes through the texture cache instead
+	bool loadImage(const std::string& name, DecodedImage& image, bool compress) {
+		if (pack != nullptr) {
+			AssetBlob blob = pack->find(name + ".tex");
+			if (blob.isValid() && TextureCache::viewEntry(blob.data, blob.size, image, compress)) return true;
+			AssetBlob source = pack->find(name);
+			if (source.isValid()) return TextureCache::loadImage(name, source.data, source.size, image, compress);
+		}
+		return TextureCache::loadImage(FileSystem::getPath(name), image, compress);
+	}
+};
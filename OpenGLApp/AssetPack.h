@@ -0,0 +1,257 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "Utils.h"
+
+// read only memory mapping of a whole file
+struct MappedFile {
+	const unsigned char* data;
+	size_t size;
+	#ifdef _WIN32
+	HANDLE file;
+	HANDLE mapping;
+	#endif
+
+	MappedFile() : data(nullptr), size(0) {
+		#ifdef _WIN32
+		file = INVALID_HANDLE_VALUE;
+		mapping = NULL;
+		#endif
+	}
+
+	~MappedFile() {
+		close();
+	}
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	bool open(const std::string& path) {
+		close();
+		#ifdef _WIN32
+		file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+		if (file == INVALID_HANDLE_VALUE) return false;
+		LARGE_INTEGER fileSize;
+		GetFileSizeEx(file, &fileSize);
+		size = (size_t)fileSize.QuadPart;
+		mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (mapping == NULL) {
+			close();
+			return false;
+		}
+		data = (const unsigned char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+		#else
+		int fd = ::open(path.c_str(), O_RDONLY);
+		if (fd < 0) return false;
+		struct stat info;
+		if (fstat(fd, &info) != 0 || info.st_size == 0) {
+			::close(fd);
+			return false;
+		}
+		size = (size_t)info.st_size;
+		void* mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+		::close(fd);
+		data = mapped == MAP_FAILED ? nullptr : (const unsigned char*)mapped;
+		#endif
+		if (data == nullptr) {
+			close();
+			return false;
+		}
+		return true;
+	}
+
+	void close() {
+		#ifdef _WIN32
+		if (data != nullptr) UnmapViewOfFile(data);
+		if (mapping != NULL) CloseHandle(mapping);
+		if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+		mapping = NULL;
+		file = INVALID_HANDLE_VALUE;
+		#else
+		if (data != nullptr) munmap((void*)data, size);
+		#endif
+		data = nullptr;
+		size = 0;
+	}
+};
+
+// view into a blob inside the pack mapping, valid as long as the pack is open
+struct AssetBlob {
+	const unsigned char* data;
+	size_t size;
+	AssetBlob() : data(nullptr), size(0) {}
+	AssetBlob(const unsigned char* data, size_t size) : data(data), size(size) {}
+
+	bool isValid() const {
+		return data != nullptr;
+	}
+};
+
+// single file archive: header, index sorted by name hash, then the blobs,
+// each blob starts on a BLOB_ALIGNMENT boundary so it can be used in place
+struct AssetPack {
+	static const uint32_t VERSION = 1;
+	static const uint64_t BLOB_ALIGNMENT = 64;
+	static const int MAX_NAME_LENGTH = 112;
+
+	struct Header {
+		char magic[4];
+		uint32_t version;
+		uint32_t entryCount;
+		uint32_t reserved;
+	};
+
+	struct Entry {
+		uint64_t nameHash;
+		uint64_t offset;
+		uint64_t size;
+		char name[MAX_NAME_LENGTH];
+	};
+
+	struct Input {
+		std::string name;
+		std::vector<unsigned char> bytes;
+	};
+
+	MappedFile file;
+	const Entry* entries;
+	uint32_t entryCount;
+	std::filesystem::file_time_type packTime;
+	// entries whose loose source changed after the pack was built, find() skips them
+	std::vector<bool> stale;
+
+	AssetPack() : entries(nullptr), entryCount(0) {}
+
+	// checks every entry of the index, a damaged pack is rejected as a whole
+	bool open(const std::string& path) {
+		entries = nullptr;
+		entryCount = 0;
+		if (!file.open(path)) return false;
+
+		Header header;
+		if (file.size < sizeof(Header)) return fail();
+		memcpy(&header, file.data, sizeof(Header));
+		if (memcmp(header.magic, "PBPK", 4) != 0 || header.version != VERSION) return fail();
+		if (header.entryCount > (file.size - sizeof(Header)) / sizeof(Entry)) return fail();
+
+		entries = (const Entry*)(file.data + sizeof(Header));
+		entryCount = header.entryCount;
+		for (uint32_t i = 0; i < entryCount; i++) {
+			const Entry& entry = entries[i];
+			if (entry.offset > file.size || entry.size > file.size - entry.offset) return fail();
+			if (memchr(entry.name, '\0', MAX_NAME_LENGTH) == nullptr) return fail();
+		}
+
+		std::error_code error;
+		packTime = std::filesystem::last_write_time(path, error);
+		stale.assign(entryCount, false);
+		return true;
+	}
+
+	// skips the entry from now on when sourcePath was written after the pack, so the loose file
+	// is used instead of silently playing with the old one. true when it did
+	bool skipIfStale(const std::string& name, const std::string& sourcePath) {
+		if (!isOpen()) return false;
+		std::error_code error;
+		std::filesystem::file_time_type sourceTime = std::filesystem::last_write_time(sourcePath, error);
+		if (error || sourceTime <= packTime) return false;
+
+		bool skipped = false;
+		for (uint32_t i = 0; i < entryCount; i++) {
+			if (name == entries[i].name) {
+				stale[i] = true;
+				skipped = true;
+			}
+		}
+		return skipped;
+	}
+
+	bool isOpen() const {
+		return entries != nullptr;
+	}
+
+	AssetBlob find(const std::string& name) const {
+		if (!isOpen()) return AssetBlob();
+
+		uint64_t hash = Utils::hashBytes(name.data(), name.size());
+		const Entry* end = entries + entryCount;
+		const Entry* entry = std::lower_bound(entries, end, hash, [](const Entry& e, uint64_t h) { return e.nameHash < h; });
+		for (; entry != end && entry->nameHash == hash; entry++) {
+			if (name == entry->name && !stale[entry - entries]) {
+				return AssetBlob(file.data + entry->offset, entry->size);
+			}
+		}
+		return AssetBlob();
+	}
+
+	static bool build(const std::string& path, std::vector<Input>& inputs) {
+		std::sort(inputs.begin(), inputs.end(), [](const Input& a, const Input& b) {
+			return Utils::hashBytes(a.name.data(), a.name.size()) < Utils::hashBytes(b.name.data(), b.name.size());
+		});
+
+		Header header;
+		memcpy(header.magic, "PBPK", 4);
+		header.version = VERSION;
+		header.entryCount = inputs.size();
+		header.reserved = 0;
+
+		std::vector<Entry> index(inputs.size());
+		uint64_t offset = alignUp(sizeof(Header) + inputs.size() * sizeof(Entry));
+		for (size_t i = 0; i < inputs.size(); i++) {
+			if (inputs[i].name.size() >= MAX_NAME_LENGTH) {
+				printf("ERROR::ASSET_PACK::NAME_TOO_LONG: %s\n", inputs[i].name.c_str());
+				return false;
+			}
+			memset(&index[i], 0, sizeof(Entry));
+			index[i].nameHash = Utils::hashBytes(inputs[i].name.data(), inputs[i].name.size());
+			index[i].offset = offset;
+			index[i].size = inputs[i].bytes.size();
+			memcpy(index[i].name, inputs[i].name.c_str(), inputs[i].name.size());
+			offset = alignUp(offset + index[i].size);
+		}
+
+		FILE* out = fopen(path.c_str(), "wb");
+		if (out == nullptr) return false;
+		fwrite(&header, sizeof(Header), 1, out);
+		fwrite(index.data(), sizeof(Entry), index.size(), out);
+		const char padding[BLOB_ALIGNMENT] = {};
+		for (size_t i = 0; i < inputs.size(); i++) {
+			long position = ftell(out);
+			fwrite(padding, 1, index[i].offset - position, out);
+			fwrite(inputs[i].bytes.data(), 1, inputs[i].bytes.size(), out);
+		}
+		bool written = !ferror(out);
+		fclose(out);
+		return written;
+	}
+
+private:
+	bool fail() {
+		file.close();
+		entries = nullptr;
+		entryCount = 0;
+		stale.clear();
+		return false;
+	}
+
+	static uint64_t alignUp(uint64_t value) {
+		return (value + BLOB_ALIGNMENT - 1) & ~(BLOB_ALIGNMENT - 1);
+	}
+};
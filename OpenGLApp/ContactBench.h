@@ -0,0 +1,84 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <vector>
+
+#include "World.h"
+
+// a pile of balls dropped onto the lowered flippers of the default table, once with the single
+// pass contact handling and once with the sequential impulse solver (World::useContactSolver).
+// how still the pile ends up, how far the balls overlap and what a step costs
+namespace ContactBench {
+	const float SETTLE_SECONDS = 15.0f;
+	// the pile is measured over the last second
+	const float MEASURE_SECONDS = 1.0f;
+	const float STEP_DT = 1.0f / 60.0f;
+
+	struct Result {
+		float meanSpeed;
+		float maxOverlap;
+		int ballsLeft;
+		float secondsPerStep;
+	};
+
+	// frameDts are cycled through step by step, more than one stands for frames folded into
+	// longer steps by the simulation thread
+	inline Result run(bool useContactSolver, int ballCount, const std::vector<float>& frameDts) {
+		World world(1);
+		world.useContactSolver = useContactSolver;
+		world.balls.clear();
+		for (int i = 0; i < ballCount; i++) {
+			Ball ball = world.createBall();
+			ball.position = glm::mix(world.spawnPosLeft, world.spawnPosRight, (i % 8 + 0.5f) / 8.0f) - glm::vec2(0.0f, (i / 8) * ball.radius * 2.5f);
+			world.balls.push_back(ball);
+		}
+
+		Result result = {};
+		float time = 0.0f;
+		int samples = 0;
+		int steps = 0;
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		while (time < SETTLE_SECONDS) {
+			float dt = frameDts[steps % frameDts.size()];
+			world.updateSimulation(dt);
+			time += dt;
+			steps++;
+			if (time < SETTLE_SECONDS - MEASURE_SECONDS) continue;
+			for (const Ball& ball : world.balls) {
+				result.meanSpeed += glm::length(ball.velocity);
+				samples++;
+			}
+		}
+		std::chrono::duration<float> elapsed = std::chrono::steady_clock::now() - start;
+		result.secondsPerStep = elapsed.count() / steps;
+		if (samples > 0) result.meanSpeed /= samples;
+
+		result.ballsLeft = world.balls.size();
+		for (size_t i = 0; i < world.balls.size(); i++) {
+			for (size_t j = i + 1; j < world.balls.size(); j++) {
+				const Ball& a = world.balls[i];
+				const Ball& b = world.balls[j];
+				result.maxOverlap = std::max(result.maxOverlap, a.radius + b.radius - glm::length(a.position - b.position));
+			}
+		}
+		return result;
+	}
+
+	inline void printRow(const char* name, const Result& result) {
+		printf("  %-28s mean speed %8.4f  max overlap %7.4f  balls left %4d  %8.2f us/step\n", name,
+			result.meanSpeed, result.maxOverlap, result.ballsLeft, result.secondsPerStep * 1000000.0f);
+	}
+
+	// entry point for --contact-bench
+	inline void runAndReport(int ballCount) {
+		ballCount = std::max(ballCount, 1);
+		std::vector<float> fixedSteps = { STEP_DT };
+		std::vector<float> foldedSteps = { STEP_DT, STEP_DT * 2.0f, STEP_DT, STEP_DT * 3.0f };
+		printf("%d balls piled on the flippers for %.0fs, measured over the last %.0fs, one thread\n", ballCount, SETTLE_SECONDS, MEASURE_SECONDS);
+		printRow("single pass, fixed dt", run(false, ballCount, fixedSteps));
+		printRow("contact solver, fixed dt", run(true, ballCount, fixedSteps));
+		printRow("single pass, folded dt", run(false, ballCount, foldedSteps));
+		printRow("contact solver, folded dt", run(true, ballCount, foldedSteps));
+	}
+}
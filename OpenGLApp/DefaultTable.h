@@ -0,0 +1,83 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <iterator>
+
+#include "Table.h"
+#include "Utils.h"
+
+// the table the game shipped with, used when no table file is given. it is written as constants, so
+// the compiler bakes its segments, segment tree and limits and checks its geometry, startup only
+// copies them. resources/tables/default.table is the same table as a source
+namespace DefaultTable {
+	constexpr TableTuning TUNING = { { 25.0f, 0.0f }, { 0.0f, 0.0f }, { 0.0f, 0.0f }, 0.0f, 2.0f, 1, 0 };
+
+	constexpr TablePoint BORDER[] = {
+		{ -75.0f, 75.0f }, { -75.0f, -5.0f }, { -60.0f, -20.0f }, { -45.0f, -32.0f }, { -32.0f, -40.0f },
+		{ -20.0f, -50.0f }, { -20.0f, -200.0f }, { 20.0f, -200.0f }, { 20.0f, -50.0f }, { 32.0f, -40.0f },
+		{ 45.0f, -32.0f }, { 60.0f, -20.0f }, { 75.0f, -5.0f }, { 75.0f, 75.0f }
+	};
+
+	constexpr TableBumper BUMPERS[] = {
+		{ -35.0f, 18.0f, 7.0f, Table::DEFAULT_PUSH_AMOUNT },
+		{ 12.0f, 50.0f, 5.0f, Table::DEFAULT_PUSH_AMOUNT },
+		{ -20.0f, 40.0f, 4.0f, Table::DEFAULT_PUSH_AMOUNT },
+		{ 40.0f, 30.0f, 10.0f, Table::DEFAULT_PUSH_AMOUNT }
+	};
+
+	constexpr float REST_ANGLE = Utils::deg2Rad(10.0f);
+	constexpr float UPPER_REST_ANGLE = Utils::deg2Rad(30.0f);
+	constexpr float MAX_ROTATION = Utils::deg2Rad(50.0f);
+	constexpr TableFlipper FLIPPERS[] = {
+		{ -20.0f, -50.0f, 1.5f, 16.0f, -REST_ANGLE, MAX_ROTATION, 12.0f, 0.2f, TABLE_LEFT },
+		{ 20.0f, -50.0f, 1.5f, 16.0f, Utils::PI + REST_ANGLE, MAX_ROTATION, 12.0f, 0.2f, TABLE_RIGHT },
+		{ -75.0f, -5.0f, 1.5f, 16.0f, -UPPER_REST_ANGLE, MAX_ROTATION, 12.0f, 0.2f, TABLE_LEFT },
+		{ 75.0f, -5.0f, 1.5f, 16.0f, Utils::PI + UPPER_REST_ANGLE, MAX_ROTATION, 12.0f, 0.2f, TABLE_RIGHT }
+	};
+
+	constexpr size_t SEGMENT_COUNT = std::size(BORDER);
+	constexpr size_t FLIPPER_COUNT = std::size(FLIPPERS);
+	constexpr size_t NODE_COUNT = Table::countNodes(SEGMENT_COUNT);
+
+	constexpr std::array<TableSegment, SEGMENT_COUNT> SEGMENTS = []() {
+		std::array<TableSegment, SEGMENT_COUNT> segments = {};
+		for (size_t i = 0; i < SEGMENT_COUNT; i++) {
+			segments[i] = Table::bakeSegment(BORDER[i], BORDER[(i + 1) % SEGMENT_COUNT], TUNING.offset);
+		}
+		return segments;
+	}();
+
+	constexpr std::array<TableNode, NODE_COUNT> NODES = []() {
+		std::array<TableNode, NODE_COUNT> nodes = {};
+		uint32_t nodeCount = 0;
+		Table::buildNode(SEGMENTS.data(), nodes.data(), nodeCount, 0, (uint32_t)SEGMENT_COUNT);
+		return nodes;
+	}();
+
+	constexpr TableLimits LIMITS = Table::computeLimits(BORDER, SEGMENT_COUNT, FLIPPERS, FLIPPER_COUNT, TUNING);
+
+	static_assert(SEGMENT_COUNT >= 3 && FLIPPER_COUNT > 0, "the default table needs a border and flippers");
+	static_assert(Table::checkGeometry(BORDER, SEGMENT_COUNT, FLIPPERS, FLIPPER_COUNT).error == Table::GEOMETRY_OK,
+		"the default table has a zero length border segment, a border crossing itself or a flipper without length");
+	static_assert(LIMITS.ballDespawnHeight < LIMITS.lowestFlipperY, "balls of the default table would be lost above its flippers");
+}
+
+namespace Table {
+	inline const TableDescription& getDefault() {
+		static const TableDescription table = []() {
+			using namespace DefaultTable;
+			TableDescription t;
+			t.tuning = TUNING;
+			t.border.assign(std::begin(BORDER), std::end(BORDER));
+			t.bumpers.assign(std::begin(BUMPERS), std::end(BUMPERS));
+			t.flippers.assign(std::begin(FLIPPERS), std::end(FLIPPERS));
+			t.segments.assign(SEGMENTS.begin(), SEGMENTS.end());
+			t.nodes.assign(NODES.begin(), NODES.end());
+			t.limits = LIMITS;
+			// the mesh is only drawn, it needs a square root and is baked here
+			bakeBorderMesh(t.segments, t.borderMesh);
+			return t;
+		}();
+		return table;
+	}
+}
@@ -0,0 +1,91 @@
+#pragma once
+#include <algorithm>
+#include <cfenv>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+
+#if defined(__SSE__) || defined(_M_X64)
+#include <xmmintrin.h>
+#define DETERMINISM_HAS_MXCSR
+#endif
+
+#include "JobSystem.h"
+#include "World.h"
+
+// bit exact simulation: the same seed and the same commands at the same step indices give the
+// same World, down to the last bit, on any x86-64 machine. that holds as long as
+//  - every step uses the same dt, main.cpp runs fixed FIX_DT steps with DETERMINISTIC_SIMULATION
+//  - every thread running simulation code uses the float environment set below (round to nearest,
+//    no flush to zero, no denormals are zero). the simulation thread and the job workers set it
+//  - the build keeps strict float semantics: no -ffast-math or /fp:fast, and with gcc/clang
+//    -ffp-contract=off once FMA is available (-march=haswell and later), or a*b+c may get fused
+//  - sin/cos come from the same libm, they are only guaranteed to match within one glibc version
+// parallel jobs do not break it, every parallel loop in World splits independent elements
+#if defined(__FAST_MATH__)
+#pragma message("fast math is enabled, the simulation is not bit exact")
+#endif
+
+namespace Determinism {
+	// all exceptions masked, round to nearest, flush to zero and denormals are zero off
+	const unsigned int MXCSR_DEFAULT = 0x1f80;
+	const unsigned int MXCSR_FLAGS = 0x3f;
+
+	inline void setupFloatEnvironment() {
+		fesetround(FE_TONEAREST);
+		#ifdef DETERMINISM_HAS_MXCSR
+		_mm_setcsr(MXCSR_DEFAULT);
+		#endif
+	}
+
+	// the sticky exception flags are ignored, they do not change results
+	inline bool isFloatEnvironmentControlled() {
+		if (fegetround() != FE_TONEAREST) return false;
+		#ifdef DETERMINISM_HAS_MXCSR
+		if ((_mm_getcsr() & ~MXCSR_FLAGS) != MXCSR_DEFAULT) return false;
+		#endif
+		return true;
+	}
+
+	inline void printStepHash(uint64_t step, uint64_t hash) {
+		printf("step %8llu  hash %016llx\n", (unsigned long long)step, (unsigned long long)hash);
+	}
+
+	// entry point for --determinism-check: one autoplayed world stepped on this thread and one
+	// spread over the jobs must hash the same after every step. prints one hash per simulated
+	// second, diff the output of two machines to find the second where they part ways
+	inline bool runCheck(JobSystem& jobs, uint32_t seed, float seconds, float dt) {
+		setupFloatEnvironment();
+		World serial(seed);
+		World parallel(seed, DifficultySettings(), &jobs);
+		serial.hashSteps = true;
+		parallel.hashSteps = true;
+
+		uint64_t stepCount = (uint64_t)std::llround(seconds / dt);
+		uint64_t stepsPerReport = (uint64_t)std::max(1.0f, std::round(1.0f / dt));
+		for (uint64_t i = 0; i < stepCount; i++) {
+			// a lost game restarts from the world's own generator, so long runs keep going
+			if (serial.gameState == GAME_OVER) serial.applyCommand(COMMAND_RESET);
+			if (parallel.gameState == GAME_OVER) parallel.applyCommand(COMMAND_RESET);
+
+			serial.autoplay();
+			serial.step(dt);
+			parallel.autoplay();
+			parallel.step(dt);
+
+			if (serial.stateHash != parallel.stateHash) {
+				printf("ERROR::DETERMINISM::DIVERGED at step %llu, %d and %d balls\n", (unsigned long long)i, (int)serial.balls.size(), (int)parallel.balls.size());
+				return false;
+			}
+			if ((i + 1) % stepsPerReport == 0) printStepHash(i + 1, serial.stateHash);
+		}
+
+		if (!isFloatEnvironmentControlled()) {
+			printf("ERROR::DETERMINISM::FLOAT_ENVIRONMENT_CHANGED during the run\n");
+			return false;
+		}
+		printf("%llu steps bit identical, final ", (unsigned long long)stepCount);
+		printStepHash(stepCount, serial.stateHash);
+		return true;
+	}
+}
@@ -0,0 +1,114 @@
+#pragma once
+#include <cstdio>
+#include <filesystem>
+#include <string>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+// tells when a file was written, without blocking. the watch is on the file's directory: editors
+// often save by writing a new file and renaming it over the old one, which a watch on the file
+// itself would lose. inotify on linux, only whole writes (close after write, rename into place)
+// count. a change notification on windows, filtered by the file's write time
+struct FileWatcher {
+	std::string path;
+	std::string fileName;
+	#ifdef _WIN32
+	HANDLE notification;
+	std::filesystem::file_time_type lastWriteTime;
+	#else
+	int fd;
+	int watch;
+	#endif
+
+	FileWatcher() {
+		#ifdef _WIN32
+		notification = INVALID_HANDLE_VALUE;
+		#else
+		fd = -1;
+		watch = -1;
+		#endif
+	}
+
+	~FileWatcher() {
+		stop();
+	}
+
+	FileWatcher(const FileWatcher&) = delete;
+	FileWatcher& operator=(const FileWatcher&) = delete;
+
+	bool start(const std::string& path) {
+		stop();
+		this->path = path;
+		std::filesystem::path file(path);
+		fileName = file.filename().string();
+		std::string directory = file.has_parent_path() ? file.parent_path().string() : ".";
+		#ifdef _WIN32
+		notification = FindFirstChangeNotificationA(directory.c_str(), FALSE, FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_FILE_NAME);
+		if (notification == INVALID_HANDLE_VALUE) {
+			printf("ERROR::FILE_WATCHER::FAILED_TO_WATCH: %s\n", directory.c_str());
+			return false;
+		}
+		std::error_code error;
+		lastWriteTime = std::filesystem::last_write_time(path, error);
+		#else
+		fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+		if (fd >= 0) watch = inotify_add_watch(fd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+		if (watch < 0) {
+			printf("ERROR::FILE_WATCHER::FAILED_TO_WATCH: %s\n", directory.c_str());
+			stop();
+			return false;
+		}
+		#endif
+		return true;
+	}
+
+	// true once for any number of writes since the last call
+	bool poll() {
+		bool changed = false;
+		#ifdef _WIN32
+		if (notification == INVALID_HANDLE_VALUE) return false;
+		bool signaled = false;
+		while (WaitForSingleObject(notification, 0) == WAIT_OBJECT_0) {
+			signaled = true;
+			if (!FindNextChangeNotification(notification)) break;
+		}
+		if (signaled) {
+			// something in the directory changed, it may not have been this file
+			std::error_code error;
+			std::filesystem::file_time_type writeTime = std::filesystem::last_write_time(path, error);
+			changed = !error && writeTime != lastWriteTime;
+			if (changed) lastWriteTime = writeTime;
+		}
+		#else
+		if (fd < 0) return false;
+		alignas(inotify_event) char buffer[4096];
+		ssize_t length;
+		while ((length = read(fd, buffer, sizeof(buffer))) > 0) {
+			for (ssize_t offset = 0; offset < length;) {
+				const inotify_event* event = (const inotify_event*)(buffer + offset);
+				if (event->len > 0 && fileName == event->name) changed = true;
+				offset += sizeof(inotify_event) + event->len;
+			}
+		}
+		#endif
+		return changed;
+	}
+
+	void stop() {
+		#ifdef _WIN32
+		if (notification != INVALID_HANDLE_VALUE) FindCloseChangeNotification(notification);
+		notification = INVALID_HANDLE_VALUE;
+		#else
+		if (fd >= 0) close(fd);
+		fd = -1;
+		watch = -1;
+		#endif
+	}
+};
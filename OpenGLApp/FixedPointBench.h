@@ -0,0 +1,143 @@
+#pragma once
+#include <chrono>
+#include <cstdio>
+#include <vector>
+
+#include "Scalar.h"
+#include "World.h"
+
+// the default table and a grid of balls, converted to scalar type T and stepped with the
+// collision templates from World.h on one thread. no contact graph or jobs, so timing float
+// against fixed point compares the scalar pipelines and nothing else
+template <typename T>
+struct ScalarTable {
+	std::vector<VecT<T>> borderPoints;
+	std::vector<ObstacleT<T>> obstacles;
+	std::vector<FlipperT<T>> flippers;
+	std::vector<BallT<T>> balls;
+	std::vector<VecT<T>> spawnPositions;
+	T ballDespawnHeight;
+
+	ScalarTable(int ballCount) {
+		World table;
+		for (glm::vec2 point : table.borderPoints) {
+			borderPoints.push_back(VecT<T>(point));
+		}
+		for (const Obstacle& obstacle : table.obstacles) {
+			obstacles.push_back(ObstacleT<T>(VecT<T>(obstacle.position), T(obstacle.radius), T(obstacle.pushAmount)));
+		}
+		for (const Flipper& flipper : table.flippers) {
+			flippers.push_back(FlipperT<T>(VecT<T>(flipper.position), T(flipper.radius), T(flipper.length), T(flipper.restAngle),
+				T(flipper.maxRotation), T(flipper.angularVelocity), T(flipper.restitution), flipper.isSignPositive));
+			flippers.back().id = flipper.id;
+		}
+		ballDespawnHeight = T(table.ballDespawnHeight);
+
+		// rows of 8 between the two spawn points, going down
+		const int COLUMNS = 8;
+		Ball shape = table.createBall();
+		for (int i = 0; i < ballCount; i++) {
+			float t = (i % COLUMNS + 0.5f) / COLUMNS;
+			glm::vec2 position = glm::mix(table.spawnPosLeft, table.spawnPosRight, t) - glm::vec2(0.0f, (i / COLUMNS) * shape.radius * 2.5f);
+			BallT<T> ball;
+			ball.position = VecT<T>(position);
+			ball.radius = T(shape.radius);
+			ball.mass = T(shape.mass);
+			balls.push_back(ball);
+			spawnPositions.push_back(ball.position);
+		}
+	}
+
+	// flippers swing every 45 steps, drained balls start over from their spawn point
+	void step(T dt, int stepIndex) {
+		for (FlipperT<T>& flipper : flippers) {
+			flipper.isFlipped = (stepIndex / 45) % 2 == 1;
+			flipper.update(dt);
+		}
+
+		int n = balls.size();
+		for (BallT<T>& ball : balls) {
+			ball.update(dt);
+		}
+		for (int i = 0; i < n; i++) {
+			for (int j = i + 1; j < n; j++) {
+				handleCollision(balls[i], balls[j]);
+			}
+		}
+		for (int i = 0; i < n; i++) {
+			BallT<T>& ball = balls[i];
+			for (const ObstacleT<T>& obstacle : obstacles)
+				handleCollision(ball, obstacle);
+
+			for (const FlipperT<T>& flipper : flippers)
+				handleCollision(ball, flipper);
+
+			handleCollision(ball, borderPoints);
+
+			if (ball.position.y < ballDespawnHeight) {
+				ball.position = spawnPositions[i];
+				ball.velocity = VecT<T>();
+			}
+		}
+	}
+};
+
+namespace FixedPointBench {
+	inline glm::vec2 toGlm(glm::vec2 v) {
+		return v;
+	}
+
+	template <typename T>
+	inline glm::vec2 toGlm(FixedVec2<T> v) {
+		return v.toGlm();
+	}
+
+	template <typename T>
+	inline float secondsPerStep(int ballCount, int steps) {
+		ScalarTable<T> table(ballCount);
+		T dt = T(1.0f / 60.0f);
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		for (int i = 0; i < steps; i++) {
+			table.step(dt, i);
+		}
+		std::chrono::duration<float> elapsed = std::chrono::steady_clock::now() - start;
+		return elapsed.count() / steps;
+	}
+
+	// largest distance between a ball here and the same ball in the float run, after steps steps
+	template <typename T>
+	inline float deviationFromFloat(int ballCount, int steps) {
+		ScalarTable<float> reference(ballCount);
+		ScalarTable<T> table(ballCount);
+		T dt = T(1.0f / 60.0f);
+		for (int i = 0; i < steps; i++) {
+			reference.step(1.0f / 60.0f, i);
+			table.step(dt, i);
+		}
+		float deviation = 0.0f;
+		for (int i = 0; i < ballCount; i++) {
+			deviation = glm::max(deviation, glm::length(toGlm(table.balls[i].position) - reference.balls[i].position));
+		}
+		return deviation;
+	}
+
+	template <typename T>
+	inline void printRow(const char* name, int ballCount, int steps, float floatTime) {
+		float time = secondsPerStep<T>(ballCount, steps);
+		printf("  %-8s %9.2f us/step  %7.1f ns/ball-step  %5.2fx float  deviation after 1s %8.4f\n", name,
+			time * 1000000.0f, time * 1000000000.0f / ballCount, time / floatTime, deviationFromFloat<T>(ballCount, 60));
+	}
+
+	// entry point for --fixed-bench
+	inline void runAndReport(int ballCount, int steps) {
+		ballCount = glm::max(ballCount, 1);
+		steps = glm::max(steps, 1);
+		printf("%d balls, %d steps, one thread\n", ballCount, steps);
+		float floatTime = secondsPerStep<float>(ballCount, steps);
+		printf("  %-8s %9.2f us/step  %7.1f ns/ball-step\n", "float", floatTime * 1000000.0f, floatTime * 1000000000.0f / ballCount);
+		printRow<Q32_32>("Q32.32", ballCount, steps, floatTime);
+		// for reference only, too coarse to play like the game (see Scalar.h)
+		printRow<Q16_16>("Q16.16", ballCount, steps, floatTime);
+		printf("Q16.16 drifts too far from float to simulate the table, Q32.32 is the usable format\n");
+	}
+}
@@ -0,0 +1,352 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <filesystem>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/packing.hpp>
+
+#include "Utils.h"
+#include "World.h"
+
+// black box for the running game. every step goes into a preallocated ring as a compact record,
+// and when one of the anomaly checks fires the last RECORD_SECONDS are written to disk on a
+// background thread. nothing on the recording path allocates or touches the disk.
+// a dump, native byte order (little endian everywhere the game builds):
+//   header   "PBFR", u16 version, u16 FlightAnomaly, i32 detail (ball index, -1 when none),
+//            f32 value (the frame time of a spike), u32 frame count
+//   frames   oldest first, each a FlightFrameHeader then per ball half2 position, half2 velocity,
+//            per enemy half2 position, per flipper half rotation
+enum FlightAnomaly {
+	FLIGHT_BALL_OUTSIDE_BORDER,
+	FLIGHT_NAN_VELOCITY,
+	FLIGHT_FRAME_TIME_SPIKE,
+	FLIGHT_UNEXPECTED_GAME_OVER,
+	FLIGHT_ANOMALY_COUNT
+};
+
+const char* const FLIGHT_ANOMALY_NAMES[FLIGHT_ANOMALY_COUNT] = {
+	"ball-outside-border",
+	"nan-velocity",
+	"frame-time-spike",
+	"unexpected-game-over"
+};
+
+struct FlightFrameHeader {
+	uint64_t step;
+	float dt;
+	int32_t score;
+	uint16_t ballCount;
+	uint16_t enemyCount;
+	uint8_t flipperCount;
+	uint8_t gameState;
+	uint16_t reserved;
+};
+
+namespace FlightRecord {
+	const char MAGIC[4] = { 'P', 'B', 'F', 'R' };
+	const uint16_t VERSION = 1;
+	const size_t HEADER_SIZE = 20;
+
+	inline size_t getFrameSize(size_t balls, size_t enemies, size_t flippers) {
+		return sizeof(FlightFrameHeader) + balls * 8 + enemies * 4 + flippers * 2;
+	}
+}
+
+struct FlightRecorder {
+	static constexpr float RECORD_SECONDS = 30.0f;
+	// enough for 30 s of 100 balls at 60 Hz with room to spare, more balls shorten the window
+	static const size_t RING_BYTES = 4 * 1024 * 1024;
+	static const size_t MAX_FRAMES = 30 * 240;
+	// a frame this many times the running average and over the minimum counts as a spike
+	static constexpr float SPIKE_FACTOR = 4.0f;
+	static constexpr float SPIKE_MIN_SECONDS = 0.1f;
+	static constexpr float FRAME_TIME_SMOOTHING = 0.05f;
+	// one dump per window, an anomaly that sticks around does not write the same 30 s again
+	static constexpr float DUMP_COOLDOWN_SECONDS = RECORD_SECONDS;
+
+	struct FrameIndex {
+		uint32_t offset;
+		uint32_t size;
+		double time;
+	};
+
+	std::string directory;
+	std::vector<uint8_t> ring;
+	size_t head;
+	std::vector<FrameIndex> frames;
+	size_t firstFrame;
+	size_t frameCount;
+	double time;
+
+	GameState lastGameState;
+	float averageFrameTime;
+	double lastDumpTime;
+	bool hasDumped;
+
+	std::vector<uint8_t> dumpBuffer;
+	std::thread dumpWriter;
+
+	FlightRecorder() : ring(RING_BYTES), head(0), frames(MAX_FRAMES), firstFrame(0), frameCount(0), time(0.0),
+		lastGameState(RUNNING), averageFrameTime(0.0f), lastDumpTime(0.0), hasDumped(false) {
+		dumpBuffer.reserve(RING_BYTES + FlightRecord::HEADER_SIZE);
+	}
+
+	~FlightRecorder() {
+		if (dumpWriter.joinable()) dumpWriter.join();
+	}
+
+	FlightRecorder(const FlightRecorder&) = delete;
+	FlightRecorder& operator=(const FlightRecorder&) = delete;
+
+	// call after every step
+	void record(const World& world, float dt) {
+		time += dt;
+		size_t size = FlightRecord::getFrameSize(world.balls.size(), world.enemies.size(), world.flippers.size());
+		if (size <= ring.size()) {
+			uint8_t* out = reserve(size);
+
+			FlightFrameHeader header = {};
+			header.step = world.stepIndex;
+			header.dt = dt;
+			header.score = world.score;
+			header.ballCount = (uint16_t)world.balls.size();
+			header.enemyCount = (uint16_t)world.enemies.size();
+			header.flipperCount = (uint8_t)world.flippers.size();
+			header.gameState = (uint8_t)world.gameState;
+			memcpy(out, &header, sizeof(header));
+			out += sizeof(header);
+
+			for (const Ball& ball : world.balls) {
+				uint32_t packed[2] = { glm::packHalf2x16(ball.position), glm::packHalf2x16(ball.velocity) };
+				memcpy(out, packed, sizeof(packed));
+				out += sizeof(packed);
+			}
+			for (const Enemy& enemy : world.enemies) {
+				uint32_t packed = glm::packHalf2x16(enemy.position);
+				memcpy(out, &packed, sizeof(packed));
+				out += sizeof(packed);
+			}
+			for (const Flipper& flipper : world.flippers) {
+				uint16_t packed = glm::packHalf1x16(flipper.currentRotation);
+				memcpy(out, &packed, sizeof(packed));
+				out += sizeof(packed);
+			}
+		}
+
+		checkWorld(world);
+		lastGameState = world.gameState;
+	}
+
+	// call once per frame with the time it took
+	void checkFrameTime(float frameTime) {
+		if (averageFrameTime > 0.0f && frameTime > SPIKE_MIN_SECONDS && frameTime > averageFrameTime * SPIKE_FACTOR) {
+			dump(FLIGHT_FRAME_TIME_SPIKE, -1, frameTime);
+		}
+		// a spike is not folded in at full weight, or the next one would hide behind it
+		float sample = averageFrameTime > 0.0f ? glm::min(frameTime, averageFrameTime * SPIKE_FACTOR) : frameTime;
+		averageFrameTime += (sample - averageFrameTime) * (averageFrameTime > 0.0f ? FRAME_TIME_SMOOTHING : 1.0f);
+	}
+
+	// writes the ring to directory/flight-<time>-<anomaly>.bin, returns false while in cooldown
+	bool dump(FlightAnomaly anomaly, int32_t detail, float value) {
+		if (hasDumped && time - lastDumpTime < DUMP_COOLDOWN_SECONDS) return false;
+		hasDumped = true;
+		lastDumpTime = time;
+
+		if (dumpWriter.joinable()) dumpWriter.join();
+		dumpBuffer.clear();
+		dumpBuffer.insert(dumpBuffer.end(), FlightRecord::MAGIC, FlightRecord::MAGIC + 4);
+		uint16_t version = FlightRecord::VERSION;
+		uint16_t anomalyValue = (uint16_t)anomaly;
+		uint32_t count = (uint32_t)frameCount;
+		append(&version, sizeof(version));
+		append(&anomalyValue, sizeof(anomalyValue));
+		append(&detail, sizeof(detail));
+		append(&value, sizeof(value));
+		append(&count, sizeof(count));
+		for (size_t i = 0; i < frameCount; i++) {
+			const FrameIndex& frame = frames[(firstFrame + i) % frames.size()];
+			append(ring.data() + frame.offset, frame.size);
+		}
+
+		std::string path = directory + "/flight-" + std::to_string((long long)::time(NULL)) + "-" + FLIGHT_ANOMALY_NAMES[anomaly] + ".bin";
+		printf("FLIGHT_RECORDER::%s, writing the last %.1fs to %s\n", FLIGHT_ANOMALY_NAMES[anomaly], getRecordedSeconds(), path.c_str());
+		dumpWriter = std::thread([this, path]() {
+			std::error_code error;
+			std::filesystem::create_directories(directory, error);
+			FILE* file = fopen(path.c_str(), "wb");
+			if (file == nullptr) {
+				printf("ERROR::FLIGHT_RECORDER::FAILED_TO_OPEN: %s\n", path.c_str());
+				return;
+			}
+			fwrite(dumpBuffer.data(), 1, dumpBuffer.size(), file);
+			fclose(file);
+		});
+		return true;
+	}
+
+	float getRecordedSeconds() const {
+		if (frameCount == 0) return 0.0f;
+		return (float)(time - frames[firstFrame].time);
+	}
+
+private:
+	// the newest record's bytes, dropping the oldest records it overwrites and the ones that are
+	// out of the time window. a record that does not fit before the end starts over at 0
+	uint8_t* reserve(size_t size) {
+		if (head + size > ring.size()) head = 0;
+		while (frameCount > 0) {
+			const FrameIndex& oldest = frames[firstFrame];
+			bool overlaps = oldest.offset < head + size && oldest.offset + oldest.size > head;
+			if (!overlaps && frameCount < frames.size() && time - oldest.time <= RECORD_SECONDS) break;
+			firstFrame = (firstFrame + 1) % frames.size();
+			frameCount--;
+		}
+
+		FrameIndex& frame = frames[(firstFrame + frameCount) % frames.size()];
+		frame.offset = (uint32_t)head;
+		frame.size = (uint32_t)size;
+		frame.time = time;
+		frameCount++;
+
+		uint8_t* out = ring.data() + head;
+		head += size;
+		return out;
+	}
+
+	void append(const void* data, size_t size) {
+		const uint8_t* bytes = (const uint8_t*)data;
+		dumpBuffer.insert(dumpBuffer.end(), bytes, bytes + size);
+	}
+
+	// even odd rule, the border is one closed loop
+	static bool isInsidePolygon(glm::vec2 p, const std::vector<glm::vec2>& points) {
+		bool inside = false;
+		size_t n = points.size();
+		for (size_t i = 0, j = n - 1; i < n; j = i++) {
+			glm::vec2 a = points[i];
+			glm::vec2 b = points[j];
+			if ((a.y > p.y) != (b.y > p.y) && p.x < (b.x - a.x) * (p.y - a.y) / (b.y - a.y) + a.x) inside = !inside;
+		}
+		return inside;
+	}
+
+	// a ball whose center is outside but that still touches the border gets pushed back in by the
+	// next step, the right spawn point is one of those. only a ball clear of the border has escaped
+	static bool hasEscaped(const Ball& ball, const std::vector<glm::vec2>& points) {
+		if (isInsidePolygon(ball.position, points)) return false;
+		float reach = ball.radius + BORDER_SIZE;
+		for (size_t i = 0; i < points.size(); i++) {
+			glm::vec2 closest = Utils::getClosestPointOnSegment(ball.position, points[i], points[(i + 1) % points.size()]);
+			glm::vec2 offset = ball.position - closest;
+			if (glm::dot(offset, offset) <= reach * reach) return false;
+		}
+		return true;
+	}
+
+	void checkWorld(const World& world) {
+		for (int i = 0; i < (int)world.balls.size(); i++) {
+			const Ball& ball = world.balls[i];
+			if (!std::isfinite(ball.velocity.x) || !std::isfinite(ball.velocity.y)) {
+				dump(FLIGHT_NAN_VELOCITY, i, 0.0f);
+				break;
+			}
+			if (world.borderPoints.size() >= 3 && hasEscaped(ball, world.borderPoints)) {
+				dump(FLIGHT_BALL_OUTSIDE_BORDER, i, 0.0f);
+				break;
+			}
+		}
+
+		// a game ends when the last ball drains or an enemy gets below the flippers, anything else is a bug
+		if (lastGameState == RUNNING && world.gameState == GAME_OVER && !world.balls.empty()) {
+			bool enemyThrough = false;
+			for (const Enemy& enemy : world.enemies) {
+				if (!enemy.isDead && enemy.position.y + enemy.radius < world.lowestFlipperY) enemyThrough = true;
+			}
+			if (!enemyThrough) dump(FLIGHT_UNEXPECTED_GAME_OVER, -1, 0.0f);
+		}
+	}
+};
+
+namespace FlightRecord {
+	// entry point for --flight-record: what went wrong and the last few steps before it
+	inline bool print(const std::string& path, int lastFrames = 10) {
+		std::vector<unsigned char> bytes;
+		if (!Utils::readFile(path, bytes)) {
+			printf("ERROR::FLIGHT_RECORDER::FAILED_TO_READ: %s\n", path.c_str());
+			return false;
+		}
+		if (bytes.size() < HEADER_SIZE || memcmp(bytes.data(), MAGIC, 4) != 0) {
+			printf("ERROR::FLIGHT_RECORDER::NOT_A_FLIGHT_RECORD: %s\n", path.c_str());
+			return false;
+		}
+
+		uint16_t version, anomaly;
+		int32_t detail;
+		float value;
+		uint32_t count;
+		memcpy(&version, bytes.data() + 4, 2);
+		memcpy(&anomaly, bytes.data() + 6, 2);
+		memcpy(&detail, bytes.data() + 8, 4);
+		memcpy(&value, bytes.data() + 12, 4);
+		memcpy(&count, bytes.data() + 16, 4);
+		if (version != VERSION || anomaly >= FLIGHT_ANOMALY_COUNT) {
+			printf("ERROR::FLIGHT_RECORDER::UNSUPPORTED_VERSION %u\n", version);
+			return false;
+		}
+
+		// frame offsets first, the interesting part is at the end
+		std::vector<size_t> offsets;
+		size_t offset = HEADER_SIZE;
+		float seconds = 0.0f;
+		for (uint32_t i = 0; i < count && offset + sizeof(FlightFrameHeader) <= bytes.size(); i++) {
+			FlightFrameHeader header;
+			memcpy(&header, bytes.data() + offset, sizeof(header));
+			size_t size = getFrameSize(header.ballCount, header.enemyCount, header.flipperCount);
+			if (offset + size > bytes.size()) break;
+			offsets.push_back(offset);
+			seconds += header.dt;
+			offset += size;
+		}
+
+		printf("%s", FLIGHT_ANOMALY_NAMES[anomaly]);
+		if (detail >= 0) printf(", ball %d", detail);
+		if (anomaly == FLIGHT_FRAME_TIME_SPIKE) printf(", %.1f ms frame", value * 1000.0f);
+		printf("\n%d steps, %.1fs recorded\n", (int)offsets.size(), seconds);
+
+		size_t first = offsets.size() > (size_t)lastFrames ? offsets.size() - lastFrames : 0;
+		for (size_t i = first; i < offsets.size(); i++) {
+			FlightFrameHeader header;
+			memcpy(&header, bytes.data() + offsets[i], sizeof(header));
+			const uint8_t* data = bytes.data() + offsets[i] + sizeof(header);
+			printf("step %8llu  dt %6.2f ms  %s  score %6d  %3u balls  %3u enemies  flippers",
+				(unsigned long long)header.step, header.dt * 1000.0f, header.gameState == GAME_OVER ? "over" : "run ",
+				header.score, header.ballCount, header.enemyCount);
+			const uint8_t* flipperData = data + header.ballCount * 8 + header.enemyCount * 4;
+			for (int f = 0; f < header.flipperCount; f++) {
+				uint16_t rotation;
+				memcpy(&rotation, flipperData + f * 2, 2);
+				printf(" %5.2f", glm::unpackHalf1x16(rotation));
+			}
+			printf("\n");
+
+			// the ball that set it off, on the last step
+			if (i + 1 == offsets.size() && detail >= 0 && detail < header.ballCount) {
+				uint32_t packed[2];
+				memcpy(packed, data + detail * 8, sizeof(packed));
+				glm::vec2 position = glm::unpackHalf2x16(packed[0]);
+				glm::vec2 velocity = glm::unpackHalf2x16(packed[1]);
+				printf("  ball %d at (%.2f, %.2f) moving (%.2f, %.2f)\n", detail, position.x, position.y, velocity.x, velocity.y);
+			}
+		}
+		return true;
+	}
+}
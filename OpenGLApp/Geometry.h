@@ -0,0 +1,118 @@
+#pragma once
+#include <array>
+#include <cmath>
+#include <cstdint>
+
+#include "Utils.h"
+
+// vertex and index data of the shapes the renderer draws, and a sine table, all computed by the
+// compiler. nothing here is filled in at startup and nothing of it can be written to
+namespace Geometry {
+	constexpr double PI = 3.14159265358979323846;
+	constexpr double TWO_PI = 2.0 * PI;
+	constexpr double HALF_PI = 0.5 * PI;
+
+	// sine for constant expressions, std::sin is not constexpr. reduced to [-pi/2, pi/2] and a
+	// taylor series to x^25, which is below double rounding there
+	constexpr double constexprSin(double x) {
+		double turns = (x + PI) / TWO_PI;
+		long long whole = (long long)turns;
+		if ((double)whole > turns) whole--;
+		x -= (double)whole * TWO_PI;
+		if (x > HALF_PI) x = PI - x;
+		else if (x < -HALF_PI) x = -PI - x;
+
+		double x2 = x * x;
+		double term = x;
+		double sum = x;
+		for (int n = 1; n <= 12; n++) {
+			term *= -x2 / (double)((2 * n) * (2 * n + 1));
+			sum += term;
+		}
+		return sum;
+	}
+
+	constexpr double constexprCos(double x) {
+		return constexprSin(x + HALF_PI);
+	}
+
+	// sine of RESOLUTION evenly spaced angles over a full turn, one more entry closes the turn.
+	// sin and cos interpolate between neighbours, good to about (2 pi / RESOLUTION)^2 / 8: 5e-6 at
+	// 1024. for drawing, not for the simulation, whose bits replays and the state hash depend on
+	template <int RESOLUTION>
+	struct SineTable {
+		static_assert(RESOLUTION >= 4 && (RESOLUTION & (RESOLUTION - 1)) == 0, "the resolution has to be a power of two");
+
+		std::array<float, RESOLUTION + 1> values;
+
+		constexpr SineTable() : values() {
+			for (int i = 0; i <= RESOLUTION; i++) {
+				values[i] = (float)constexprSin(TWO_PI * i / RESOLUTION);
+			}
+		}
+
+		// quarter turns are whole entries, cos is sin a quarter turn ahead
+		float sin(float angle) const {
+			return lookUp(angle * (float)(RESOLUTION / TWO_PI));
+		}
+
+		float cos(float angle) const {
+			return lookUp(angle * (float)(RESOLUTION / TWO_PI) + (float)(RESOLUTION / 4));
+		}
+
+	private:
+		float lookUp(float position) const {
+			float floored = std::floor(position);
+			int index = (int)floored & (RESOLUTION - 1);
+			float t = position - floored;
+			return values[index] + (values[index + 1] - values[index]) * t;
+		}
+	};
+
+	constexpr int SINE_TABLE_RESOLUTION = 1024;
+	inline constexpr SineTable<SINE_TABLE_RESOLUTION> SINE_TABLE;
+
+	// unit circle as a triangle fan: the center, then a vertex every degree all the way round, x y z
+	constexpr unsigned int CIRCLE_VERTEX_COUNT = 362;
+
+	constexpr std::array<float, CIRCLE_VERTEX_COUNT * 3> CIRCLE_VERTICES = []() {
+		std::array<float, CIRCLE_VERTEX_COUNT * 3> vertices = {};
+		for (unsigned int i = 1; i < CIRCLE_VERTEX_COUNT; i++) {
+			double angle = Utils::deg2Rad((float)i);
+			vertices[i * 3] = (float)constexprCos(angle);
+			vertices[i * 3 + 1] = (float)constexprSin(angle);
+		}
+		return vertices;
+	}();
+
+	constexpr std::array<unsigned int, CIRCLE_VERTEX_COUNT> CIRCLE_INDICES = []() {
+		std::array<unsigned int, CIRCLE_VERTEX_COUNT> indices = {};
+		for (unsigned int i = 0; i < CIRCLE_VERTEX_COUNT; i++) {
+			indices[i] = i;
+		}
+		return indices;
+	}();
+
+	// unit square from (0, -0.5) to (1, 0.5), a line of length 1 along x with its width centered
+	constexpr std::array<float, 4 * 3> SQUARE_VERTICES = {
+		0.0f, -0.5f, 0.0f,
+		1.0f, -0.5f, 0.0f,
+		1.0f, 0.5f, 0.0f,
+		0.0f, 0.5f, 0.0f
+	};
+
+	constexpr std::array<unsigned int, 6> SQUARE_INDICES = { 0, 1, 2, 0, 2, 3 };
+
+	constexpr std::array<unsigned int, 5> OUTLINE_INDICES = { 0, 1, 2, 3, 0 };
+
+	// sprite quad from (0, 0) to (1, 1) as two triangles, position and texture coordinate
+	constexpr std::array<float, 6 * 4> QUAD_VERTICES = {
+		0.0f, 1.0f, 0.0f, 1.0f,
+		1.0f, 0.0f, 1.0f, 0.0f,
+		0.0f, 0.0f, 0.0f, 0.0f,
+
+		0.0f, 1.0f, 0.0f, 1.0f,
+		1.0f, 1.0f, 1.0f, 1.0f,
+		1.0f, 0.0f, 1.0f, 0.0f
+	};
+}
@@ -0,0 +1,49 @@
+#pragma once
+#include "Scalar.h"
+
+// integrators that move a body one step under a constant acceleration, as policies: a type with a
+// static integrate() and a NAME, handed to BallT::update and World::updateSimulationWith as a
+// template argument, so each choice is compiled into its own step with nothing to branch on.
+// written against ScalarMath types like the shapes in World.h, so they work in fixed point too.
+// collisions act on the velocity after the step, none of these keeps state of its own
+namespace Integrators {
+	// velocity first, then position with the new velocity (symplectic euler). what the game has
+	// always used, first order: a thrown ball lands a bit short, by half a gravity step per step
+	struct SemiImplicitEuler {
+		static constexpr const char* NAME = "semi-implicit euler";
+
+		template <typename T>
+		static void integrate(VecT<T>& position, VecT<T>& velocity, VecT<T> acceleration, T dt) {
+			velocity += acceleration * dt;
+			position += velocity * dt;
+		}
+	};
+
+	// position from the velocity and acceleration at the start, then the velocity from the mean
+	// of the accelerations at both ends, which are the same under gravity. second order, free
+	// flight is exact
+	struct VelocityVerlet {
+		static constexpr const char* NAME = "velocity verlet";
+
+		template <typename T>
+		static void integrate(VecT<T>& position, VecT<T>& velocity, VecT<T> acceleration, T dt) {
+			position += velocity * dt + acceleration * (T(0.5f) * dt * dt);
+			velocity += acceleration * dt;
+		}
+	};
+
+	// half a step of drift, a full kick, half a step of drift: verlet's position form with the
+	// velocity carried along instead of the previous position, so collision code can keep
+	// changing the velocity. second order, free flight is exact
+	struct PositionVerlet {
+		static constexpr const char* NAME = "position verlet";
+
+		template <typename T>
+		static void integrate(VecT<T>& position, VecT<T>& velocity, VecT<T> acceleration, T dt) {
+			T halfDt = T(0.5f) * dt;
+			position += velocity * halfDt;
+			velocity += acceleration * dt;
+			position += velocity * halfDt;
+		}
+	};
+}
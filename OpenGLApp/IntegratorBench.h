@@ -0,0 +1,119 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+#include "Integrator.h"
+#include "World.h"
+
+// the ball integrators from Integrator.h side by side: how far a thrown ball ends up from the exact
+// parabola, how far off a dropped ball bounces back, and what a step of the default table costs
+// with each. each integrator is its own instantiation of the same code
+namespace IntegratorBench {
+	const float STEP_SIZES[] = { 1.0f / 30.0f, 1.0f / 60.0f, 1.0f / 120.0f, 1.0f / 240.0f };
+	const int STEP_SIZE_COUNT = sizeof(STEP_SIZES) / sizeof(STEP_SIZES[0]);
+	const float FLIGHT_SECONDS = 2.0f;
+	const float BOUNCE_SECONDS = 4.0f;
+
+	// distance from where a ball thrown up and sideways really is after FLIGHT_SECONDS
+	template <typename Integrator>
+	inline float getFlightError(float dt) {
+		const glm::vec2 THROW_VELOCITY = glm::vec2(20.0f, 60.0f);
+		Ball ball;
+		ball.velocity = THROW_VELOCITY;
+		int steps = (int)std::round(FLIGHT_SECONDS / dt);
+		for (int i = 0; i < steps; i++) {
+			ball.update<Integrator>(dt);
+		}
+		float t = steps * dt;
+		glm::vec2 exact = THROW_VELOCITY * t + GRAVITY * (0.5f * t * t);
+		return glm::length(ball.position - exact);
+	}
+
+	// a ball dropped onto a floor, how far off the exact height its first bounce goes: the drop height
+	// times RESTITUTION squared. the contact pushes the ball out and scales the velocity, so this is
+	// the integrator together with the collision code
+	template <typename Integrator>
+	inline float getBounceError(float dt) {
+		const float DROP_HEIGHT = 20.0f;
+		// wound like the table border
+		std::vector<glm::vec2> box = { glm::vec2(-50.0f, 50.0f), glm::vec2(-50.0f, 0.0f), glm::vec2(50.0f, 0.0f), glm::vec2(50.0f, 50.0f) };
+		Ball ball;
+		float restingHeight = ball.radius + BORDER_SIZE * 0.5f;
+		ball.position = glm::vec2(0.0f, restingHeight + DROP_HEIGHT);
+		bool hasBounced = false;
+		float apex = 0.0f;
+		int steps = (int)std::round(BOUNCE_SECONDS / dt);
+		for (int i = 0; i < steps; i++) {
+			ball.update<Integrator>(dt);
+			handleCollision(ball, box);
+			if (ball.velocity.y > 0.0f) hasBounced = true;
+			else if (hasBounced) break;
+			if (hasBounced) apex = std::max(apex, ball.position.y);
+		}
+		return std::abs(apex - (restingHeight + DROP_HEIGHT * RESTITUTION * RESTITUTION));
+	}
+
+	// the default table with ballCount balls and the flippers on autoplay, only the simulation half
+	// of the step. drained balls go back to a spawn point so the count stays the same
+	template <typename Integrator>
+	inline float secondsPerStep(int ballCount, int steps, float dt) {
+		World world(1);
+		world.balls.clear();
+		for (int i = 0; i < ballCount; i++) {
+			Ball ball = world.createBall();
+			ball.position = glm::mix(world.spawnPosLeft, world.spawnPosRight, (i % 8 + 0.5f) / 8.0f) - glm::vec2(0.0f, (i / 8) * ball.radius * 2.5f);
+			world.balls.push_back(ball);
+		}
+
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		for (int i = 0; i < steps; i++) {
+			world.autoplay();
+			world.template updateSimulationWith<Integrator>(dt);
+			for (Ball& ball : world.balls) {
+				if (ball.position.y < world.ballDespawnHeight) {
+					ball.position = world.spawnPosLeft;
+					ball.velocity = glm::vec2(0.0f);
+				}
+			}
+		}
+		std::chrono::duration<float> elapsed = std::chrono::steady_clock::now() - start;
+		return elapsed.count() / steps;
+	}
+
+	// the largest of STEP_SIZES with a flight error no worse than the given one
+	template <typename Integrator>
+	inline float getCoarsestStep(float error) {
+		for (int i = 0; i < STEP_SIZE_COUNT; i++) {
+			if (getFlightError<Integrator>(STEP_SIZES[i]) <= error) return STEP_SIZES[i];
+		}
+		return 0.0f;
+	}
+
+	template <typename Integrator>
+	inline void printRow(int ballCount, int steps, float referenceError) {
+		printf("  %-20s", Integrator::NAME);
+		for (int i = 0; i < STEP_SIZE_COUNT; i++) {
+			printf("  %9.5f", getFlightError<Integrator>(STEP_SIZES[i]));
+		}
+		printf("  | %8.5f", getBounceError<Integrator>(STEP_SIZES[1]));
+		printf("  | %8.2f us/step", secondsPerStep<Integrator>(ballCount, steps, STEP_SIZES[1]) * 1000000.0f);
+		float coarsest = getCoarsestStep<Integrator>(referenceError);
+		if (coarsest > 0.0f) printf("  | 1/%.0f\n", 1.0f / coarsest);
+		else printf("  | none\n");
+	}
+
+	// entry point for --integrator-bench
+	inline void runAndReport(int ballCount, int steps) {
+		ballCount = std::max(ballCount, 1);
+		steps = std::max(steps, 1);
+		float referenceError = getFlightError<Integrators::SemiImplicitEuler>(1.0f / 60.0f);
+		printf("flight error after %.0fs at dt 1/30 1/60 1/120 1/240 | bounce error at 1/60 | %d balls at 1/60, %d steps, one thread | coarsest dt as accurate as semi-implicit euler at 1/60\n",
+			FLIGHT_SECONDS, ballCount, steps);
+		printRow<Integrators::SemiImplicitEuler>(ballCount, steps, referenceError);
+		printRow<Integrators::VelocityVerlet>(ballCount, steps, referenceError);
+		printRow<Integrators::PositionVerlet>(ballCount, steps, referenceError);
+	}
+}
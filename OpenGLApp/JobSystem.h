@@ -0,0 +1,227 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// counts unfinished jobs. a job submitted with a dependency is held back until that
+// counter drains, which is how jobs are chained without blocking a worker
+struct JobCounter {
+	std::atomic<int> pending;
+	std::mutex mutex;
+	std::vector<std::pair<std::function<void()>, JobCounter*>> continuations;
+	JobCounter() : pending(0) {}
+
+	bool isDone() const {
+		return pending.load(std::memory_order_acquire) == 0;
+	}
+};
+
+// work stealing job system. every worker owns a deque: it pushes and pops at the back,
+// idle workers steal from the front of the others. threads that are not workers (the main
+// and simulation threads) submit through one extra shared deque and help out while they wait.
+// in deterministic mode nothing is queued, every job runs inline in submission order
+struct JobSystem {
+	struct Job {
+		std::function<void()> function;
+		JobCounter* counter;
+	};
+
+	struct WorkQueue {
+		std::mutex mutex;
+		std::deque<Job> jobs;
+	};
+
+	std::vector<std::thread> workers;
+	std::vector<std::unique_ptr<WorkQueue>> queues;
+	std::atomic<int> queuedCount;
+	std::mutex sleepMutex;
+	std::condition_variable workAvailable;
+	bool stopping;
+	bool deterministic;
+	// runs first on every worker thread, set before start()
+	std::function<void()> workerSetup;
+	// the job system a worker thread belongs to and its deque there. a worker of another system
+	// that submits or waits here is a non-worker to this one
+	inline static thread_local const JobSystem* workerOwner = nullptr;
+	inline static thread_local int workerIndex = -1;
+
+	JobSystem() : queuedCount(0), stopping(false), deterministic(true) {}
+
+	~JobSystem() {
+		stop();
+	}
+
+	JobSystem(const JobSystem&) = delete;
+	JobSystem& operator=(const JobSystem&) = delete;
+
+	// threadCount 0 uses one worker per hardware thread besides the caller
+	void start(unsigned int threadCount = 0, bool isDeterministic = false) {
+		stop();
+		deterministic = isDeterministic;
+		if (deterministic) return;
+
+		if (threadCount == 0) {
+			unsigned int cores = std::thread::hardware_concurrency();
+			threadCount = cores > 1 ? cores - 1 : 1;
+		}
+		stopping = false;
+		for (unsigned int i = 0; i <= threadCount; i++) {
+			queues.push_back(std::make_unique<WorkQueue>());
+		}
+		for (unsigned int i = 0; i < threadCount; i++) {
+			workers.emplace_back(&JobSystem::workerLoop, this, (int)i);
+		}
+	}
+
+	void stop() {
+		{
+			std::lock_guard<std::mutex> lock(sleepMutex);
+			stopping = true;
+		}
+		workAvailable.notify_all();
+		for (std::thread& worker : workers) {
+			worker.join();
+		}
+		workers.clear();
+		queues.clear();
+		queuedCount = 0;
+		deterministic = true;
+	}
+
+	unsigned int getThreadCount() const {
+		return workers.size() + 1;
+	}
+
+	void submit(std::function<void()> function, JobCounter* counter = nullptr, JobCounter* dependency = nullptr) {
+		if (counter != nullptr) counter->pending.fetch_add(1, std::memory_order_relaxed);
+
+		if (dependency != nullptr && !deterministic) {
+			std::lock_guard<std::mutex> lock(dependency->mutex);
+			if (!dependency->isDone()) {
+				dependency->continuations.emplace_back(std::move(function), counter);
+				return;
+			}
+		}
+		push({ std::move(function), counter });
+	}
+
+	// splits [0, count) into ranges of at most grainSize and calls function(begin, end)
+	// for each, returning once all of them finished. small loops stay on the calling thread
+	template <typename Function>
+	void parallelFor(int count, int grainSize, const Function& function) {
+		if (count <= 0) return;
+		grainSize = std::max(grainSize, 1);
+		if (deterministic || count <= grainSize) {
+			function(0, count);
+			return;
+		}
+
+		JobCounter counter;
+		for (int begin = 0; begin < count; begin += grainSize) {
+			int end = std::min(begin + grainSize, count);
+			submit([&function, begin, end] { function(begin, end); }, &counter);
+		}
+		wait(counter);
+	}
+
+	// runs queued jobs on the calling thread until the counter drains,
+	// a counter must be waited on before it goes out of scope
+	void wait(JobCounter& counter) {
+		while (!counter.isDone()) {
+			if (!runOne()) std::this_thread::yield();
+		}
+		std::lock_guard<std::mutex> lock(counter.mutex);
+	}
+
+private:
+	void push(Job job) {
+		if (deterministic) {
+			execute(job);
+			return;
+		}
+
+		WorkQueue& queue = *queues[ownQueueIndex()];
+		{
+			std::lock_guard<std::mutex> lock(queue.mutex);
+			queue.jobs.push_back(std::move(job));
+		}
+		{
+			std::lock_guard<std::mutex> lock(sleepMutex);
+			queuedCount.fetch_add(1, std::memory_order_release);
+		}
+		workAvailable.notify_one();
+	}
+
+	bool pop(Job& job) {
+		int ownIndex = ownQueueIndex();
+		int queueCount = queues.size();
+		for (int i = 0; i < queueCount; i++) {
+			// own deque first, newest job first so its data is still warm in cache
+			int index = (ownIndex + i) % queueCount;
+			WorkQueue& queue = *queues[index];
+			std::lock_guard<std::mutex> lock(queue.mutex);
+			if (queue.jobs.empty()) continue;
+			if (i == 0) {
+				job = std::move(queue.jobs.back());
+				queue.jobs.pop_back();
+			}
+			else {
+				job = std::move(queue.jobs.front());
+				queue.jobs.pop_front();
+			}
+			queuedCount.fetch_sub(1, std::memory_order_relaxed);
+			return true;
+		}
+		return false;
+	}
+
+	// the shared deque for threads that are not workers of this system
+	int ownQueueIndex() const {
+		return workerOwner == this ? workerIndex : (int)queues.size() - 1;
+	}
+
+	bool runOne() {
+		if (queuedCount.load(std::memory_order_acquire) == 0) return false;
+		Job job;
+		if (!pop(job)) return false;
+		execute(job);
+		return true;
+	}
+
+	void execute(Job& job) {
+		job.function();
+		if (job.counter == nullptr) return;
+
+		// the decrement happens under the counter's lock so a waiter cannot destroy the counter
+		// before this is done with it, and no continuation slips in after the release
+		std::vector<std::pair<std::function<void()>, JobCounter*>> released;
+		{
+			std::lock_guard<std::mutex> lock(job.counter->mutex);
+			if (job.counter->pending.fetch_sub(1, std::memory_order_acq_rel) != 1) return;
+			released.swap(job.counter->continuations);
+		}
+		for (auto& continuation : released) {
+			push({ std::move(continuation.first), continuation.second });
+		}
+	}
+
+	void workerLoop(int index) {
+		workerOwner = this;
+		workerIndex = index;
+		if (workerSetup) workerSetup();
+		while (true) {
+			if (runOne()) continue;
+
+			std::unique_lock<std::mutex> lock(sleepMutex);
+			workAvailable.wait(lock, [this] { return stopping || queuedCount.load(std::memory_order_relaxed) > 0; });
+			if (stopping) return;
+		}
+	}
+};
@@ -0,0 +1,353 @@
+#pragma once
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "World.h"
+
+// LANES small worlds on the same static table, stepped together. every per-world value is stored
+// as an array with one entry per lane, so each loop below runs the same math for all worlds
+// side by side and the compiler can keep one world per SIMD lane. the loops avoid branches on
+// purpose, lanes that do not take part are masked with 0/1 floats instead.
+// only the physics runs here (balls, flippers, obstacles, border), enemies and scoring stay in World.
+// with gcc/clang build with -fno-math-errno, otherwise sqrt keeps the lane loops scalar.
+// 8 lanes fill an AVX register, use 16 for AVX-512
+constexpr int LOCKSTEP_LANES = 8;
+// every ball of an episode starts on a random side, up to SPAWN_JITTER off the spawn point and
+// with up to SPAWN_SPEED sideways, so episodes with different seeds play out differently
+constexpr float LOCKSTEP_SPAWN_JITTER = 2.0f;
+constexpr float LOCKSTEP_SPAWN_SPEED = 5.0f;
+// side, offset, speed
+constexpr int LOCKSTEP_ROLLS_PER_BALL = 3;
+
+// ball slot k of every lane, so a ball update touches LANES consecutive floats per field
+template <int LANES>
+struct LaneBalls {
+	alignas(64) float px[LANES];
+	alignas(64) float py[LANES];
+	alignas(64) float vx[LANES];
+	alignas(64) float vy[LANES];
+	alignas(64) float active[LANES];
+};
+
+template <int LANES>
+struct LaneFlipper {
+	alignas(64) float rotation[LANES];
+	alignas(64) float angularVelocity[LANES];
+	alignas(64) float flipped[LANES];
+	alignas(64) float endX[LANES];
+	alignas(64) float endY[LANES];
+};
+
+template <int LANES>
+struct LockstepWorlds {
+	// the shared table, taken from a freshly reset World
+	std::vector<glm::vec2> borderPoints;
+	std::vector<Obstacle> obstacles;
+	std::vector<Flipper> flipperShapes;
+	float ballRadius;
+	float ballMass;
+	float ballDespawnHeight;
+	glm::vec2 spawnPosLeft, spawnPosRight;
+
+	std::vector<LaneBalls<LANES>> balls;
+	std::vector<LaneFlipper<LANES>> flippers;
+	alignas(64) float time[LANES];
+	std::vector<float> spawnRolls;
+
+	LockstepWorlds(int ballSlots = 1) {
+		World table;
+		borderPoints = table.borderPoints;
+		obstacles = table.obstacles;
+		flipperShapes = table.flippers;
+		Ball ball = table.createBall();
+		ballRadius = ball.radius;
+		ballMass = ball.mass;
+		ballDespawnHeight = table.ballDespawnHeight;
+		spawnPosLeft = table.spawnPosLeft;
+		spawnPosRight = table.spawnPosRight;
+
+		balls.resize(std::max(ballSlots, 1));
+		spawnRolls.resize(balls.size() * LOCKSTEP_ROLLS_PER_BALL);
+		flippers.resize(flipperShapes.size());
+		for (int lane = 0; lane < LANES; lane++) {
+			resetLane(lane, lane);
+		}
+	}
+
+	void resetLane(int lane, uint32_t seed) {
+		// lanes keep no generator state, slot k starts from counter draws 3k to 3k + 2 of the seed
+		Random::fillFloats(seed, 0, spawnRolls.data(), spawnRolls.size());
+		time[lane] = 0.0f;
+		for (size_t k = 0; k < balls.size(); k++) {
+			LaneBalls<LANES>& slot = balls[k];
+			const float* rolls = &spawnRolls[k * LOCKSTEP_ROLLS_PER_BALL];
+			glm::vec2 spawn = rolls[0] > 0.5f ? spawnPosRight : spawnPosLeft;
+			slot.px[lane] = spawn.x + (rolls[1] * 2.0f - 1.0f) * LOCKSTEP_SPAWN_JITTER;
+			slot.py[lane] = spawn.y;
+			slot.vx[lane] = (rolls[2] * 2.0f - 1.0f) * LOCKSTEP_SPAWN_SPEED;
+			slot.vy[lane] = 0.0f;
+			slot.active[lane] = 1.0f;
+		}
+		for (LaneFlipper<LANES>& flipper : flippers) {
+			flipper.rotation[lane] = 0.0f;
+			flipper.angularVelocity[lane] = 0.0f;
+			flipper.flipped[lane] = 0.0f;
+		}
+	}
+
+	// parks a lane that has no episode left to run
+	void deactivateLane(int lane) {
+		for (LaneBalls<LANES>& slot : balls) {
+			slot.active[lane] = 0.0f;
+		}
+	}
+
+	bool isLaneRunning(int lane) const {
+		for (const LaneBalls<LANES>& slot : balls) {
+			if (slot.active[lane] != 0.0f) return true;
+		}
+		return false;
+	}
+
+	void setFlipped(int lane, int id, bool isFlipped) {
+		for (size_t f = 0; f < flippers.size(); f++) {
+			if (flipperShapes[f].id == id) flippers[f].flipped[lane] = isFlipped ? 1.0f : 0.0f;
+		}
+	}
+
+	// same policy as World::autoplay, one decision per lane
+	void autoplay() {
+		for (size_t f = 0; f < flippers.size(); f++) {
+			const Flipper& shape = flipperShapes[f];
+			float reach = shape.length + ballRadius;
+			for (int lane = 0; lane < LANES; lane++) {
+				float inReach = 0.0f;
+				for (const LaneBalls<LANES>& slot : balls) {
+					float dx = slot.px[lane] - shape.position.x;
+					float dy = slot.py[lane] - shape.position.y;
+					bool near = slot.active[lane] != 0.0f && dx * dx + dy * dy < reach * reach && dy < shape.length * 0.5f;
+					inReach = near ? 1.0f : inReach;
+				}
+				LaneFlipper<LANES>& flipper = flippers[f];
+				float rotation = flipper.rotation[lane];
+				bool swinging = flipper.flipped[lane] != 0.0f ? rotation < shape.maxRotation : rotation == 0.0f;
+				flipper.flipped[lane] = swinging ? inReach : 0.0f;
+			}
+		}
+	}
+
+	void step(float dt) {
+		updateFlippers(dt);
+		integrateBalls(dt);
+		handleBallCollisions();
+		for (LaneBalls<LANES>& slot : balls) {
+			handleObstacles(slot);
+			handleFlippers(slot);
+			handleBorder(slot);
+			for (int lane = 0; lane < LANES; lane++) {
+				slot.active[lane] = slot.py[lane] < ballDespawnHeight ? 0.0f : slot.active[lane];
+			}
+		}
+		for (int lane = 0; lane < LANES; lane++) {
+			time[lane] += dt;
+		}
+	}
+
+	// Flipper::update and getFlipperEnd for every lane
+	void updateFlippers(float dt) {
+		for (size_t f = 0; f < flippers.size(); f++) {
+			const Flipper& shape = flipperShapes[f];
+			LaneFlipper<LANES>& flipper = flippers[f];
+			float sign = shape.isSignPositive ? 1.0f : -1.0f;
+			for (int lane = 0; lane < LANES; lane++) {
+				float previous = flipper.rotation[lane];
+				float raised = std::min(previous + shape.angularVelocity * dt, shape.maxRotation);
+				float lowered = std::max(previous - shape.angularVelocity * dt, 0.0f);
+				float rotation = flipper.flipped[lane] != 0.0f ? raised : lowered;
+				flipper.rotation[lane] = rotation;
+				flipper.angularVelocity[lane] = sign * (rotation - previous) / dt;
+
+				float angle = shape.restAngle + sign * rotation;
+				flipper.endX[lane] = shape.position.x + std::cos(angle) * shape.length;
+				flipper.endY[lane] = shape.position.y + std::sin(angle) * shape.length;
+			}
+		}
+	}
+
+	// Ball::update through the same BallIntegrator, inactive lanes are integrated too and simply ignored
+	void integrateBalls(float dt) {
+		for (LaneBalls<LANES>& slot : balls) {
+			for (int lane = 0; lane < LANES; lane++) {
+				glm::vec2 position = glm::vec2(slot.px[lane], slot.py[lane]);
+				glm::vec2 velocity = glm::vec2(slot.vx[lane], slot.vy[lane]);
+				BallIntegrator::integrate(position, velocity, GRAVITY, dt);
+				slot.px[lane] = position.x;
+				slot.py[lane] = position.y;
+				slot.vx[lane] = velocity.x;
+				slot.vy[lane] = velocity.y;
+			}
+		}
+	}
+
+	// the ball pair contact response between slots, all balls share radius and mass so the mass terms cancel
+	void handleBallCollisions() {
+		float reach = ballRadius * 2.0f;
+		for (size_t i = 0; i < balls.size(); i++) {
+			for (size_t j = i + 1; j < balls.size(); j++) {
+				LaneBalls<LANES>& a = balls[i];
+				LaneBalls<LANES>& b = balls[j];
+				for (int lane = 0; lane < LANES; lane++) {
+					float dx = b.px[lane] - a.px[lane];
+					float dy = b.py[lane] - a.py[lane];
+					float distance = std::sqrt(dx * dx + dy * dy);
+					float hit = (a.active[lane] * b.active[lane] != 0.0f && distance > 0.0001f && distance <= reach) ? 1.0f : 0.0f;
+					float inverse = hit / std::max(distance, 0.0001f);
+					dx *= inverse;
+					dy *= inverse;
+
+					float correction = (reach - distance) * 0.5f;
+					a.px[lane] -= dx * correction;
+					a.py[lane] -= dy * correction;
+					b.px[lane] += dx * correction;
+					b.py[lane] += dy * correction;
+
+					float v1 = a.vx[lane] * dx + a.vy[lane] * dy;
+					float v2 = b.vx[lane] * dx + b.vy[lane] * dy;
+					float newV1 = (v1 + v2 - (v1 - v2) * RESTITUTION) * 0.5f;
+					float newV2 = (v1 + v2 - (v2 - v1) * RESTITUTION) * 0.5f;
+					a.vx[lane] += dx * (newV1 - v1);
+					a.vy[lane] += dy * (newV1 - v1);
+					b.vx[lane] += dx * (newV2 - v2);
+					b.vy[lane] += dy * (newV2 - v2);
+				}
+			}
+		}
+	}
+
+	void handleObstacles(LaneBalls<LANES>& slot) {
+		for (const Obstacle& obstacle : obstacles) {
+			float reach = ballRadius + obstacle.radius;
+			for (int lane = 0; lane < LANES; lane++) {
+				float dx = slot.px[lane] - obstacle.position.x;
+				float dy = slot.py[lane] - obstacle.position.y;
+				float distance = std::sqrt(dx * dx + dy * dy);
+				float hit = (slot.active[lane] != 0.0f && distance != 0.0f && distance <= reach) ? 1.0f : 0.0f;
+				float inverse = hit / std::max(distance, FLT_MIN);
+				dx *= inverse;
+				dy *= inverse;
+
+				float correction = reach - distance;
+				slot.px[lane] += dx * correction;
+				slot.py[lane] += dy * correction;
+
+				float v = slot.vx[lane] * dx + slot.vy[lane] * dy;
+				slot.vx[lane] += dx * (obstacle.pushAmount - v);
+				slot.vy[lane] += dy * (obstacle.pushAmount - v);
+			}
+		}
+	}
+
+	void handleFlippers(LaneBalls<LANES>& slot) {
+		for (size_t f = 0; f < flippers.size(); f++) {
+			const Flipper& shape = flipperShapes[f];
+			const LaneFlipper<LANES>& flipper = flippers[f];
+			float reach = ballRadius + shape.radius * 0.5f;
+			for (int lane = 0; lane < LANES; lane++) {
+				// Utils::getClosestPointOnSegment against this lane's flipper end
+				float abx = flipper.endX[lane] - shape.position.x;
+				float aby = flipper.endY[lane] - shape.position.y;
+				float t = ((slot.px[lane] - shape.position.x) * abx + (slot.py[lane] - shape.position.y) * aby) / (abx * abx + aby * aby);
+				t = std::max(0.0f, std::min(1.0f, t));
+				float cx = shape.position.x + abx * t;
+				float cy = shape.position.y + aby * t;
+
+				float dx = slot.px[lane] - cx;
+				float dy = slot.py[lane] - cy;
+				float distance = std::sqrt(dx * dx + dy * dy);
+				float hit = (slot.active[lane] != 0.0f && distance != 0.0f && distance <= reach) ? 1.0f : 0.0f;
+				float inverse = hit / std::max(distance, FLT_MIN);
+				dx *= inverse;
+				dy *= inverse;
+
+				float correction = reach - distance;
+				slot.px[lane] += dx * correction;
+				slot.py[lane] += dy * correction;
+
+				float rx = cx + dx * shape.radius - shape.position.x;
+				float ry = cy + dy * shape.radius - shape.position.y;
+				float surfaceX = -ry * flipper.angularVelocity[lane];
+				float surfaceY = rx * flipper.angularVelocity[lane];
+
+				float v = slot.vx[lane] * dx + slot.vy[lane] * dy;
+				float newV = surfaceX * dx + surfaceY * dy;
+				slot.vx[lane] += dx * (newV - v);
+				slot.vy[lane] += dy * (newV - v);
+			}
+		}
+	}
+
+	// the circle against segment chain kernel and the border bounce: closest segment first, then the same push and bounce
+	void handleBorder(LaneBalls<LANES>& slot) {
+		alignas(64) float minDistance[LANES];
+		alignas(64) float closestX[LANES];
+		alignas(64) float closestY[LANES];
+		alignas(64) float normalX[LANES];
+		alignas(64) float normalY[LANES];
+		for (int lane = 0; lane < LANES; lane++) {
+			minDistance[lane] = FLT_MAX;
+			closestX[lane] = closestY[lane] = normalX[lane] = normalY[lane] = 0.0f;
+		}
+
+		int n = borderPoints.size();
+		for (int i = 0; i < n; i++) {
+			glm::vec2 a = borderPoints[i];
+			glm::vec2 ab = borderPoints[(i + 1) % n] - a;
+			float lengthSquared = glm::dot(ab, ab);
+			if (lengthSquared == 0.0f) continue;
+			for (int lane = 0; lane < LANES; lane++) {
+				float t = ((slot.px[lane] - a.x) * ab.x + (slot.py[lane] - a.y) * ab.y) / lengthSquared;
+				t = std::max(0.0f, std::min(1.0f, t));
+				float cx = a.x + ab.x * t;
+				float cy = a.y + ab.y * t;
+				float dx = slot.px[lane] - cx;
+				float dy = slot.py[lane] - cy;
+				float distance = std::sqrt(dx * dx + dy * dy);
+				bool closer = distance < minDistance[lane];
+				minDistance[lane] = closer ? distance : minDistance[lane];
+				closestX[lane] = closer ? cx : closestX[lane];
+				closestY[lane] = closer ? cy : closestY[lane];
+				normalX[lane] = closer ? -ab.y : normalX[lane];
+				normalY[lane] = closer ? ab.x : normalY[lane];
+			}
+		}
+
+		float skin = BORDER_SIZE * 0.5f;
+		for (int lane = 0; lane < LANES; lane++) {
+			float dx = slot.px[lane] - closestX[lane];
+			float dy = slot.py[lane] - closestY[lane];
+			float distance = std::sqrt(dx * dx + dy * dy);
+			bool onLine = distance == 0.0f;
+			dx = onLine ? normalX[lane] : dx;
+			dy = onLine ? normalY[lane] : dy;
+			distance = onLine ? std::sqrt(dx * dx + dy * dy) : distance;
+			float inverse = 1.0f / std::max(distance, FLT_MIN);
+			dx *= inverse;
+			dy *= inverse;
+
+			bool inside = dx * normalX[lane] + dy * normalY[lane] >= 0.0f;
+			bool hit = slot.active[lane] != 0.0f && (!inside || distance <= ballRadius + skin);
+			float push = inside ? (ballRadius - distance + skin) : -(distance + ballRadius - skin);
+			push = hit ? push : 0.0f;
+			slot.px[lane] += dx * push;
+			slot.py[lane] += dy * push;
+
+			float v = slot.vx[lane] * dx + slot.vy[lane] * dy;
+			float bounce = hit ? (std::abs(v) * RESTITUTION - v) : 0.0f;
+			slot.vx[lane] += dx * bounce;
+			slot.vy[lane] += dy * bounce;
+		}
+	}
+};
@@ -0,0 +1,283 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "Scalar.h"
+#include "Table.h"
+
+// collision shapes and the kernels that find where two of them touch. a kernel is a specialization
+// of Narrowphase<A, B>, picked by the compiler from the two shape types, so a pair without one is a
+// compile error instead of a runtime miss. shapes are plain values made from the bodies in World.h,
+// kernels only read them and fill in a contact, what a contact does is up to the bodies.
+// written against ScalarMath like the bodies, so they work in fixed point too
+template <typename T>
+struct CircleShapeT {
+	typedef T Scalar;
+	VecT<T> center;
+	T radius;
+};
+
+// a segment with a radius around it
+template <typename T>
+struct CapsuleShapeT {
+	typedef T Scalar;
+	VecT<T> start;
+	VecT<T> end;
+	T radius;
+};
+
+// closed chain of segments with a thickness of 2 * radius, wound counter clockwise like the table
+// border: the inside is on the left of every segment. the points are borrowed
+template <typename T>
+struct SegmentChainT {
+	typedef T Scalar;
+	const VecT<T>* points;
+	int count;
+	T radius;
+};
+
+// the same chain from the baked segments and segment tree of a table
+struct BakedChainShape {
+	typedef float Scalar;
+	const TableDescription* table;
+	float radius;
+};
+
+// convex polygon wound counter clockwise, rounded by radius. the points are borrowed
+template <typename T>
+struct ConvexPolygonT {
+	typedef T Scalar;
+	const VecT<T>* points;
+	int count;
+	T radius;
+};
+
+typedef CircleShapeT<float> CircleShape;
+typedef CapsuleShapeT<float> CapsuleShape;
+typedef SegmentChainT<float> SegmentChain;
+typedef ConvexPolygonT<float> ConvexPolygon;
+
+// where A touches B. normal is the unit direction that moves A out of B and depth how far along it.
+// depth is only negative for a circle that ended up behind a chain segment and has to go back
+// through it. point is the closest point on B's core (center, segment or edge), distance how far
+// A's center is from it
+template <typename T>
+struct ContactT {
+	VecT<T> normal;
+	VecT<T> point;
+	T depth;
+	T distance;
+};
+
+typedef ContactT<float> Contact;
+
+// the kernel table, one specialization per supported pair
+template <typename A, typename B>
+struct Narrowphase;
+
+// true and a contact when a and b touch
+template <typename A, typename B>
+inline bool collide(const A& a, const B& b, ContactT<typename A::Scalar>& contact) {
+	return Narrowphase<A, B>::collide(a, b, contact);
+}
+
+// circle against a point with a radius around it, the circle and capsule kernels both come here.
+// no contact when the centers coincide, there is no direction to push in
+template <typename T>
+inline bool collideCircleCore(const CircleShapeT<T>& circle, VecT<T> point, T radius, ContactT<T>& contact) {
+	VecT<T> d = circle.center - point;
+	T distance = ScalarMath::length(d);
+	if (distance == T(0.0f) || distance > circle.radius + radius) return false;
+
+	contact.normal = ScalarMath::normalize(d);
+	contact.point = point;
+	contact.depth = circle.radius + radius - distance;
+	contact.distance = distance;
+	return true;
+}
+
+// circle against one chain segment given the closest point on it. in front of the segment the
+// circle is pushed out to the chain's radius, behind it all the way through to the front, along
+// the direction to the center either way
+template <typename T>
+inline bool collideCircleChainSegment(const CircleShapeT<T>& circle, VecT<T> closest, VecT<T> ab, T radius, ContactT<T>& contact) {
+	VecT<T> normal = ScalarMath::perpendicular(ab);
+	VecT<T> d = circle.center - closest;
+	T distance = ScalarMath::length(d);
+	if (distance == T(0.0f)) {
+		d = normal;
+		distance = ScalarMath::length(normal);
+	}
+	d = ScalarMath::normalize(d);
+
+	if (ScalarMath::dot(d, normal) >= T(0.0f)) {
+		if (distance > circle.radius + radius) return false;
+
+		contact.depth = circle.radius - distance + radius;
+	}
+	else {
+		contact.depth = -(distance + circle.radius - radius);
+	}
+	contact.normal = d;
+	contact.point = closest;
+	contact.distance = distance;
+	return true;
+}
+
+template <typename T>
+struct Narrowphase<CircleShapeT<T>, CircleShapeT<T>> {
+	static bool collide(const CircleShapeT<T>& a, const CircleShapeT<T>& b, ContactT<T>& contact) {
+		return collideCircleCore(a, b.center, b.radius, contact);
+	}
+};
+
+template <typename T>
+struct Narrowphase<CircleShapeT<T>, CapsuleShapeT<T>> {
+	static bool collide(const CircleShapeT<T>& a, const CapsuleShapeT<T>& b, ContactT<T>& contact) {
+		VecT<T> closest = ScalarMath::getClosestPointOnSegment(a.center, b.start, b.end);
+		return collideCircleCore(a, closest, b.radius, contact);
+	}
+};
+
+// the closest segment decides, of equally close ones the first
+template <typename T>
+struct Narrowphase<CircleShapeT<T>, SegmentChainT<T>> {
+	static bool collide(const CircleShapeT<T>& a, const SegmentChainT<T>& b, ContactT<T>& contact) {
+		if (b.count < 3) return false;
+
+		VecT<T> closest, ab;
+		T minDist = T(0.0f);
+		for (int i = 0; i < b.count; i++) {
+			VecT<T> start = b.points[i];
+			VecT<T> end = b.points[(i + 1) % b.count];
+			VecT<T> c = ScalarMath::getClosestPointOnSegment(a.center, start, end);
+			T distance = ScalarMath::length(a.center - c);
+			if (i == 0 || distance < minDist) {
+				minDist = distance;
+				closest = c;
+				ab = end - start;
+			}
+		}
+		return collideCircleChainSegment<T>(a, closest, ab, b.radius, contact);
+	}
+};
+
+// getClosestPointOnSegment with the dot products of a baked segment
+inline glm::vec2 getClosestPointOnSegment(glm::vec2 p, const TableSegment& segment) {
+	glm::vec2 a = glm::vec2(segment.a.x, segment.a.y);
+	glm::vec2 ab = glm::vec2(segment.ab.x, segment.ab.y);
+	if (segment.lengthSq == 0.0f) return a;
+	float t = glm::max(0.0f, glm::min(1.0f, (glm::dot(p, ab) - segment.aDotAb) / segment.lengthSq));
+	return a + ab * t;
+}
+
+// the closest baked segment to p, the same one the scan over the border points picks: of equally
+// close segments the first. the tree is walked nearer child first and a node is skipped only when
+// its box is farther than the closest segment so far
+inline int findClosestSegment(const TableDescription& table, glm::vec2 p, glm::vec2& closest) {
+	const TableSegment* segments = table.segments.data();
+	int best = -1;
+	float bestDistance = 0.0f;
+	auto visit = [&](int i) {
+		glm::vec2 c = getClosestPointOnSegment(p, segments[i]);
+		float distance = glm::length(p - c);
+		if (best < 0 || distance < bestDistance || (distance == bestDistance && i < best)) {
+			best = i;
+			bestDistance = distance;
+			closest = c;
+		}
+	};
+
+	int n = table.segments.size();
+	if (n < (int)Table::TREE_MIN_SEGMENTS) {
+		for (int i = 0; i < n; i++) visit(i);
+		return best;
+	}
+
+	const TableNode* nodes = table.nodes.data();
+	const int STACK_SIZE = 64;
+	uint32_t stack[STACK_SIZE];
+	int top = 0;
+	stack[top++] = 0;
+	while (top > 0) {
+		const TableNode& node = nodes[stack[--top]];
+		float dx = glm::max(glm::max(node.minX - p.x, p.x - node.maxX), 0.0f);
+		float dy = glm::max(glm::max(node.minY - p.y, p.y - node.maxY), 0.0f);
+		if (best >= 0 && dx * dx + dy * dy > bestDistance * bestDistance) continue;
+
+		if (node.right == 0 || top + 2 > STACK_SIZE) {
+			for (uint32_t i = node.first; i < node.first + node.count; i++) visit(i);
+			continue;
+		}
+		// the nearer child goes on top
+		uint32_t left = (uint32_t)(&node - nodes) + 1;
+		const TableNode& leftNode = nodes[left];
+		const TableNode& rightNode = nodes[node.right];
+		glm::vec2 leftCenter = glm::vec2(leftNode.minX + leftNode.maxX, leftNode.minY + leftNode.maxY) * 0.5f;
+		glm::vec2 rightCenter = glm::vec2(rightNode.minX + rightNode.maxX, rightNode.minY + rightNode.maxY) * 0.5f;
+		bool isLeftNearer = glm::dot(p - leftCenter, p - leftCenter) <= glm::dot(p - rightCenter, p - rightCenter);
+		stack[top++] = isLeftNearer ? node.right : left;
+		stack[top++] = isLeftNearer ? left : node.right;
+	}
+	return best;
+}
+
+template <>
+struct Narrowphase<CircleShape, BakedChainShape> {
+	static bool collide(const CircleShape& a, const BakedChainShape& b, Contact& contact) {
+		glm::vec2 closest;
+		int i = findClosestSegment(*b.table, a.center, closest);
+		if (i < 0) return false;
+		const TableSegment& segment = b.table->segments[i];
+		return collideCircleChainSegment<float>(a, closest, glm::vec2(segment.ab.x, segment.ab.y), b.radius, contact);
+	}
+};
+
+// the edge the center is farthest in front of decides while the center is inside the polygon,
+// outside it the closest point on the outline does
+template <typename T>
+struct Narrowphase<CircleShapeT<T>, ConvexPolygonT<T>> {
+	static bool collide(const CircleShapeT<T>& a, const ConvexPolygonT<T>& b, ContactT<T>& contact) {
+		if (b.count < 3) return false;
+
+		T reach = a.radius + b.radius;
+		int bestEdge = -1;
+		T bestSeparation = T(0.0f);
+		VecT<T> bestNormal;
+		for (int i = 0; i < b.count; i++) {
+			VecT<T> start = b.points[i];
+			VecT<T> end = b.points[(i + 1) % b.count];
+			// counter clockwise, the outside is on the right
+			VecT<T> outward = ScalarMath::normalize(-ScalarMath::perpendicular(end - start));
+			T separation = ScalarMath::dot(a.center - start, outward);
+			if (separation > reach) return false;
+			if (bestEdge < 0 || separation > bestSeparation) {
+				bestEdge = i;
+				bestSeparation = separation;
+				bestNormal = outward;
+			}
+		}
+
+		if (bestSeparation <= T(0.0f)) {
+			contact.normal = bestNormal;
+			contact.point = a.center - bestNormal * bestSeparation;
+			contact.depth = reach - bestSeparation;
+			contact.distance = bestSeparation;
+			return true;
+		}
+
+		VecT<T> closest;
+		T minDist = T(0.0f);
+		for (int i = 0; i < b.count; i++) {
+			VecT<T> c = ScalarMath::getClosestPointOnSegment(a.center, b.points[i], b.points[(i + 1) % b.count]);
+			T distance = ScalarMath::length(a.center - c);
+			if (i == 0 || distance < minDist) {
+				minDist = distance;
+				closest = c;
+			}
+		}
+		return collideCircleCore(a, closest, b.radius, contact);
+	}
+};
@@ -0,0 +1,69 @@
+#pragma once
+#include <chrono>
+#include <cstring>
+
+// per frame performance counters shown by the perf hud
+enum ProfilePhase {
+	PHASE_INPUT = 0,
+	PHASE_SIMULATION,
+	PHASE_GAME,
+	PHASE_RENDER,
+	// drawing the hud itself, kept apart so it does not inflate the render time it shows
+	PHASE_HUD,
+	PHASE_SWAP,
+	PHASE_COUNT
+};
+
+struct PerfCounters {
+	unsigned int drawCalls;
+	unsigned int uniformUploads;
+	unsigned int textureBinds;
+	PerfCounters() : drawCalls(0), uniformUploads(0), textureBinds(0) {}
+};
+
+struct FrameStats {
+	float frameTime;
+	float phaseTimes[PHASE_COUNT];
+	PerfCounters counters;
+	unsigned int ballCount;
+	unsigned int enemyCount;
+	FrameStats() : frameTime(0.0f), counters(), ballCount(0), enemyCount(0) {
+		memset(phaseTimes, 0, sizeof(phaseTimes));
+	}
+};
+
+struct FrameProfiler {
+	using Clock = std::chrono::steady_clock;
+	static const int HISTORY_SIZE = 120;
+
+	FrameStats current;
+	FrameStats last;
+	FrameStats history[HISTORY_SIZE];
+	int historyHead;
+	Clock::time_point phaseStart;
+
+	FrameProfiler() : historyHead(0), phaseStart(Clock::now()) {}
+
+	void beginPhase() {
+		phaseStart = Clock::now();
+	}
+
+	void endPhase(ProfilePhase phase) {
+		std::chrono::duration<float> elapsed = Clock::now() - phaseStart;
+		current.phaseTimes[phase] += elapsed.count();
+	}
+
+	// closes the frame: the finished stats become "last" and go into the graph history
+	void endFrame(float frameTime) {
+		current.frameTime = frameTime;
+		last = current;
+		history[historyHead] = current;
+		historyHead = (historyHead + 1) % HISTORY_SIZE;
+		current = FrameStats();
+	}
+
+	// index 0 is the oldest frame in the history
+	const FrameStats& getHistory(int index) const {
+		return history[(historyHead + index) % HISTORY_SIZE];
+	}
+};
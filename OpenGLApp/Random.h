@@ -0,0 +1,106 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// pcg32 (xsh-rr variant). 64 bits of state plus an odd increment that picks one of 2^63 streams,
+// generators with the same seed on different streams produce unrelated sequences.
+// every world owns its generators, there is no global random state anywhere in the game
+struct Pcg32 {
+	static const uint64_t MULTIPLIER = 6364136223846793005ull;
+
+	uint64_t state;
+	uint64_t increment;
+
+	Pcg32(uint64_t seed = 0, uint64_t stream = 0) {
+		this->seed(seed, stream);
+	}
+
+	void seed(uint64_t seed, uint64_t stream = 0) {
+		state = 0;
+		increment = (stream << 1) | 1;
+		nextUInt();
+		state += seed;
+		nextUInt();
+	}
+
+	uint32_t nextUInt() {
+		uint64_t old = state;
+		state = old * MULTIPLIER + increment;
+		uint32_t xorShifted = (uint32_t)(((old >> 18) ^ old) >> 27);
+		uint32_t rotation = (uint32_t)(old >> 59);
+		return (xorShifted >> rotation) | (xorShifted << ((0u - rotation) & 31));
+	}
+
+	// uniform in [0, 1), the top 24 bits so every value is exact in a float
+	float nextFloat() {
+		return (nextUInt() >> 8) * (1.0f / 16777216.0f);
+	}
+
+	float nextFloat(float min, float max) {
+		return min + nextFloat() * (max - min);
+	}
+
+	// a new generator on its own stream, seeded from this one. lets a sub-system draw numbers
+	// without shifting the sequence everything else sees
+	Pcg32 split(uint64_t stream) {
+		uint64_t high = nextUInt();
+		return Pcg32((high << 32) | nextUInt(), stream);
+	}
+
+	// skips delta outputs in O(log delta), same result as calling nextUInt() delta times
+	void advance(uint64_t delta) {
+		uint64_t multiplier = MULTIPLIER;
+		uint64_t increment = this->increment;
+		uint64_t totalMultiplier = 1;
+		uint64_t totalIncrement = 0;
+		while (delta > 0) {
+			if (delta & 1) {
+				totalMultiplier *= multiplier;
+				totalIncrement = totalIncrement * multiplier + increment;
+			}
+			increment = (multiplier + 1) * increment;
+			multiplier *= multiplier;
+			delta >>= 1;
+		}
+		state = totalMultiplier * state + totalIncrement;
+	}
+
+	// batched draw, the same values nextFloat() would return one by one
+	void fillFloats(float* out, size_t count) {
+		for (size_t i = 0; i < count; i++) {
+			out[i] = nextFloat();
+		}
+	}
+};
+
+// counter based generator: value i of a key is a pure function of (key, i), there is no state
+// to carry from one draw to the next. the loop in fillFloats has no dependency between
+// iterations and only uses 32-bit integer math, so it vectorizes
+namespace Random {
+	// 32-bit integer finalizer with low bias (lowbias32)
+	inline uint32_t mix(uint32_t x) {
+		x ^= x >> 16;
+		x *= 0x7feb352du;
+		x ^= x >> 15;
+		x *= 0x846ca68bu;
+		x ^= x >> 16;
+		return x;
+	}
+
+	inline uint32_t counterUInt(uint32_t key, uint32_t counter) {
+		return mix(counter * 0x9e3779b9u + mix(key));
+	}
+
+	inline float counterFloat(uint32_t key, uint32_t counter) {
+		return (counterUInt(key, counter) >> 8) * (1.0f / 16777216.0f);
+	}
+
+	// out[i] = counterFloat(key, firstCounter + i)
+	inline void fillFloats(uint32_t key, uint32_t firstCounter, float* out, size_t count) {
+		uint32_t keyHash = mix(key);
+		for (size_t i = 0; i < count; i++) {
+			uint32_t x = mix((firstCounter + (uint32_t)i) * 0x9e3779b9u + keyHash);
+			out[i] = (x >> 8) * (1.0f / 16777216.0f);
+		}
+	}
+}
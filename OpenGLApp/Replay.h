@@ -0,0 +1,403 @@
+#pragma once
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Determinism.h"
+#include "JobSystem.h"
+#include "Utils.h"
+#include "World.h"
+
+// session replays. input reaches the world only as SimulationCommands applied between steps, so a
+// replay is the seed plus every applied command tagged with its step. with fixed steps that is all
+// it takes to play a session back bit for bit, with variable steps the dt of each step goes in too.
+// layout, integers little endian:
+//   header   "PBRP", u16 version, u16 flags (REPLAY_CONTACT_SOLVER), u32 seed, f32 fixed dt (0 when
+//            every step has its own), u32 size and the table as Table::compile writes it, so a
+//            session on an edited table plays back on that table
+//   records  varint (steps since the previous record << 2 | type), then by type
+//            REPLAY_COMMAND  u8 SimulationCommand, applied before that step
+//            REPLAY_DT       varint of the new dt bits xor the previous ones, from that step on
+//            REPLAY_END      u64 World::stateHash after the last step, the step count is the record's step
+// a file that was cut short plays back up to its last complete record
+enum ReplayRecordType {
+	REPLAY_COMMAND = 0,
+	REPLAY_DT = 1,
+	REPLAY_END = 2
+};
+
+// header flags, the simulation choices a world is made with
+enum ReplayFlags {
+	REPLAY_CONTACT_SOLVER = 1
+};
+
+namespace Replay {
+	const char MAGIC[4] = { 'P', 'B', 'R', 'P' };
+	const uint16_t VERSION = 2;
+	// up to the table size
+	const size_t HEADER_SIZE = 20;
+	// the longest stretch without a record a real session can have, an hour at 1000 steps a
+	// second. a larger gap means a damaged file, playing it would run for days
+	const uint64_t MAX_RECORD_STEP_GAP = 3600ull * 1000ull;
+
+	inline void putU16(std::vector<uint8_t>& out, uint16_t value) {
+		out.push_back(value & 0xff);
+		out.push_back(value >> 8);
+	}
+
+	inline void putU32(std::vector<uint8_t>& out, uint32_t value) {
+		for (int i = 0; i < 4; i++) out.push_back((value >> (i * 8)) & 0xff);
+	}
+
+	inline void putU64(std::vector<uint8_t>& out, uint64_t value) {
+		for (int i = 0; i < 8; i++) out.push_back((value >> (i * 8)) & 0xff);
+	}
+
+	inline void putVarint(std::vector<uint8_t>& out, uint64_t value) {
+		while (value >= 0x80) {
+			out.push_back((uint8_t)(value | 0x80));
+			value >>= 7;
+		}
+		out.push_back((uint8_t)value);
+	}
+
+	inline uint32_t floatBits(float value) {
+		uint32_t bits;
+		memcpy(&bits, &value, sizeof(bits));
+		return bits;
+	}
+
+	inline float bitsFloat(uint32_t bits) {
+		float value;
+		memcpy(&value, &bits, sizeof(value));
+		return value;
+	}
+
+	// bounds checked reads over the loaded file, every read fails once the data runs out
+	struct Reader {
+		const uint8_t* data;
+		size_t size;
+		size_t offset;
+
+		bool getU8(uint8_t& value) {
+			if (offset >= size) return false;
+			value = data[offset++];
+			return true;
+		}
+
+		bool getUnsigned(uint64_t& value, int bytes) {
+			if (size - offset < (size_t)bytes) return false;
+			value = 0;
+			for (int i = 0; i < bytes; i++) value |= (uint64_t)data[offset + i] << (i * 8);
+			offset += bytes;
+			return true;
+		}
+
+		bool getVarint(uint64_t& value) {
+			value = 0;
+			for (int shift = 0; shift < 64; shift += 7) {
+				uint8_t byte;
+				if (!getU8(byte)) return false;
+				value |= (uint64_t)(byte & 0x7f) << shift;
+				if ((byte & 0x80) == 0) return true;
+			}
+			return false;
+		}
+	};
+}
+
+// encodes on the simulation thread, a background thread writes full chunks to disk. the simulation
+// never waits for the disk: when MAX_PENDING_CHUNKS are still queued the recording stops there,
+// and the file stays a valid, shorter replay
+struct ReplayRecorder {
+	static const size_t CHUNK_SIZE = 4096;
+	static const size_t MAX_PENDING_CHUNKS = 64;
+
+	FILE* file;
+	std::string path;
+	std::vector<uint8_t> chunk;
+	std::vector<std::vector<uint8_t>> pending;
+	std::vector<std::vector<uint8_t>> spare;
+	std::mutex mutex;
+	std::condition_variable chunkReady;
+	std::thread writer;
+	bool stopping;
+	bool overflowed;
+
+	float fixedDt;
+	uint32_t lastDtBits;
+	uint64_t step;
+	uint64_t lastRecordStep;
+
+	ReplayRecorder() : file(nullptr), stopping(false), overflowed(false), fixedDt(0.0f), lastDtBits(0), step(0), lastRecordStep(0) {}
+
+	~ReplayRecorder() {
+		close();
+	}
+
+	ReplayRecorder(const ReplayRecorder&) = delete;
+	ReplayRecorder& operator=(const ReplayRecorder&) = delete;
+
+	bool isRecording() const {
+		return file != nullptr && !overflowed && !stopping;
+	}
+
+	// fixedDt 0 stores the dt of every step, flags are ReplayFlags
+	bool start(const std::string& path, uint32_t seed, float fixedDt, uint16_t flags, const TableDescription& table) {
+		close();
+		std::error_code error;
+		std::filesystem::create_directories(std::filesystem::path(path).parent_path(), error);
+		file = fopen(path.c_str(), "wb");
+		if (file == nullptr) {
+			printf("ERROR::REPLAY::FAILED_TO_OPEN: %s\n", path.c_str());
+			return false;
+		}
+
+		this->path = path;
+		this->fixedDt = fixedDt;
+		lastDtBits = 0;
+		step = 0;
+		lastRecordStep = 0;
+		stopping = false;
+		overflowed = false;
+		chunk.clear();
+		chunk.reserve(CHUNK_SIZE);
+
+		chunk.insert(chunk.end(), Replay::MAGIC, Replay::MAGIC + 4);
+		Replay::putU16(chunk, Replay::VERSION);
+		Replay::putU16(chunk, flags);
+		Replay::putU32(chunk, seed);
+		Replay::putU32(chunk, Replay::floatBits(fixedDt));
+		std::vector<uint8_t> tableBytes;
+		Table::compile(table, tableBytes);
+		Replay::putU32(chunk, (uint32_t)tableBytes.size());
+		chunk.insert(chunk.end(), tableBytes.begin(), tableBytes.end());
+
+		writer = std::thread(&ReplayRecorder::writerLoop, this);
+		return true;
+	}
+
+	// call before the step, the next three in the order the world sees them
+	void recordDt(float dt) {
+		if (!isRecording() || fixedDt != 0.0f) return;
+		uint32_t bits = Replay::floatBits(dt);
+		if (bits == lastDtBits) return;
+		beginRecord(REPLAY_DT);
+		Replay::putVarint(chunk, bits ^ lastDtBits);
+		lastDtBits = bits;
+		endRecord();
+	}
+
+	void recordCommand(SimulationCommand command) {
+		if (!isRecording()) return;
+		beginRecord(REPLAY_COMMAND);
+		chunk.push_back((uint8_t)command);
+		endRecord();
+	}
+
+	void endStep() {
+		step++;
+	}
+
+	// writes the end record and waits for the disk, for the end of the program
+	void finish(uint64_t stateHash) {
+		stop(stateHash);
+		close();
+	}
+
+	// writes the end record and returns at once, the writer drains the queue on its own and is
+	// joined by the next start, finish or the destructor. safe to call from the simulation step
+	void stop(uint64_t stateHash) {
+		if (!isRecording()) return;
+		beginRecord(REPLAY_END);
+		Replay::putU64(chunk, stateHash);
+		flush();
+		if (overflowed) return;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		chunkReady.notify_one();
+		printf("Replay recording stopped at step %llu: %s\n", (unsigned long long)step, path.c_str());
+	}
+
+private:
+	void beginRecord(ReplayRecordType type) {
+		Replay::putVarint(chunk, ((step - lastRecordStep) << 2) | type);
+		lastRecordStep = step;
+	}
+
+	void endRecord() {
+		if (chunk.size() >= CHUNK_SIZE) flush();
+	}
+
+	void flush() {
+		if (chunk.empty() || file == nullptr) return;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (pending.size() >= MAX_PENDING_CHUNKS) {
+				overflowed = true;
+				printf("ERROR::REPLAY::WRITER_FELL_BEHIND, recording stopped at step %llu\n", (unsigned long long)step);
+				chunk.clear();
+				return;
+			}
+			pending.push_back(std::move(chunk));
+			if (spare.empty()) chunk = std::vector<uint8_t>();
+			else {
+				chunk = std::move(spare.back());
+				spare.pop_back();
+			}
+		}
+		chunkReady.notify_one();
+		chunk.clear();
+		chunk.reserve(CHUNK_SIZE);
+	}
+
+	void close() {
+		if (file == nullptr) return;
+		if (!overflowed) flush();
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		chunkReady.notify_one();
+		writer.join();
+		fclose(file);
+		file = nullptr;
+		pending.clear();
+		spare.clear();
+	}
+
+	void writerLoop() {
+		std::unique_lock<std::mutex> lock(mutex);
+		while (true) {
+			chunkReady.wait(lock, [this] { return stopping || !pending.empty(); });
+			if (pending.empty()) {
+				// a stopped recording may stay open until the program ends, it is complete on disk now
+				fflush(file);
+				return;
+			}
+
+			std::vector<uint8_t> written = std::move(pending.front());
+			pending.erase(pending.begin());
+			lock.unlock();
+			fwrite(written.data(), 1, written.size(), file);
+			lock.lock();
+			spare.push_back(std::move(written));
+		}
+	}
+};
+
+namespace Replay {
+	// entry point for --replay: plays the session back headless as fast as the cpu goes and checks
+	// the final state hash against the recorded one
+	inline bool play(const std::string& path, JobSystem* jobs) {
+		std::vector<unsigned char> bytes;
+		if (!Utils::readFile(path, bytes)) {
+			printf("ERROR::REPLAY::FAILED_TO_READ: %s\n", path.c_str());
+			return false;
+		}
+		if (bytes.size() < HEADER_SIZE || memcmp(bytes.data(), MAGIC, 4) != 0) {
+			printf("ERROR::REPLAY::NOT_A_REPLAY: %s\n", path.c_str());
+			return false;
+		}
+
+		Reader reader = { bytes.data(), bytes.size(), 4 };
+		uint64_t version, flags, seed, fixedDtBits, tableSize;
+		reader.getUnsigned(version, 2);
+		reader.getUnsigned(flags, 2);
+		reader.getUnsigned(seed, 4);
+		reader.getUnsigned(fixedDtBits, 4);
+		reader.getUnsigned(tableSize, 4);
+		if (version != VERSION) {
+			printf("ERROR::REPLAY::UNSUPPORTED_VERSION %llu\n", (unsigned long long)version);
+			return false;
+		}
+		// copied out so the sections are aligned like in a file of their own
+		std::vector<unsigned char> tableBytes;
+		if (tableSize <= reader.size - reader.offset) {
+			tableBytes.assign(reader.data + reader.offset, reader.data + reader.offset + tableSize);
+			reader.offset += (size_t)tableSize;
+		}
+		Table::View tableView;
+		if (!Table::getView(tableBytes.data(), tableBytes.size(), tableView)) {
+			printf("ERROR::REPLAY::BAD_TABLE: %s\n", path.c_str());
+			return false;
+		}
+
+		Determinism::setupFloatEnvironment();
+		World world(0, DifficultySettings(), jobs);
+		Table::copyView(tableView, world.table);
+		world.reset((uint32_t)seed);
+		world.hashSteps = true;
+		world.useContactSolver = (flags & REPLAY_CONTACT_SOLVER) != 0;
+		float dt = bitsFloat((uint32_t)fixedDtBits);
+		uint32_t dtBits = 0;
+		uint64_t step = 0;
+		uint64_t recordedHash = 0;
+		bool complete = false;
+		float simulatedTime = 0.0f;
+
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		uint64_t tag;
+		bool corrupt = false;
+		while (reader.getVarint(tag)) {
+			if ((tag >> 2) > MAX_RECORD_STEP_GAP) {
+				printf("ERROR::REPLAY::CORRUPT, %llu steps without a record at byte %llu\n", (unsigned long long)(tag >> 2), (unsigned long long)reader.offset);
+				corrupt = true;
+				break;
+			}
+			uint64_t recordStep = step + (tag >> 2);
+			ReplayRecordType type = (ReplayRecordType)(tag & 3);
+
+			// steps without input between the previous record and this one
+			for (; step < recordStep; step++) {
+				world.step(dt);
+				simulatedTime += dt;
+			}
+
+			if (type == REPLAY_COMMAND) {
+				uint8_t command;
+				if (!reader.getU8(command)) break;
+				world.applyCommand((SimulationCommand)command);
+			}
+			else if (type == REPLAY_DT) {
+				uint64_t delta;
+				if (!reader.getVarint(delta)) break;
+				dtBits ^= (uint32_t)delta;
+				dt = bitsFloat(dtBits);
+			}
+			else if (type == REPLAY_END) {
+				complete = reader.getUnsigned(recordedHash, 8);
+				break;
+			}
+			else {
+				printf("ERROR::REPLAY::UNKNOWN_RECORD at byte %llu\n", (unsigned long long)reader.offset);
+				break;
+			}
+		}
+		std::chrono::duration<float> elapsed = std::chrono::steady_clock::now() - start;
+
+		printf("seed %u, %llu steps, %.1fs of play in %.3fs (%.0fx real time), score %d\n", (uint32_t)seed, (unsigned long long)step,
+			simulatedTime, elapsed.count(), elapsed.count() > 0.0f ? simulatedTime / elapsed.count() : 0.0f, world.score);
+		printf("final hash %016llx\n", (unsigned long long)world.stateHash);
+		if (corrupt) return false;
+		if (!complete) {
+			printf("replay has no end record, it was cut short\n");
+			return false;
+		}
+		if (recordedHash != world.stateHash) {
+			printf("ERROR::REPLAY::DIVERGED, recorded hash %016llx\n", (unsigned long long)recordedHash);
+			return false;
+		}
+		printf("matches the recorded session\n");
+		return true;
+	}
+}
@@ -0,0 +1,245 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <vector>
+
+#include "Replay.h"
+#include "World.h"
+
+// rolling history of world states for scrubbing back in time. the world state is stored every
+// STATE_INTERVAL steps and after every step that had input, the steps in between are stepped again
+// from their recorded dt when scrubbed to, the simulation is bit exact so that lands on the same bits.
+// a stored state is a WorldSnapshot whose 32-bit words are coded against the stored states before
+// it: each word is predicted as the linear continuation of the last two and the xor of the word
+// and its prediction goes out as a varint, alternating with varint run lengths of exactly predicted
+// words. constant words, counters and free falling balls come out as zero or one byte, balls in
+// contact cost 2-3 bytes a float. every KEYFRAME_INTERVAL steps a keyframe (coded against zeros)
+// starts a new group, whole groups are dropped from the front once the history is over its step or
+// byte budget
+struct RewindHistory {
+	static const int KEYFRAME_INTERVAL = 240;
+	static const int STATE_INTERVAL = 4;
+
+	// a keyframe and everything up to the next one. states and stateSteps run in parallel, dts has
+	// the dt of every step from firstStep on
+	struct Group {
+		uint64_t firstStep;
+		std::vector<uint8_t> bytes;
+		std::vector<uint32_t> stateOffsets;
+		std::vector<uint64_t> stateSteps;
+		std::vector<float> dts;
+
+		size_t getByteSize() const {
+			return bytes.size() + stateOffsets.size() * sizeof(uint32_t) + stateSteps.size() * sizeof(uint64_t) + dts.size() * sizeof(float);
+		}
+	};
+
+	uint64_t maxSteps;
+	size_t maxBytes;
+	std::deque<Group> groups;
+	size_t totalBytes;
+	uint64_t nextStep;
+
+	// the last three stored states on the recording side and the last three decoded ones, the
+	// newest of each is the base for the next, so scrubbing forward decodes at most one state
+	WorldSnapshot recorded[3];
+	int recordedSlot;
+	WorldSnapshot decoded[3];
+	int decodedSlot;
+	uint64_t decodedStep;
+	bool hasDecoded;
+
+	RewindHistory(float seconds = 600.0f, float dt = 1.0f / 60.0f, size_t maxBytes = 48 * 1024 * 1024) :
+		maxSteps((uint64_t)(seconds / dt)), maxBytes(maxBytes), totalBytes(0), nextStep(0),
+		recordedSlot(0), decodedSlot(0), decodedStep(0), hasDecoded(false) {}
+
+	bool isEmpty() const {
+		return groups.empty();
+	}
+
+	uint64_t oldestStep() const {
+		return groups.empty() ? nextStep : groups.front().firstStep;
+	}
+
+	uint64_t newestStep() const {
+		return nextStep - 1;
+	}
+
+	size_t getByteSize() const {
+		return totalBytes;
+	}
+
+	void clear() {
+		groups.clear();
+		totalBytes = 0;
+		nextStep = 0;
+		hasDecoded = false;
+	}
+
+	// call after every step with the dt it took, hadInput when commands were applied before it
+	void record(const World& world, float dt, bool hadInput) {
+		if (groups.empty() || nextStep - groups.back().firstStep >= KEYFRAME_INTERVAL) {
+			totalBytes += sizeof(Group);
+			groups.emplace_back();
+			groups.back().firstStep = nextStep;
+		}
+		Group& group = groups.back();
+		size_t sizeBefore = group.getByteSize();
+		group.dts.push_back(dt);
+
+		uint64_t sinceState = group.stateSteps.empty() ? 0 : nextStep - group.stateSteps.back();
+		if (group.stateSteps.empty() || hadInput || sinceState >= STATE_INTERVAL) {
+			size_t index = group.stateSteps.size();
+			WorldSnapshot& current = recorded[recordedSlot];
+			world.saveSnapshot(current);
+			group.stateOffsets.push_back((uint32_t)group.bytes.size());
+			group.stateSteps.push_back(nextStep);
+			encode(current, getBase(recorded, recordedSlot, index, 1), getBase(recorded, recordedSlot, index, 2), group.bytes);
+			recordedSlot = (recordedSlot + 1) % 3;
+		}
+		totalBytes += group.getByteSize() - sizeBefore;
+		nextStep++;
+
+		// the newest group is never dropped, it is the base for the next state
+		while (groups.size() > 1 && (nextStep - groups.front().firstStep > maxSteps || totalBytes > maxBytes)) {
+			totalBytes -= groups.front().getByteSize() + sizeof(Group);
+			groups.pop_front();
+		}
+	}
+
+	// puts the world back to how it was after the given step. the world has to be the one that
+	// was recorded, or one on the same table with the same difficulty and jobs
+	bool restore(uint64_t step, World& world) {
+		if (groups.empty() || step < oldestStep() || step > newestStep()) return false;
+		const Group& group = findGroup(step);
+		size_t index = std::upper_bound(group.stateSteps.begin(), group.stateSteps.end(), step) - group.stateSteps.begin() - 1;
+		decodeTo(group, index);
+		if (!world.restoreSnapshot(decoded[(decodedSlot + 2) % 3])) return false;
+
+		// no step after a stored state up to the next one had input
+		for (uint64_t i = group.stateSteps[index] + 1; i <= step; i++) {
+			world.step(group.dts[i - group.firstStep]);
+		}
+		return true;
+	}
+
+	// forgets everything after step, recording continues from the world restored to it
+	void truncateAfter(uint64_t step) {
+		if (groups.empty() || step < oldestStep() || step > newestStep()) return;
+		while (groups.back().firstStep > step) {
+			totalBytes -= groups.back().getByteSize() + sizeof(Group);
+			groups.pop_back();
+		}
+
+		Group& group = groups.back();
+		size_t sizeBefore = group.getByteSize();
+		size_t keepStates = std::upper_bound(group.stateSteps.begin(), group.stateSteps.end(), step) - group.stateSteps.begin();
+		if (keepStates < group.stateSteps.size()) {
+			group.bytes.resize(group.stateOffsets[keepStates]);
+			group.stateOffsets.resize(keepStates);
+			group.stateSteps.resize(keepStates);
+		}
+		group.dts.resize((size_t)(step - group.firstStep) + 1);
+		totalBytes -= sizeBefore - group.getByteSize();
+		nextStep = step + 1;
+
+		// the next states are predicted from the last two kept ones
+		hasDecoded = false;
+		decodeTo(group, keepStates - 1);
+		for (int back = 1; back <= 2; back++) {
+			recorded[(recordedSlot + 3 - back) % 3].copyFrom(decoded[(decodedSlot + 3 - back) % 3]);
+		}
+	}
+
+private:
+	const Group& findGroup(uint64_t step) const {
+		size_t index = 0;
+		while (index + 1 < groups.size() && groups[index + 1].firstStep <= step) index++;
+		return groups[index];
+	}
+
+	// the snapshot distance states back from slot, null when that is before the group's keyframe
+	static const WorldSnapshot* getBase(const WorldSnapshot* slots, int slot, size_t index, size_t distance) {
+		if (index < distance) return nullptr;
+		return &slots[(slot + 3 - distance) % 3];
+	}
+
+	static uint32_t getWord(const WorldSnapshot* snapshot, size_t i) {
+		uint32_t word = 0;
+		if (snapshot != nullptr && i < snapshot->size / 4) memcpy(&word, snapshot->arena.data() + i * 4, 4);
+		return word;
+	}
+
+	// linear continuation of the two previous words, or the previous word right after a keyframe
+	static uint32_t predict(const WorldSnapshot* previous, const WorldSnapshot* beforePrevious, size_t i) {
+		uint32_t last = getWord(previous, i);
+		if (beforePrevious == nullptr) return last;
+		return 2 * last - getWord(beforePrevious, i);
+	}
+
+	// the counts, then alternating varint lengths of exactly predicted and mispredicted words,
+	// each mispredicted word followed by the varint of word xor prediction
+	static void encode(const WorldSnapshot& snapshot, const WorldSnapshot* previous, const WorldSnapshot* beforePrevious, std::vector<uint8_t>& out) {
+		Replay::putVarint(out, snapshot.ballCount);
+		Replay::putVarint(out, snapshot.enemyCount);
+		Replay::putVarint(out, snapshot.flipperCount);
+		Replay::putVarint(out, snapshot.contactCount);
+
+		size_t wordCount = snapshot.size / 4;
+		size_t i = 0;
+		while (i < wordCount) {
+			size_t runStart = i;
+			while (i < wordCount && getWord(&snapshot, i) == predict(previous, beforePrevious, i)) i++;
+			size_t mispredictedStart = i;
+			while (i < wordCount && getWord(&snapshot, i) != predict(previous, beforePrevious, i)) i++;
+
+			Replay::putVarint(out, mispredictedStart - runStart);
+			Replay::putVarint(out, i - mispredictedStart);
+			for (size_t k = mispredictedStart; k < i; k++) {
+				Replay::putVarint(out, getWord(&snapshot, k) ^ predict(previous, beforePrevious, k));
+			}
+		}
+	}
+
+	static void decode(const Group& group, size_t index, const WorldSnapshot* previous, const WorldSnapshot* beforePrevious, WorldSnapshot& out) {
+		size_t end = index + 1 < group.stateOffsets.size() ? group.stateOffsets[index + 1] : group.bytes.size();
+		Replay::Reader reader = { group.bytes.data(), end, group.stateOffsets[index] };
+
+		uint64_t ballCount = 0, enemyCount = 0, flipperCount = 0, contactCount = 0;
+		reader.getVarint(ballCount);
+		reader.getVarint(enemyCount);
+		reader.getVarint(flipperCount);
+		reader.getVarint(contactCount);
+		out.layout((uint32_t)ballCount, (uint32_t)enemyCount, (uint32_t)flipperCount, (uint32_t)contactCount);
+
+		size_t wordCount = out.size / 4;
+		size_t i = 0;
+		while (i < wordCount) {
+			uint64_t predicted = 0, mispredicted = 0;
+			if (!reader.getVarint(predicted) || !reader.getVarint(mispredicted)) break;
+			for (uint64_t k = 0; k < predicted + mispredicted && i < wordCount; k++, i++) {
+				uint64_t difference = 0;
+				if (k >= predicted) reader.getVarint(difference);
+				uint32_t word = predict(previous, beforePrevious, i) ^ (uint32_t)difference;
+				memcpy(out.arena.data() + i * 4, &word, 4);
+			}
+		}
+	}
+
+	// leaves stored state index of group in the newest decoded slot and the two before it behind it
+	void decodeTo(const Group& group, size_t index) {
+		// continue from the last decoded state when it is in the same group and not ahead
+		size_t next = 0;
+		if (hasDecoded && decodedStep >= group.firstStep && decodedStep <= group.stateSteps[index]) {
+			next = std::lower_bound(group.stateSteps.begin(), group.stateSteps.end(), decodedStep) - group.stateSteps.begin() + 1;
+		}
+		for (; next <= index; next++) {
+			decode(group, next, getBase(decoded, decodedSlot, next, 1), getBase(decoded, decodedSlot, next, 2), decoded[decodedSlot]);
+			decodedSlot = (decodedSlot + 1) % 3;
+		}
+		decodedStep = group.stateSteps[index];
+		hasDecoded = true;
+	}
+};
@@ -0,0 +1,276 @@
+#pragma once
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <type_traits>
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+
+#include <glm/glm.hpp>
+
+// scalar types for the physics. the shapes and collision functions in World.h are written once
+// against ScalarMath and instantiated for float (glm vectors, what the game runs on) and for
+// fixed point, where every operation is integer math and gives the same bits on any compiler and cpu
+
+// wide multiply and divide for the raw values, shift is the number of fraction bits
+template <typename Storage>
+struct FixedWide;
+
+template <>
+struct FixedWide<int32_t> {
+	static int32_t mul(int32_t a, int32_t b, int shift) {
+		return (int32_t)(((int64_t)a * b) >> shift);
+	}
+	static int32_t div(int32_t a, int32_t b, int shift) {
+		return (int32_t)(((int64_t)a << shift) / b);
+	}
+	// root * root > value << shift, for a positive value
+	static bool isSquareAbove(uint64_t root, int32_t value, int shift) {
+		return root * root > ((uint64_t)value << shift);
+	}
+};
+
+template <>
+struct FixedWide<int64_t> {
+	static int64_t mul(int64_t a, int64_t b, int shift) {
+		#if defined(__SIZEOF_INT128__)
+		return (int64_t)(((__int128)a * b) >> shift);
+		#else
+		int64_t high;
+		uint64_t low = (uint64_t)_mul128(a, b, &high);
+		return (int64_t)__shiftright128(low, (uint64_t)high, (unsigned char)shift);
+		#endif
+	}
+	static int64_t div(int64_t a, int64_t b, int shift) {
+		#if defined(__SIZEOF_INT128__)
+		return (int64_t)(((__int128)a << shift) / b);
+		#else
+		int64_t remainder;
+		return _div128(a >> (64 - shift), (int64_t)((uint64_t)a << shift), b, &remainder);
+		#endif
+	}
+	static bool isSquareAbove(uint64_t root, int64_t value, int shift) {
+		#if defined(__SIZEOF_INT128__)
+		return (unsigned __int128)root * root > ((unsigned __int128)value << shift);
+		#else
+		uint64_t high;
+		uint64_t low = _umul128(root, root, &high);
+		uint64_t valueHigh = (uint64_t)value >> (64 - shift);
+		uint64_t valueLow = (uint64_t)value << shift;
+		return high > valueHigh || (high == valueHigh && low > valueLow);
+		#endif
+	}
+};
+
+// signed fixed point, the low FRACTION_BITS of raw are the fraction. Q16_16 has 1/65536 steps and
+// a range of +-32768, enough for positions and speeds but squared distances across the table get
+// close to the limit. Q32_32 has room for everything. sums wrap instead of overflowing.
+// Q16_16 is not accurate enough to simulate the table: the rounding of dt and the contact math
+// puts balls about 1.75 units off the float run after one second (--fixed-bench), Q32_32 stays
+// within 0.002. use Q32_32 for anything that has to play like the game
+template <typename Storage, int FRACTION_BITS>
+struct Fixed {
+	typedef typename std::make_unsigned<Storage>::type Unsigned;
+	static constexpr Storage ONE = (Storage)1 << FRACTION_BITS;
+
+	Storage raw;
+
+	constexpr Fixed() : raw(0) {}
+	constexpr Fixed(double value) : raw((Storage)(value * (double)ONE + (value >= 0.0 ? 0.5 : -0.5))) {}
+
+	static constexpr Fixed fromRaw(Storage raw) {
+		Fixed value;
+		value.raw = raw;
+		return value;
+	}
+
+	float toFloat() const {
+		return (float)((double)raw / (double)ONE);
+	}
+
+	explicit operator float() const {
+		return toFloat();
+	}
+
+	friend Fixed operator+(Fixed a, Fixed b) { return fromRaw((Storage)((Unsigned)a.raw + (Unsigned)b.raw)); }
+	friend Fixed operator-(Fixed a, Fixed b) { return fromRaw((Storage)((Unsigned)a.raw - (Unsigned)b.raw)); }
+	friend Fixed operator*(Fixed a, Fixed b) { return fromRaw(FixedWide<Storage>::mul(a.raw, b.raw, FRACTION_BITS)); }
+	friend Fixed operator/(Fixed a, Fixed b) {
+		// saturates instead of trapping, the fixed point answer to a float inf
+		if (b.raw == 0) return fromRaw(a.raw >= 0 ? std::numeric_limits<Storage>::max() : std::numeric_limits<Storage>::min());
+		return fromRaw(FixedWide<Storage>::div(a.raw, b.raw, FRACTION_BITS));
+	}
+	Fixed operator-() const { return fromRaw((Storage)(0 - (Unsigned)raw)); }
+
+	Fixed& operator+=(Fixed other) { return *this = *this + other; }
+	Fixed& operator-=(Fixed other) { return *this = *this - other; }
+	Fixed& operator*=(Fixed other) { return *this = *this * other; }
+	Fixed& operator/=(Fixed other) { return *this = *this / other; }
+
+	friend bool operator==(Fixed a, Fixed b) { return a.raw == b.raw; }
+	friend bool operator!=(Fixed a, Fixed b) { return a.raw != b.raw; }
+	friend bool operator<(Fixed a, Fixed b) { return a.raw < b.raw; }
+	friend bool operator<=(Fixed a, Fixed b) { return a.raw <= b.raw; }
+	friend bool operator>(Fixed a, Fixed b) { return a.raw > b.raw; }
+	friend bool operator>=(Fixed a, Fixed b) { return a.raw >= b.raw; }
+};
+
+typedef Fixed<int32_t, 16> Q16_16;
+typedef Fixed<int64_t, 32> Q32_32;
+
+template <typename T>
+struct FixedVec2 {
+	T x, y;
+
+	FixedVec2() : x(), y() {}
+	FixedVec2(T x, T y) : x(x), y(y) {}
+	explicit FixedVec2(glm::vec2 v) : x(v.x), y(v.y) {}
+
+	glm::vec2 toGlm() const {
+		return glm::vec2(x.toFloat(), y.toFloat());
+	}
+
+	friend FixedVec2 operator+(FixedVec2 a, FixedVec2 b) { return FixedVec2(a.x + b.x, a.y + b.y); }
+	friend FixedVec2 operator-(FixedVec2 a, FixedVec2 b) { return FixedVec2(a.x - b.x, a.y - b.y); }
+	friend FixedVec2 operator*(FixedVec2 v, T s) { return FixedVec2(v.x * s, v.y * s); }
+	friend FixedVec2 operator*(T s, FixedVec2 v) { return FixedVec2(v.x * s, v.y * s); }
+	friend FixedVec2 operator/(FixedVec2 v, T s) { return FixedVec2(v.x / s, v.y / s); }
+	FixedVec2 operator-() const { return FixedVec2(-x, -y); }
+
+	FixedVec2& operator+=(FixedVec2 other) { return *this = *this + other; }
+	FixedVec2& operator-=(FixedVec2 other) { return *this = *this - other; }
+	FixedVec2& operator*=(T s) { return *this = *this * s; }
+
+	friend bool operator==(FixedVec2 a, FixedVec2 b) { return a.x == b.x && a.y == b.y; }
+	friend bool operator!=(FixedVec2 a, FixedVec2 b) { return !(a == b); }
+};
+
+// the vector type that goes with a scalar
+template <typename T>
+struct ScalarTraits {
+	typedef FixedVec2<T> Vec2;
+};
+
+template <>
+struct ScalarTraits<float> {
+	typedef glm::vec2 Vec2;
+};
+
+template <typename T>
+using VecT = typename ScalarTraits<T>::Vec2;
+
+namespace ScalarMath {
+	// float, straight through to std and glm so the game's results do not change
+	inline float sqrt(float x) { return std::sqrt(x); }
+	inline float abs(float x) { return std::abs(x); }
+	inline float min(float a, float b) { return glm::min(a, b); }
+	inline float max(float a, float b) { return glm::max(a, b); }
+	inline float cos(float x) { return glm::cos(x); }
+	inline float sin(float x) { return glm::sin(x); }
+	inline float dot(glm::vec2 a, glm::vec2 b) { return glm::dot(a, b); }
+	inline float length(glm::vec2 v) { return glm::length(v); }
+	inline glm::vec2 normalize(glm::vec2 v) { return glm::normalize(v); }
+
+	// fixed point
+	template <typename S, int F>
+	inline Fixed<S, F> abs(Fixed<S, F> x) {
+		return x.raw < 0 ? -x : x;
+	}
+
+	template <typename S, int F>
+	inline Fixed<S, F> min(Fixed<S, F> a, Fixed<S, F> b) {
+		return b < a ? b : a;
+	}
+
+	template <typename S, int F>
+	inline Fixed<S, F> max(Fixed<S, F> a, Fixed<S, F> b) {
+		return a < b ? b : a;
+	}
+
+	template <typename S, int F>
+	inline Fixed<S, F> floor(Fixed<S, F> x) {
+		return Fixed<S, F>::fromRaw((S)(x.raw & ~(S)(Fixed<S, F>::ONE - 1)));
+	}
+
+	// floor(sqrt(raw << F)) as raw result. the hardware sqrt only gives a first guess, the
+	// integer fix up after it makes the result exact, so it does not depend on the float
+	// environment or the cpu
+	template <typename S, int F>
+	inline Fixed<S, F> sqrt(Fixed<S, F> x) {
+		if (x.raw <= 0) return Fixed<S, F>();
+		uint64_t root = (uint64_t)std::sqrt((double)x.raw * (double)Fixed<S, F>::ONE);
+		while (root > 0 && FixedWide<S>::isSquareAbove(root, x.raw, F)) root--;
+		while (!FixedWide<S>::isSquareAbove(root + 1, x.raw, F)) root++;
+		return Fixed<S, F>::fromRaw((S)root);
+	}
+
+	// reduced to [-pi/2, pi/2] and a taylor series up to x^11, error below 1e-7 before rounding
+	template <typename S, int F>
+	inline Fixed<S, F> sin(Fixed<S, F> x) {
+		typedef Fixed<S, F> T;
+		const T PI = T(3.14159265358979323846);
+		const T HALF_PI = T(1.57079632679489661923);
+		const T TWO_PI = T(6.28318530717958647692);
+
+		x = x - TWO_PI * floor((x + PI) / TWO_PI);
+		if (x > HALF_PI) x = PI - x;
+		else if (x < -HALF_PI) x = -PI - x;
+
+		T x2 = x * x;
+		T series = T(-1.0 / 39916800.0);
+		series = T(1.0 / 362880.0) + x2 * series;
+		series = T(-1.0 / 5040.0) + x2 * series;
+		series = T(1.0 / 120.0) + x2 * series;
+		series = T(-1.0 / 6.0) + x2 * series;
+		series = T(1.0) + x2 * series;
+		return x * series;
+	}
+
+	template <typename S, int F>
+	inline Fixed<S, F> cos(Fixed<S, F> x) {
+		return sin(x + Fixed<S, F>(1.57079632679489661923));
+	}
+
+	template <typename T>
+	inline T dot(FixedVec2<T> a, FixedVec2<T> b) {
+		return a.x * b.x + a.y * b.y;
+	}
+
+	// 32-bit formats scale by the larger component first, squaring raw distances would overflow
+	// Q16.16. 64-bit formats square directly, anything on the table fits
+	template <typename T>
+	inline T length(FixedVec2<T> v) {
+		if (sizeof(v.x.raw) >= 8) return sqrt(v.x * v.x + v.y * v.y);
+		T scale = max(abs(v.x), abs(v.y));
+		if (scale == T()) return T();
+		T x = v.x / scale;
+		T y = v.y / scale;
+		return scale * sqrt(x * x + y * y);
+	}
+
+	template <typename T>
+	inline FixedVec2<T> normalize(FixedVec2<T> v) {
+		T l = length(v);
+		if (l == T()) return v;
+		return FixedVec2<T>(v.x / l, v.y / l);
+	}
+
+	// both vector types
+	template <typename Vec>
+	inline Vec perpendicular(Vec v) {
+		return Vec(-v.y, v.x);
+	}
+
+	template <typename Vec>
+	inline Vec getClosestPointOnSegment(Vec p, Vec a, Vec b) {
+		typedef decltype(dot(a, b)) T;
+		Vec ab = b - a;
+		T t = dot(ab, ab);
+		if (t == T(0.0f)) return a;
+		t = max(T(0.0f), min(T(1.0f), (dot(p, ab) - dot(a, ab)) / t));
+		Vec closest = a;
+		return closest + ab * t;
+	}
+}
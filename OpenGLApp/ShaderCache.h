@@ -0,0 +1,235 @@
+#pragma once
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <shader.h>
+
+#include "Utils.h"
+
+// program binary cache, one file per program holding the driver's own binary blob.
+// entries are keyed by the shader sources and the driver string, so a driver update
+// or an edited shader simply misses and recompiles
+namespace ShaderCache {
+	// GL_KHR_parallel_shader_compile, not part of the generated loader
+	typedef void (APIENTRYP PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)(GLuint count);
+	constexpr uint32_t VERSION = 1;
+
+	struct Header {
+		char magic[4];
+		uint32_t version;
+		uint64_t key;
+		uint32_t binaryFormat;
+		uint32_t binarySize;
+	};
+
+	struct ProgramSource {
+		std::string name;
+		const char* vertexCode;
+		int vertexLength;
+		const char* fragmentCode;
+		int fragmentLength;
+	};
+
+	inline std::string cacheDirectory = "cache/shaders";
+	inline bool binariesSupported = false;
+	inline bool parallelCompileSupported = false;
+	inline uint64_t driverHash = 0;
+
+	inline bool hasExtension(const char* name) {
+		GLint count = 0;
+		glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+		for (GLint i = 0; i < count; i++) {
+			const char* extension = (const char*)glGetStringi(GL_EXTENSIONS, i);
+			if (extension != nullptr && strcmp(extension, name) == 0) return true;
+		}
+		return false;
+	}
+
+	// call once the context is current. a 3.3 context does not get the 4.1 entry points
+	// from glad, so they are fetched through the extension when the driver exposes it
+	inline void init(GLADloadproc loadProc) {
+		if (glad_glGetProgramBinary == nullptr && hasExtension("GL_ARB_get_program_binary")) {
+			glad_glGetProgramBinary = (PFNGLGETPROGRAMBINARYPROC)loadProc("glGetProgramBinary");
+			glad_glProgramBinary = (PFNGLPROGRAMBINARYPROC)loadProc("glProgramBinary");
+			glad_glProgramParameteri = (PFNGLPROGRAMPARAMETERIPROC)loadProc("glProgramParameteri");
+		}
+		GLint formatCount = 0;
+		if (glad_glGetProgramBinary != nullptr && glad_glProgramBinary != nullptr && glad_glProgramParameteri != nullptr) {
+			glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formatCount);
+		}
+		binariesSupported = formatCount > 0;
+
+		if (hasExtension("GL_KHR_parallel_shader_compile") || hasExtension("GL_ARB_parallel_shader_compile")) {
+			PFNGLMAXSHADERCOMPILERTHREADSKHRPROC maxThreads = (PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)loadProc("glMaxShaderCompilerThreadsKHR");
+			if (maxThreads == nullptr) maxThreads = (PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)loadProc("glMaxShaderCompilerThreadsARB");
+			if (maxThreads != nullptr) {
+				// 0xFFFFFFFF lets the driver pick the thread count
+				maxThreads(0xFFFFFFFF);
+				parallelCompileSupported = true;
+			}
+		}
+
+		const char* strings[] = {
+			(const char*)glGetString(GL_VENDOR),
+			(const char*)glGetString(GL_RENDERER),
+			(const char*)glGetString(GL_VERSION)
+		};
+		driverHash = Utils::hashBytes(&VERSION, sizeof(VERSION));
+		for (const char* string : strings) {
+			if (string != nullptr) driverHash = Utils::hashBytes(string, strlen(string), driverHash);
+		}
+	}
+
+	inline uint64_t getKey(const ProgramSource& source) {
+		size_t vertexLength = source.vertexLength < 0 ? strlen(source.vertexCode) : source.vertexLength;
+		size_t fragmentLength = source.fragmentLength < 0 ? strlen(source.fragmentCode) : source.fragmentLength;
+		uint64_t key = Utils::hashBytes(source.vertexCode, vertexLength, driverHash);
+		return Utils::hashBytes(source.fragmentCode, fragmentLength, key);
+	}
+
+	inline std::string getCachePath(const ProgramSource& source) {
+		std::string name = source.name;
+		for (char& c : name) {
+			if (c == '/' || c == '\\' || c == ':' || c == '.') c = '_';
+		}
+		return cacheDirectory + "/" + name + ".bin";
+	}
+
+	inline bool tryLoad(const ProgramSource& source, uint64_t key, Shader& shader) {
+		FILE* file = fopen(getCachePath(source).c_str(), "rb");
+		if (file == nullptr) return false;
+
+		Header header;
+		std::vector<unsigned char> binary;
+		bool valid = fread(&header, sizeof(Header), 1, file) == 1 &&
+			memcmp(header.magic, "PBSC", 4) == 0 && header.version == VERSION && header.key == key;
+		if (valid) {
+			binary.resize(header.binarySize);
+			valid = fread(binary.data(), 1, binary.size(), file) == binary.size();
+		}
+		fclose(file);
+		if (!valid) return false;
+
+		GLuint program = glCreateProgram();
+		glProgramBinary(program, header.binaryFormat, binary.data(), (GLsizei)binary.size());
+		GLint linked = GL_FALSE;
+		glGetProgramiv(program, GL_LINK_STATUS, &linked);
+		if (!linked) {
+			// the driver rejects binaries it no longer understands, just rebuild from source
+			glDeleteProgram(program);
+			return false;
+		}
+		shader.ID = program;
+		return true;
+	}
+
+	inline void store(const ProgramSource& source, uint64_t key, const Shader& shader) {
+		GLint length = 0;
+		glGetProgramiv(shader.ID, GL_PROGRAM_BINARY_LENGTH, &length);
+		if (length <= 0) return;
+
+		Header header;
+		memcpy(header.magic, "PBSC", 4);
+		header.version = VERSION;
+		header.key = key;
+		std::vector<unsigned char> binary(length);
+		GLenum format = 0;
+		glGetProgramBinary(shader.ID, length, nullptr, &format, binary.data());
+		header.binaryFormat = format;
+		header.binarySize = length;
+
+		std::error_code error;
+		std::filesystem::create_directories(cacheDirectory, error);
+		// written next to the entry and renamed over it, so a crash never leaves a truncated entry
+		// behind. each write gets its own name, so two instances storing at once do not interleave
+		std::string cachePath = getCachePath(source);
+		std::string tempPath = cachePath + "." + std::to_string(std::random_device()()) + ".tmp";
+		FILE* file = fopen(tempPath.c_str(), "wb");
+		if (file == nullptr) return;
+		bool written = fwrite(&header, sizeof(Header), 1, file) == 1 &&
+			fwrite(binary.data(), 1, binary.size(), file) == binary.size();
+		written = fclose(file) == 0 && written;
+		if (written) {
+			std::filesystem::rename(tempPath, cachePath, error);
+		}
+		if (!written || error) {
+			std::filesystem::remove(tempPath, error);
+		}
+	}
+
+	inline void logErrors(const ProgramSource& source, GLuint shaderObject, GLuint program) {
+		GLchar infoLog[1024];
+		GLint success = GL_TRUE;
+		if (shaderObject != 0) {
+			glGetShaderiv(shaderObject, GL_COMPILE_STATUS, &success);
+			if (!success) {
+				glGetShaderInfoLog(shaderObject, 1024, NULL, infoLog);
+				std::cout << "ERROR::SHADER_COMPILATION_ERROR in " << source.name << "\n" << infoLog << std::endl;
+			}
+			return;
+		}
+		glGetProgramiv(program, GL_LINK_STATUS, &success);
+		if (!success) {
+			glGetProgramInfoLog(program, 1024, NULL, infoLog);
+			std::cout << "ERROR::PROGRAM_LINKING_ERROR in " << source.name << "\n" << infoLog << std::endl;
+		}
+	}
+
+	// builds every program, from the cache where possible. all misses are submitted to the
+	// driver before any status is queried, so with parallel shader compile enabled (or a
+	// driver that compiles on its own threads) they build concurrently
+	inline std::vector<Shader> loadPrograms(const std::vector<ProgramSource>& sources) {
+		std::vector<Shader> shaders(sources.size());
+		std::vector<uint64_t> keys(sources.size(), 0);
+		std::vector<GLuint> vertexShaders(sources.size(), 0);
+		std::vector<GLuint> fragmentShaders(sources.size(), 0);
+
+		for (size_t i = 0; i < sources.size(); i++) {
+			if (binariesSupported) {
+				keys[i] = getKey(sources[i]);
+				if (tryLoad(sources[i], keys[i], shaders[i])) continue;
+			}
+
+			const ProgramSource& source = sources[i];
+			vertexShaders[i] = glCreateShader(GL_VERTEX_SHADER);
+			glShaderSource(vertexShaders[i], 1, &source.vertexCode, &source.vertexLength);
+			glCompileShader(vertexShaders[i]);
+			fragmentShaders[i] = glCreateShader(GL_FRAGMENT_SHADER);
+			glShaderSource(fragmentShaders[i], 1, &source.fragmentCode, &source.fragmentLength);
+			glCompileShader(fragmentShaders[i]);
+		}
+
+		for (size_t i = 0; i < sources.size(); i++) {
+			if (vertexShaders[i] == 0) continue;
+			shaders[i].ID = glCreateProgram();
+			if (binariesSupported) {
+				glProgramParameteri(shaders[i].ID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+			}
+			glAttachShader(shaders[i].ID, vertexShaders[i]);
+			glAttachShader(shaders[i].ID, fragmentShaders[i]);
+			glLinkProgram(shaders[i].ID);
+		}
+
+		for (size_t i = 0; i < sources.size(); i++) {
+			if (vertexShaders[i] == 0) continue;
+			logErrors(sources[i], vertexShaders[i], 0);
+			logErrors(sources[i], fragmentShaders[i], 0);
+			logErrors(sources[i], 0, shaders[i].ID);
+			glDeleteShader(vertexShaders[i]);
+			glDeleteShader(fragmentShaders[i]);
+
+			GLint linked = GL_FALSE;
+			glGetProgramiv(shaders[i].ID, GL_LINK_STATUS, &linked);
+			if (binariesSupported && linked) {
+				store(sources[i], keys[i], shaders[i]);
+			}
+		}
+		return shaders;
+	}
+}
@@ -0,0 +1,774 @@
+#pragma once
+#include <algorithm>
+#include <cfloat>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "AssetPack.h"
+#include "Utils.h"
+
+// table layouts, what World::reset() builds the playfield from. a table is written as a text
+// source (resources/tables/*.table) and compiled with --build-table into a binary that is memory
+// mapped and copied once at load, without parsing or baking. the records below are the binary
+// layout, TableDescription holds the same records in vectors. positions are in table space,
+// tuning.offset moves all of it into the world.
+// next to the layout the compiler bakes what the game would otherwise build at startup: the border
+// segments with their closest point terms, a segment tree over them and the border's render mesh,
+// all in world space
+enum TableSide {
+	TABLE_LEFT,
+	TABLE_RIGHT
+};
+
+// which optional tuning values the table sets, the rest are derived from the border like before
+enum TableTuningFlags {
+	TABLE_HAS_SPAWNS = 1,
+	TABLE_HAS_DESPAWN_HEIGHT = 2
+};
+
+struct TablePoint {
+	float x, y;
+};
+
+struct TableBumper {
+	float x, y;
+	float radius;
+	float pushAmount;
+};
+
+// angles in radians, ready for Flipper
+struct TableFlipper {
+	float x, y;
+	float radius;
+	float length;
+	float restAngle;
+	float maxRotation;
+	float angularVelocity;
+	float restitution;
+	uint32_t side;
+};
+
+// a border segment from a to a + ab, with the two dot products the closest point query divides
+struct TableSegment {
+	TablePoint a;
+	TablePoint ab;
+	float lengthSq;
+	float aDotAb;
+};
+
+// bounding volume tree over the border segments, depth first. segments are never reordered, a node
+// covers the contiguous range [first, first + count) of them. the left child of an inner node is the
+// next node, right is the index of the other one. leaves have right 0. the boxes are grown by
+// Table::NODE_MARGIN so rounding in the box distance never culls the closest segment
+struct TableNode {
+	float minX, minY;
+	float maxX, maxY;
+	uint32_t first;
+	uint32_t count;
+	uint32_t right;
+};
+
+// position and texture coordinate, six per border segment, the texture repeat already baked in
+struct TableMeshVertex {
+	float x, y;
+	float u, v;
+};
+
+struct TableTuning {
+	TablePoint offset;
+	TablePoint spawnLeft;
+	TablePoint spawnRight;
+	float despawnHeight;
+	float ballRadius;
+	int32_t initialBalls;
+	uint32_t flags;
+};
+
+// what the world derives from the layout, in world space: the lowest flipper, the height below
+// which a ball is lost and the two spawn points. baked like the segments
+struct TableLimits {
+	float lowestFlipperY;
+	float ballDespawnHeight;
+	TablePoint spawnLeft;
+	TablePoint spawnRight;
+};
+
+struct TableDescription {
+	// one closed loop, the last point connects back to the first
+	std::vector<TablePoint> border;
+	std::vector<TableBumper> bumpers;
+	std::vector<TableFlipper> flippers;
+	TableTuning tuning;
+	// baked from the above by Table::bake()
+	std::vector<TableSegment> segments;
+	std::vector<TableNode> nodes;
+	std::vector<TableMeshVertex> borderMesh;
+	TableLimits limits;
+
+	TableDescription() {
+		memset(&tuning, 0, sizeof(tuning));
+		memset(&limits, 0, sizeof(limits));
+		tuning.ballRadius = 2.0f;
+		tuning.initialBalls = 1;
+	}
+};
+
+// what Table::applyEdit() changed. when a count or the offset changed that part was rebuilt as a
+// whole, otherwise the lists hold the indices that differ
+struct TableEdit {
+	bool isBorderRebuilt;
+	bool areBumpersRebuilt;
+	bool areFlippersRebuilt;
+	bool isTuningChanged;
+	std::vector<uint32_t> segments;
+	std::vector<uint32_t> bumpers;
+	std::vector<uint32_t> flippers;
+	uint32_t refitNodes;
+
+	TableEdit() : isBorderRebuilt(false), areBumpersRebuilt(false), areFlippersRebuilt(false), isTuningChanged(false), refitNodes(0) {}
+
+	bool isEmpty() const {
+		return !isBorderRebuilt && !areBumpersRebuilt && !areFlippersRebuilt && !isTuningChanged && segments.empty() && bumpers.empty() && flippers.empty();
+	}
+};
+
+// binary layout, little endian: the header, then each section on a SECTION_ALIGNMENT boundary.
+// sections are offsets from the start of the file, never pointers, so the mapping is used as is
+namespace Table {
+	const char MAGIC[4] = { 'P', 'B', 'T', 'B' };
+	const uint32_t VERSION = 3;
+	const uint32_t SECTION_ALIGNMENT = 16;
+	// bumper push when the source leaves it out, the Obstacle default
+	constexpr float DEFAULT_PUSH_AMOUNT = 5.0f;
+	// the border the mesh is baked for, the collision skin and the renderer use the same
+	constexpr float BORDER_WIDTH = 2.5f;
+	constexpr float BORDER_UV_SCALE = 0.1f;
+	constexpr uint32_t LEAF_SEGMENTS = 4;
+	constexpr float NODE_MARGIN = 1e-3f;
+	// below this many segments scanning all of them is faster than walking the tree
+	constexpr uint32_t TREE_MIN_SEGMENTS = 24;
+
+	struct Section {
+		uint32_t offset;
+		uint32_t count;
+	};
+
+	struct FileHeader {
+		char magic[4];
+		uint32_t version;
+		uint32_t size;
+		uint32_t reserved;
+		Section border;
+		Section bumpers;
+		Section flippers;
+		Section segments;
+		Section nodes;
+		Section borderMesh;
+		TableTuning tuning;
+		TableLimits limits;
+	};
+
+	// the table as it is laid out in memory, pointing into a mapping or into a TableDescription
+	struct View {
+		const TableTuning* tuning;
+		const TableLimits* limits;
+		const TablePoint* border;
+		uint32_t borderCount;
+		const TableBumper* bumpers;
+		uint32_t bumperCount;
+		const TableFlipper* flippers;
+		uint32_t flipperCount;
+		const TableSegment* segments;
+		const TableNode* nodes;
+		uint32_t nodeCount;
+		const TableMeshVertex* borderMesh;
+	};
+
+	inline uint32_t alignUp(uint32_t value) {
+		return (value + SECTION_ALIGNMENT - 1) & ~(SECTION_ALIGNMENT - 1);
+	}
+
+	inline View getView(const TableDescription& table) {
+		return { &table.tuning, &table.limits, table.border.data(), (uint32_t)table.border.size(), table.bumpers.data(), (uint32_t)table.bumpers.size(),
+			table.flippers.data(), (uint32_t)table.flippers.size(), table.segments.data(), table.nodes.data(), (uint32_t)table.nodes.size(),
+			table.borderMesh.data() };
+	}
+
+	inline void copyView(const View& view, TableDescription& table) {
+		table.tuning = *view.tuning;
+		table.limits = *view.limits;
+		table.border.assign(view.border, view.border + view.borderCount);
+		table.bumpers.assign(view.bumpers, view.bumpers + view.bumperCount);
+		table.flippers.assign(view.flippers, view.flippers + view.flipperCount);
+		table.segments.assign(view.segments, view.segments + view.borderCount);
+		table.nodes.assign(view.nodes, view.nodes + view.nodeCount);
+		table.borderMesh.assign(view.borderMesh, view.borderMesh + view.borderCount * 6);
+	}
+
+	inline bool isBaked(const TableDescription& table) {
+		return table.segments.size() == table.border.size() && table.borderMesh.size() == table.border.size() * 6 && !table.nodes.empty();
+	}
+
+	// the world space segment from start to end, offset the way World::reset() offsets the border
+	// points. plain float math, the same operations glm does, so it bakes the same bits at compile
+	// time as at run time
+	constexpr TableSegment bakeSegment(TablePoint start, TablePoint end, TablePoint offset) {
+		float ax = start.x + offset.x;
+		float ay = start.y + offset.y;
+		float abx = (end.x + offset.x) - ax;
+		float aby = (end.y + offset.y) - ay;
+		return { { ax, ay }, { abx, aby }, abx * abx + aby * aby, ax * abx + ay * aby };
+	}
+
+	inline TableSegment bakeSegment(const TableDescription& table, size_t i) {
+		return bakeSegment(table.border[i], table.border[(i + 1) % table.border.size()], table.tuning.offset);
+	}
+
+	inline void bakeSegments(const TableDescription& table, std::vector<TableSegment>& segments) {
+		segments.resize(table.border.size());
+		for (size_t i = 0; i < segments.size(); i++) {
+			segments[i] = bakeSegment(table, i);
+		}
+	}
+
+	// the box around the node's segments, grown by NODE_MARGIN
+	constexpr void fitNode(const TableSegment* segments, TableNode& node) {
+		node.minX = node.minY = FLT_MAX;
+		node.maxX = node.maxY = -FLT_MAX;
+		for (uint32_t i = node.first; i < node.first + node.count; i++) {
+			const TableSegment& segment = segments[i];
+			float endX = segment.a.x + segment.ab.x;
+			float endY = segment.a.y + segment.ab.y;
+			node.minX = std::min(node.minX, std::min(segment.a.x, endX));
+			node.minY = std::min(node.minY, std::min(segment.a.y, endY));
+			node.maxX = std::max(node.maxX, std::max(segment.a.x, endX));
+			node.maxY = std::max(node.maxY, std::max(segment.a.y, endY));
+		}
+		node.minX -= NODE_MARGIN;
+		node.minY -= NODE_MARGIN;
+		node.maxX += NODE_MARGIN;
+		node.maxY += NODE_MARGIN;
+	}
+
+	constexpr uint32_t countNodes(uint32_t segmentCount) {
+		if (segmentCount <= LEAF_SEGMENTS) return 1;
+		return 1 + countNodes(segmentCount / 2) + countNodes(segmentCount - segmentCount / 2);
+	}
+
+	// the node for segments [first, first + count) and its children from nodes[nodeCount] on, returns its index
+	constexpr uint32_t buildNode(const TableSegment* segments, TableNode* nodes, uint32_t& nodeCount, uint32_t first, uint32_t count) {
+		uint32_t index = nodeCount++;
+		TableNode& node = nodes[index];
+		node.first = first;
+		node.count = count;
+		node.right = 0;
+		fitNode(segments, node);
+		if (count > LEAF_SEGMENTS) {
+			// border points run along the outline, so halving the range splits it into two nearby halves
+			uint32_t half = count / 2;
+			buildNode(segments, nodes, nodeCount, first, half);
+			nodes[index].right = buildNode(segments, nodes, nodeCount, first + half, count - half);
+		}
+		return index;
+	}
+
+	inline void buildTree(const std::vector<TableSegment>& segments, std::vector<TableNode>& nodes) {
+		nodes.clear();
+		if (segments.empty()) return;
+		nodes.resize(countNodes((uint32_t)segments.size()));
+		uint32_t nodeCount = 0;
+		buildNode(segments.data(), nodes.data(), nodeCount, 0, (uint32_t)segments.size());
+	}
+
+	// the limits the world used to work out at every reset: spawns and despawn height from the
+	// tuning when it sets them, from the border otherwise
+	constexpr TableLimits computeLimits(const TablePoint* border, size_t borderCount, const TableFlipper* flippers, size_t flipperCount,
+		const TableTuning& tuning) {
+		TableLimits limits = {};
+		TablePoint offset = tuning.offset;
+		limits.lowestFlipperY = FLT_MAX;
+		for (size_t i = 0; i < flipperCount; i++) {
+			float y = flippers[i].y + offset.y;
+			limits.lowestFlipperY = y < limits.lowestFlipperY ? y : limits.lowestFlipperY;
+		}
+
+		if (tuning.flags & TABLE_HAS_DESPAWN_HEIGHT) {
+			limits.ballDespawnHeight = tuning.despawnHeight + offset.y;
+		}
+		else {
+			float lowestPoint = FLT_MAX;
+			float secondLowestPoint = FLT_MAX;
+			for (size_t i = 0; i < borderCount; i++) {
+				float y = border[i].y + offset.y;
+				if (y < lowestPoint) {
+					secondLowestPoint = lowestPoint;
+					lowestPoint = y;
+				}
+			}
+			limits.ballDespawnHeight = (lowestPoint + secondLowestPoint) / 2.0f;
+		}
+
+		if (tuning.flags & TABLE_HAS_SPAWNS) {
+			limits.spawnLeft = { tuning.spawnLeft.x + offset.x, tuning.spawnLeft.y + offset.y };
+			limits.spawnRight = { tuning.spawnRight.x + offset.x, tuning.spawnRight.y + offset.y };
+		}
+		else {
+			float highestY = std::numeric_limits<float>::lowest();
+			float leftmost = FLT_MAX;
+			float rightmost = std::numeric_limits<float>::lowest();
+			for (size_t i = 0; i < borderCount; i++) {
+				TablePoint point = { border[i].x + offset.x, border[i].y + offset.y };
+				highestY = std::max(point.y, highestY);
+				leftmost = std::min(point.x, leftmost);
+				rightmost = std::max(point.x, rightmost);
+			}
+			limits.spawnLeft = { leftmost + BORDER_WIDTH, highestY - BORDER_WIDTH };
+			limits.spawnRight = { rightmost + BORDER_WIDTH, highestY - BORDER_WIDTH };
+		}
+		return limits;
+	}
+
+	inline TableLimits computeLimits(const TableDescription& table) {
+		return computeLimits(table.border.data(), table.border.size(), table.flippers.data(), table.flippers.size(), table.tuning);
+	}
+
+	// the quad SquareLineSprite draws for a segment: BORDER_WIDTH wide, centered on the segment,
+	// the texture repeating every 1 / BORDER_UV_SCALE units. six vertices
+	inline void bakeSegmentMesh(const TableSegment& segment, TableMeshVertex* out) {
+		const float corners[6][2] = { { 0.0f, 1.0f }, { 1.0f, 0.0f }, { 0.0f, 0.0f }, { 0.0f, 1.0f }, { 1.0f, 1.0f }, { 1.0f, 0.0f } };
+		glm::vec2 a = glm::vec2(segment.a.x, segment.a.y);
+		glm::vec2 ab = glm::vec2(segment.ab.x, segment.ab.y);
+		float length = glm::length(ab);
+		glm::vec2 along = length > 0.0f ? ab / length : glm::vec2(1.0f, 0.0f);
+		glm::vec2 across = glm::vec2(-along.y, along.x);
+		for (int i = 0; i < 6; i++) {
+			glm::vec2 position = a + along * (corners[i][0] * length) + across * ((corners[i][1] - 0.5f) * BORDER_WIDTH);
+			out[i] = { position.x, position.y, corners[i][0] * length * BORDER_UV_SCALE, corners[i][1] * BORDER_WIDTH * BORDER_UV_SCALE };
+		}
+	}
+
+	inline void bakeBorderMesh(const std::vector<TableSegment>& segments, std::vector<TableMeshVertex>& mesh) {
+		mesh.resize(segments.size() * 6);
+		for (size_t i = 0; i < segments.size(); i++) {
+			bakeSegmentMesh(segments[i], &mesh[i * 6]);
+		}
+	}
+
+	// fills in the segments, the tree and the mesh from the layout
+	inline void bake(TableDescription& table) {
+		bakeSegments(table, table.segments);
+		buildTree(table.segments, table.nodes);
+		bakeBorderMesh(table.segments, table.borderMesh);
+		table.limits = computeLimits(table);
+	}
+
+	// grows or shrinks the boxes of the nodes over the given segments, children come after their
+	// parent so going backwards fits every child before its parent. returns the number of nodes refit
+	inline uint32_t refitNodes(const std::vector<TableSegment>& segments, std::vector<TableNode>& nodes, const std::vector<uint32_t>& changed) {
+		std::vector<bool> isChanged(segments.size(), false);
+		for (uint32_t i : changed) isChanged[i] = true;
+		std::vector<bool> isRefit(nodes.size(), false);
+		uint32_t refitCount = 0;
+		for (size_t i = nodes.size(); i-- > 0;) {
+			TableNode& node = nodes[i];
+			if (node.right == 0) {
+				for (uint32_t k = node.first; k < node.first + node.count && !isRefit[i]; k++) isRefit[i] = isChanged[k];
+				if (isRefit[i]) fitNode(segments.data(), node);
+			}
+			else if (isRefit[i + 1] || isRefit[node.right]) {
+				const TableNode& left = nodes[i + 1];
+				const TableNode& right = nodes[node.right];
+				node.minX = std::min(left.minX, right.minX);
+				node.minY = std::min(left.minY, right.minY);
+				node.maxX = std::max(left.maxX, right.maxX);
+				node.maxY = std::max(left.maxY, right.maxY);
+				isRefit[i] = true;
+			}
+			if (isRefit[i]) refitCount++;
+		}
+		return refitCount;
+	}
+
+	// brings a baked table up to an edited version of it touching as little as possible: moved border
+	// points rebake the two segments and their mesh quads on either side and refit the tree nodes
+	// above them. a border with a different point count or a moved offset is baked again as a whole
+	inline void applyEdit(TableDescription& table, const TableDescription& edited, TableEdit& edit) {
+		edit = TableEdit();
+		bool isOffsetMoved = table.tuning.offset.x != edited.tuning.offset.x || table.tuning.offset.y != edited.tuning.offset.y;
+		edit.isTuningChanged = memcmp(&table.tuning, &edited.tuning, sizeof(TableTuning)) != 0;
+		table.tuning = edited.tuning;
+
+		size_t n = edited.border.size();
+		if (isOffsetMoved || table.border.size() != n || !isBaked(table)) {
+			table.border = edited.border;
+			bake(table);
+			edit.isBorderRebuilt = true;
+		}
+		else {
+			for (size_t i = 0; i < n; i++) {
+				if (table.border[i].x == edited.border[i].x && table.border[i].y == edited.border[i].y) continue;
+				table.border[i] = edited.border[i];
+				edit.segments.push_back((uint32_t)((i + n - 1) % n));
+				edit.segments.push_back((uint32_t)i);
+			}
+			std::sort(edit.segments.begin(), edit.segments.end());
+			edit.segments.erase(std::unique(edit.segments.begin(), edit.segments.end()), edit.segments.end());
+			for (uint32_t i : edit.segments) {
+				table.segments[i] = bakeSegment(table, i);
+				bakeSegmentMesh(table.segments[i], &table.borderMesh[i * 6]);
+			}
+			if (!edit.segments.empty()) edit.refitNodes = refitNodes(table.segments, table.nodes, edit.segments);
+		}
+
+		if (isOffsetMoved || table.bumpers.size() != edited.bumpers.size()) {
+			table.bumpers = edited.bumpers;
+			edit.areBumpersRebuilt = true;
+		}
+		else {
+			for (size_t i = 0; i < edited.bumpers.size(); i++) {
+				if (memcmp(&table.bumpers[i], &edited.bumpers[i], sizeof(TableBumper)) == 0) continue;
+				table.bumpers[i] = edited.bumpers[i];
+				edit.bumpers.push_back((uint32_t)i);
+			}
+		}
+
+		if (isOffsetMoved || table.flippers.size() != edited.flippers.size()) {
+			table.flippers = edited.flippers;
+			edit.areFlippersRebuilt = true;
+		}
+		else {
+			for (size_t i = 0; i < edited.flippers.size(); i++) {
+				if (memcmp(&table.flippers[i], &edited.flippers[i], sizeof(TableFlipper)) == 0) continue;
+				table.flippers[i] = edited.flippers[i];
+				edit.flippers.push_back((uint32_t)i);
+			}
+		}
+		table.limits = computeLimits(table);
+	}
+
+	// whether segments ab and cd share a point, in double so nearly touching ones are not missed
+	constexpr bool doSegmentsIntersect(const TablePoint& a, const TablePoint& b, const TablePoint& c, const TablePoint& d) {
+		auto cross = [](const TablePoint& o, const TablePoint& p, const TablePoint& q) {
+			return ((double)p.x - o.x) * ((double)q.y - o.y) - ((double)p.y - o.y) * ((double)q.x - o.x);
+		};
+		auto isWithin = [](const TablePoint& p, const TablePoint& q, const TablePoint& r) {
+			return std::min(p.x, q.x) <= r.x && r.x <= std::max(p.x, q.x) && std::min(p.y, q.y) <= r.y && r.y <= std::max(p.y, q.y);
+		};
+		double d1 = cross(c, d, a), d2 = cross(c, d, b), d3 = cross(a, b, c), d4 = cross(a, b, d);
+		if (((d1 > 0.0 && d2 < 0.0) || (d1 < 0.0 && d2 > 0.0)) && ((d3 > 0.0 && d4 < 0.0) || (d3 < 0.0 && d4 > 0.0))) return true;
+		return (d1 == 0.0 && isWithin(c, d, a)) || (d2 == 0.0 && isWithin(c, d, b)) || (d3 == 0.0 && isWithin(a, b, c)) || (d4 == 0.0 && isWithin(a, b, d));
+	}
+
+	enum GeometryError {
+		GEOMETRY_OK,
+		GEOMETRY_ZERO_LENGTH_SEGMENT,
+		GEOMETRY_SELF_INTERSECTION,
+		GEOMETRY_BAD_FLIPPER
+	};
+
+	// the first problem and where it is: the segment (or flipper) index and for an intersection the other segment
+	struct GeometryCheck {
+		GeometryError error;
+		size_t first;
+		size_t second;
+	};
+
+	// geometry the collision code cannot handle: zero length segments have no normal to push along,
+	// a border crossing itself has no inside. constexpr, so tables written in code are checked at compile time
+	constexpr GeometryCheck checkGeometry(const TablePoint* border, size_t n, const TableFlipper* flippers, size_t flipperCount) {
+		for (size_t i = 0; i < n; i++) {
+			const TablePoint& a = border[i];
+			const TablePoint& b = border[(i + 1) % n];
+			if (a.x == b.x && a.y == b.y) return { GEOMETRY_ZERO_LENGTH_SEGMENT, i, i };
+		}
+		for (size_t i = 0; i < n; i++) {
+			for (size_t j = i + 1; j < n; j++) {
+				const TablePoint& a = border[i];
+				const TablePoint& b = border[(i + 1) % n];
+				const TablePoint& c = border[j];
+				const TablePoint& d = border[(j + 1) % n];
+				bool isAdjacent = j == i + 1 || (i == 0 && j == n - 1);
+				if (isAdjacent) {
+					// neighbours share a point, they only intersect when one folds back over the other
+					const TablePoint& shared = j == i + 1 ? b : a;
+					const TablePoint& p = j == i + 1 ? a : b;
+					const TablePoint& q = j == i + 1 ? d : c;
+					double cross = ((double)p.x - shared.x) * ((double)q.y - shared.y) - ((double)p.y - shared.y) * ((double)q.x - shared.x);
+					double dot = ((double)p.x - shared.x) * ((double)q.x - shared.x) + ((double)p.y - shared.y) * ((double)q.y - shared.y);
+					if (cross != 0.0 || dot <= 0.0) continue;
+				}
+				else if (!doSegmentsIntersect(a, b, c, d)) continue;
+				return { GEOMETRY_SELF_INTERSECTION, i, j };
+			}
+		}
+		for (size_t i = 0; i < flipperCount; i++) {
+			if (!(flippers[i].radius > 0.0f && flippers[i].length > 0.0f)) return { GEOMETRY_BAD_FLIPPER, i, i };
+		}
+		return { GEOMETRY_OK, 0, 0 };
+	}
+
+	inline bool validate(const TableDescription& table, const std::string& name) {
+		const std::vector<TablePoint>& border = table.border;
+		size_t n = border.size();
+		GeometryCheck check = checkGeometry(border.data(), n, table.flippers.data(), table.flippers.size());
+		if (check.error == GEOMETRY_ZERO_LENGTH_SEGMENT) {
+			const TablePoint& point = border[check.first];
+			printf("ERROR::TABLE::ZERO_LENGTH_SEGMENT %s: border points %d and %d are both at %g %g\n", name.c_str(), (int)check.first,
+				(int)((check.first + 1) % n), point.x, point.y);
+		}
+		else if (check.error == GEOMETRY_SELF_INTERSECTION) {
+			printf("ERROR::TABLE::SELF_INTERSECTING_BORDER %s: segment %d-%d crosses segment %d-%d\n", name.c_str(), (int)check.first,
+				(int)((check.first + 1) % n), (int)check.second, (int)((check.second + 1) % n));
+		}
+		else if (check.error == GEOMETRY_BAD_FLIPPER) {
+			const TableFlipper& flipper = table.flippers[check.first];
+			printf("ERROR::TABLE::BAD_FLIPPER %s: at %g %g\n", name.c_str(), flipper.x, flipper.y);
+		}
+		return check.error == GEOMETRY_OK;
+	}
+
+	// source format, one statement per line, # starts a comment. angles in degrees, a flipper's
+	// rest angle is measured down from the horizontal, pointing inward
+	//   offset x y                 moves the whole table
+	//   ball_radius r
+	//   initial_balls n
+	//   spawn_left x y             optional, both spawns default to the top corners of the border
+	//   spawn_right x y
+	//   despawn_height y           optional, defaults to halfway between the two lowest border points
+	//   border x y                 one per point, in order
+	//   bumper x y radius [push]
+	//   flipper left|right x y radius length rest max_rotation angular_velocity restitution
+	inline bool parse(const std::string& source, TableDescription& table, const std::string& name = "table") {
+		table = TableDescription();
+		std::istringstream lines(source);
+		std::string line;
+		int lineNumber = 0;
+		int spawnCount = 0;
+		while (std::getline(lines, line)) {
+			lineNumber++;
+			size_t comment = line.find('#');
+			if (comment != std::string::npos) line.resize(comment);
+			std::istringstream words(line);
+			std::string keyword;
+			if (!(words >> keyword)) continue;
+
+			bool valid = true;
+			if (keyword == "offset") {
+				valid = (bool)(words >> table.tuning.offset.x >> table.tuning.offset.y);
+			}
+			else if (keyword == "ball_radius") {
+				valid = (bool)(words >> table.tuning.ballRadius) && table.tuning.ballRadius > 0.0f;
+			}
+			else if (keyword == "initial_balls") {
+				valid = (bool)(words >> table.tuning.initialBalls) && table.tuning.initialBalls >= 0;
+			}
+			else if (keyword == "spawn_left") {
+				valid = (bool)(words >> table.tuning.spawnLeft.x >> table.tuning.spawnLeft.y);
+				table.tuning.flags |= TABLE_HAS_SPAWNS;
+				spawnCount++;
+			}
+			else if (keyword == "spawn_right") {
+				valid = (bool)(words >> table.tuning.spawnRight.x >> table.tuning.spawnRight.y);
+				table.tuning.flags |= TABLE_HAS_SPAWNS;
+				spawnCount++;
+			}
+			else if (keyword == "despawn_height") {
+				valid = (bool)(words >> table.tuning.despawnHeight);
+				table.tuning.flags |= TABLE_HAS_DESPAWN_HEIGHT;
+			}
+			else if (keyword == "border") {
+				TablePoint point;
+				valid = (bool)(words >> point.x >> point.y);
+				table.border.push_back(point);
+			}
+			else if (keyword == "bumper") {
+				TableBumper bumper;
+				valid = (bool)(words >> bumper.x >> bumper.y >> bumper.radius) && bumper.radius > 0.0f;
+				bumper.pushAmount = DEFAULT_PUSH_AMOUNT;
+				if (valid && !(words >> std::ws).eof()) valid = (bool)(words >> bumper.pushAmount);
+				table.bumpers.push_back(bumper);
+			}
+			else if (keyword == "flipper") {
+				std::string side;
+				TableFlipper flipper;
+				float rest, maxRotation;
+				valid = (bool)(words >> side >> flipper.x >> flipper.y >> flipper.radius >> flipper.length >> rest >> maxRotation
+					>> flipper.angularVelocity >> flipper.restitution) && (side == "left" || side == "right");
+				flipper.side = side == "left" ? TABLE_LEFT : TABLE_RIGHT;
+				flipper.restAngle = flipper.side == TABLE_LEFT ? -Utils::deg2Rad(rest) : Utils::PI + Utils::deg2Rad(rest);
+				flipper.maxRotation = Utils::deg2Rad(maxRotation);
+				table.flippers.push_back(flipper);
+			}
+			else {
+				printf("ERROR::TABLE::UNKNOWN_STATEMENT %s:%d: %s\n", name.c_str(), lineNumber, keyword.c_str());
+				return false;
+			}
+
+			std::string extra;
+			if (!valid || (words >> extra)) {
+				printf("ERROR::TABLE::BAD_STATEMENT %s:%d: %s\n", name.c_str(), lineNumber, line.c_str());
+				return false;
+			}
+		}
+
+		if (table.border.size() < 3) {
+			printf("ERROR::TABLE::BORDER_NEEDS_3_POINTS %s\n", name.c_str());
+			return false;
+		}
+		if (spawnCount == 1) {
+			printf("ERROR::TABLE::NEEDS_BOTH_SPAWNS %s\n", name.c_str());
+			return false;
+		}
+		if (table.flippers.empty()) {
+			printf("ERROR::TABLE::NO_FLIPPERS %s\n", name.c_str());
+			return false;
+		}
+		return validate(table, name);
+	}
+
+	inline void appendSection(std::vector<uint8_t>& out, Section& section, const void* data, size_t count, size_t stride) {
+		out.resize(alignUp((uint32_t)out.size()), 0);
+		section.offset = (uint32_t)out.size();
+		section.count = (uint32_t)count;
+		const uint8_t* bytes = (const uint8_t*)data;
+		out.insert(out.end(), bytes, bytes + count * stride);
+	}
+
+	inline void compile(const TableDescription& source, std::vector<uint8_t>& out) {
+		TableDescription baked;
+		if (!isBaked(source)) {
+			baked = source;
+			bake(baked);
+		}
+		const TableDescription& table = isBaked(source) ? source : baked;
+
+		FileHeader header;
+		memset(&header, 0, sizeof(header));
+		memcpy(header.magic, MAGIC, 4);
+		header.version = VERSION;
+		header.tuning = table.tuning;
+		header.limits = table.limits;
+
+		out.assign(sizeof(FileHeader), 0);
+		appendSection(out, header.border, table.border.data(), table.border.size(), sizeof(TablePoint));
+		appendSection(out, header.bumpers, table.bumpers.data(), table.bumpers.size(), sizeof(TableBumper));
+		appendSection(out, header.flippers, table.flippers.data(), table.flippers.size(), sizeof(TableFlipper));
+		appendSection(out, header.segments, table.segments.data(), table.segments.size(), sizeof(TableSegment));
+		appendSection(out, header.nodes, table.nodes.data(), table.nodes.size(), sizeof(TableNode));
+		appendSection(out, header.borderMesh, table.borderMesh.data(), table.borderMesh.size(), sizeof(TableMeshVertex));
+		header.size = (uint32_t)out.size();
+		memcpy(out.data(), &header, sizeof(header));
+	}
+
+	inline bool isSectionValid(const Section& section, size_t stride, size_t size) {
+		return section.offset % SECTION_ALIGNMENT == 0 && section.offset <= size && section.count <= (size - section.offset) / stride;
+	}
+
+	// a tree from a damaged file could send the query outside the segments or around in circles
+	inline bool areNodesValid(const TableNode* nodes, uint32_t nodeCount, uint32_t segmentCount) {
+		if (nodeCount == 0) return false;
+		for (uint32_t i = 0; i < nodeCount; i++) {
+			const TableNode& node = nodes[i];
+			if (node.first > segmentCount || node.count > segmentCount - node.first) return false;
+			if (node.right == 0) continue;
+			if (node.right <= i + 1 || node.right >= nodeCount) return false;
+			// the children split the node's range between them
+			const TableNode& left = nodes[i + 1];
+			const TableNode& right = nodes[node.right];
+			if (left.first != node.first || left.count == 0 || right.count == 0 || right.first != left.first + left.count ||
+				left.count + right.count != node.count) return false;
+		}
+		return true;
+	}
+
+	// checks the header and that every section lies inside the data, then points into it
+	inline bool getView(const unsigned char* data, size_t size, View& view) {
+		if (data == nullptr || size < sizeof(FileHeader) || memcmp(data, MAGIC, 4) != 0) return false;
+		const FileHeader* header = (const FileHeader*)data;
+		if (header->version != VERSION || header->size != size) return false;
+		if (!isSectionValid(header->border, sizeof(TablePoint), size) || !isSectionValid(header->bumpers, sizeof(TableBumper), size) ||
+			!isSectionValid(header->flippers, sizeof(TableFlipper), size) || !isSectionValid(header->segments, sizeof(TableSegment), size) ||
+			!isSectionValid(header->nodes, sizeof(TableNode), size) || !isSectionValid(header->borderMesh, sizeof(TableMeshVertex), size)) return false;
+		if (header->segments.count != header->border.count || header->borderMesh.count != (uint64_t)header->border.count * 6) return false;
+		const TableNode* nodes = (const TableNode*)(data + header->nodes.offset);
+		if (!areNodesValid(nodes, header->nodes.count, header->segments.count)) return false;
+
+		view.tuning = &header->tuning;
+		view.limits = &header->limits;
+		view.border = (const TablePoint*)(data + header->border.offset);
+		view.borderCount = header->border.count;
+		view.bumpers = (const TableBumper*)(data + header->bumpers.offset);
+		view.bumperCount = header->bumpers.count;
+		view.flippers = (const TableFlipper*)(data + header->flippers.offset);
+		view.flipperCount = header->flippers.count;
+		view.segments = (const TableSegment*)(data + header->segments.offset);
+		view.nodes = nodes;
+		view.nodeCount = header->nodes.count;
+		view.borderMesh = (const TableMeshVertex*)(data + header->borderMesh.offset);
+		return view.borderCount >= 3 && view.flipperCount > 0;
+	}
+
+	inline bool loadSource(const std::string& path, TableDescription& table) {
+		std::vector<unsigned char> bytes;
+		if (!Utils::readFile(path, bytes)) {
+			printf("ERROR::TABLE::FAILED_TO_READ: %s\n", path.c_str());
+			return false;
+		}
+		if (!parse(std::string(bytes.begin(), bytes.end()), table, path)) return false;
+		bake(table);
+		return true;
+	}
+
+	// the world edits its table on hot reload, so the sections are copied out and the file unmapped
+	inline bool loadBinary(const std::string& path, TableDescription& table) {
+		MappedFile file;
+		View view;
+		if (!file.open(path)) return false;
+		if (!getView(file.data, file.size, view)) {
+			printf("ERROR::TABLE::BAD_BINARY: %s\n", path.c_str());
+			return false;
+		}
+		copyView(view, table);
+		return true;
+	}
+
+	// the compiled table when there is one at least as new as the source, the source otherwise
+	inline bool load(const std::string& sourcePath, const std::string& binaryPath, TableDescription& table) {
+		std::error_code sourceError, binaryError;
+		std::filesystem::file_time_type sourceTime = std::filesystem::last_write_time(sourcePath, sourceError);
+		std::filesystem::file_time_type binaryTime = std::filesystem::last_write_time(binaryPath, binaryError);
+		if (!binaryError && (sourceError || binaryTime >= sourceTime) && loadBinary(binaryPath, table)) return true;
+		return loadSource(sourcePath, table);
+	}
+
+	// entry point for --build-table
+	inline bool build(const std::string& sourcePath, const std::string& binaryPath) {
+		TableDescription table;
+		if (!loadSource(sourcePath, table)) return false;
+		std::vector<uint8_t> bytes;
+		compile(table, bytes);
+
+		std::error_code error;
+		std::filesystem::create_directories(std::filesystem::path(binaryPath).parent_path(), error);
+		FILE* out = fopen(binaryPath.c_str(), "wb");
+		if (out == nullptr) {
+			printf("ERROR::TABLE::FAILED_TO_WRITE: %s\n", binaryPath.c_str());
+			return false;
+		}
+		fwrite(bytes.data(), 1, bytes.size(), out);
+		bool written = !ferror(out);
+		fclose(out);
+		printf("%s: %d border points, %d bumpers, %d flippers, %d tree nodes, %d mesh vertices, %d bytes\n", binaryPath.c_str(),
+			(int)table.border.size(), (int)table.bumpers.size(), (int)table.flippers.size(), (int)table.nodes.size(), (int)table.borderMesh.size(),
+			(int)bytes.size());
+		return written;
+	}
+}
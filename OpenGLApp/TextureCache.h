@@ -0,0 +1,233 @@
+#pragma once
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "stb_image.h"
+extern "C" {
+#include "image_DXT.h"
+}
+
+#include "Utils.h"
+
+// pixels ready for upload, either raw RGB/RGBA or a preprocessed S3TC block stream.
+// the bytes are owned by data, or borrowed from the asset pack mapping through view
+struct DecodedImage {
+	int handle;
+	int width, height;
+	bool hasAlpha;
+	unsigned int compressedFormat; // 0 for raw pixels
+	std::vector<unsigned char> data;
+	const unsigned char* view;
+	size_t viewSize;
+	DecodedImage() : handle(-1), width(0), height(0), hasAlpha(false), compressedFormat(0), view(nullptr), viewSize(0) {}
+
+	const unsigned char* bytes() const {
+		return view != nullptr ? view : (data.empty() ? nullptr : data.data());
+	}
+
+	size_t size() const {
+		return view != nullptr ? viewSize : data.size();
+	}
+};
+
+// on-disk cache of preprocessed textures next to the resources folder,
+// one file per source image and format: a header followed by the upload ready data.
+// large images are stored as S3TC when the driver takes it and as raw pixels when it does not,
+// so a driver without S3TC gets its own warm cache instead of decoding every png again
+namespace TextureCache {
+	// values of GL_COMPRESSED_RGB_S3TC_DXT1_EXT / GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+	constexpr unsigned int FORMAT_DXT1 = 0x83F1;
+	constexpr unsigned int FORMAT_DXT5 = 0x83F3;
+	constexpr uint32_t VERSION = 1;
+	// tiny sprites stay uncompressed, DXT would smear their pixels for no memory gain
+	constexpr int MIN_COMPRESS_SIZE = 64;
+
+	struct Header {
+		char magic[4];
+		uint32_t version;
+		uint64_t sourceHash;
+		uint64_t sourceSize;
+		int64_t sourceTime;
+		int32_t width, height;
+		uint32_t hasAlpha;
+		uint32_t compressedFormat;
+		uint64_t dataSize;
+	};
+
+	inline std::string cacheDirectory = "cache/textures";
+
+	inline std::string getCachePath(const std::string& sourcePath, bool compress) {
+		std::string name = std::filesystem::path(sourcePath).lexically_normal().generic_string();
+		for (char& c : name) {
+			if (c == '/' || c == ':' || c == '.') c = '_';
+		}
+		name.erase(0, name.find_first_not_of('_'));
+		return cacheDirectory + "/" + name + (compress ? ".tex" : "_rgba.tex");
+	}
+
+	inline int64_t getSourceTime(const std::string& path) {
+		std::error_code error;
+		std::filesystem::file_time_type time = std::filesystem::last_write_time(path, error);
+		if (error) return 0;
+		return (int64_t)time.time_since_epoch().count();
+	}
+
+	inline bool parseHeader(const unsigned char* bytes, size_t size, Header& header) {
+		if (size < sizeof(Header)) return false;
+		memcpy(&header, bytes, sizeof(Header));
+		if (memcmp(header.magic, "PBTC", 4) != 0 || header.version != VERSION) return false;
+		return header.dataSize == size - sizeof(Header);
+	}
+
+	// an entry built for S3TC does not do for a driver without it
+	inline bool isUsable(const Header& header, const DecodedImage& image, bool compress) {
+		return header.hasAlpha == (uint32_t)image.hasAlpha && (compress || header.compressedFormat == 0);
+	}
+
+	// points the image at an entry held in memory without copying the pixel data
+	inline bool viewEntry(const unsigned char* bytes, size_t size, DecodedImage& image, bool compress) {
+		Header header;
+		if (!parseHeader(bytes, size, header) || !isUsable(header, image, compress)) return false;
+		image.width = header.width;
+		image.height = header.height;
+		image.compressedFormat = header.compressedFormat;
+		image.view = bytes + sizeof(Header);
+		image.viewSize = header.dataSize;
+		return true;
+	}
+
+	inline std::vector<unsigned char> serialize(const DecodedImage& image, uint64_t sourceHash, uint64_t sourceSize, int64_t sourceTime) {
+		Header header;
+		memcpy(header.magic, "PBTC", 4);
+		header.version = VERSION;
+		header.sourceHash = sourceHash;
+		header.sourceSize = sourceSize;
+		header.sourceTime = sourceTime;
+		header.width = image.width;
+		header.height = image.height;
+		header.hasAlpha = image.hasAlpha;
+		header.compressedFormat = image.compressedFormat;
+		header.dataSize = image.size();
+
+		std::vector<unsigned char> bytes(sizeof(Header) + image.size());
+		memcpy(bytes.data(), &header, sizeof(Header));
+		if (image.size() > 0) {
+			memcpy(bytes.data() + sizeof(Header), image.bytes(), image.size());
+		}
+		return bytes;
+	}
+
+	// hit when the stored size and timestamp match, otherwise the source hash decides
+	inline bool tryLoad(const std::string& cachePath, const std::string& sourcePath, DecodedImage& image, bool compress, std::vector<unsigned char>& sourceBytes, uint64_t& sourceHash) {
+		std::vector<unsigned char> bytes;
+		Header header;
+		if (!Utils::readFile(cachePath, bytes) || !parseHeader(bytes.data(), bytes.size(), header)) return false;
+		if (!isUsable(header, image, compress)) return false;
+
+		std::error_code error;
+		uint64_t sourceSize = std::filesystem::file_size(sourcePath, error);
+		bool unchanged = !error && sourceSize == header.sourceSize && getSourceTime(sourcePath) == header.sourceTime;
+		if (!unchanged) {
+			if (!Utils::readFile(sourcePath, sourceBytes)) return false;
+			sourceHash = Utils::hashBytes(sourceBytes.data(), sourceBytes.size());
+			if (sourceHash != header.sourceHash) return false;
+		}
+
+		image.width = header.width;
+		image.height = header.height;
+		image.compressedFormat = header.compressedFormat;
+		image.data.assign(bytes.begin() + sizeof(Header), bytes.end());
+		return true;
+	}
+
+	// sourceTime 0 for a source that is not a file of its own, the hash decides then
+	inline void store(const std::string& cachePath, int64_t sourceTime, const DecodedImage& image, uint64_t sourceHash, uint64_t sourceSize) {
+		std::error_code error;
+		std::filesystem::create_directories(std::filesystem::path(cachePath).parent_path(), error);
+
+		std::vector<unsigned char> bytes = serialize(image, sourceHash, sourceSize, sourceTime);
+
+		// write to a temporary file first so a crash never leaves a truncated entry behind
+		std::string tempPath = cachePath + ".tmp";
+		FILE* file = fopen(tempPath.c_str(), "wb");
+		if (file == nullptr) return;
+		bool written = fwrite(bytes.data(), 1, bytes.size(), file) == bytes.size();
+		fclose(file);
+		if (written) {
+			std::filesystem::rename(tempPath, cachePath, error);
+		}
+		else {
+			std::filesystem::remove(tempPath, error);
+		}
+	}
+
+	// decodes the source and compresses it when it is large enough and compress is set
+	inline bool build(const unsigned char* sourceBytes, size_t sourceSize, DecodedImage& image, bool compress) {
+		int channels;
+		int desiredChannels = image.hasAlpha ? 4 : 3;
+		image.view = nullptr;
+		unsigned char* pixels = stbi_load_from_memory(sourceBytes, (int)sourceSize, &image.width, &image.height, &channels, desiredChannels);
+		if (pixels == nullptr) return false;
+
+		image.compressedFormat = 0;
+		if (compress && image.width >= MIN_COMPRESS_SIZE && image.height >= MIN_COMPRESS_SIZE) {
+			int compressedSize = 0;
+			unsigned char* compressed = image.hasAlpha ?
+				convert_image_to_DXT5(pixels, image.width, image.height, desiredChannels, &compressedSize) :
+				convert_image_to_DXT1(pixels, image.width, image.height, desiredChannels, &compressedSize);
+			if (compressed != nullptr) {
+				image.compressedFormat = image.hasAlpha ? FORMAT_DXT5 : FORMAT_DXT1;
+				image.data.assign(compressed, compressed + compressedSize);
+				free(compressed);
+			}
+		}
+
+		if (image.compressedFormat == 0) {
+			image.data.assign(pixels, pixels + (size_t)image.width * image.height * desiredChannels);
+		}
+		stbi_image_free(pixels);
+		return true;
+	}
+
+	inline bool loadImage(const std::string& sourcePath, DecodedImage& image, bool compress) {
+		std::string cachePath = getCachePath(sourcePath, compress);
+		std::vector<unsigned char> sourceBytes;
+		uint64_t sourceHash = 0;
+		if (tryLoad(cachePath, sourcePath, image, compress, sourceBytes, sourceHash)) return true;
+
+		if (sourceBytes.empty()) {
+			if (!Utils::readFile(sourcePath, sourceBytes)) return false;
+			sourceHash = Utils::hashBytes(sourceBytes.data(), sourceBytes.size());
+		}
+		if (!build(sourceBytes.data(), sourceBytes.size(), image, compress)) return false;
+		store(cachePath, getSourceTime(sourcePath), image, sourceHash, sourceBytes.size());
+		return true;
+	}
+
+	// the same for a source held in memory, e.g. a png in the asset pack. name only picks the
+	// cache file, the hash of the bytes decides whether the entry is still good
+	inline bool loadImage(const std::string& name, const unsigned char* sourceBytes, size_t sourceSize, DecodedImage& image, bool compress) {
+		std::string cachePath = getCachePath(name, compress);
+		uint64_t sourceHash = Utils::hashBytes(sourceBytes, sourceSize);
+		std::vector<unsigned char> bytes;
+		Header header;
+		if (Utils::readFile(cachePath, bytes) && parseHeader(bytes.data(), bytes.size(), header) &&
+			isUsable(header, image, compress) && header.sourceHash == sourceHash) {
+			image.width = header.width;
+			image.height = header.height;
+			image.compressedFormat = header.compressedFormat;
+			image.data.assign(bytes.begin() + sizeof(Header), bytes.end());
+			return true;
+		}
+
+		if (!build(sourceBytes, sourceSize, image, compress)) return false;
+		store(cachePath, 0, image, sourceHash, sourceSize);
+		return true;
+	}
+}
@@ -0,0 +1,39 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+
+// single producer, single consumer hand-off without locks. the writer always owns one slot,
+// the reader owns another and the third sits in the middle holding the newest published value.
+// publish() and acquire() swap their slot with the middle one, so neither side ever waits
+template <typename T>
+struct TripleBuffer {
+	static const uint8_t INDEX_MASK = 0x3;
+	static const uint8_t DIRTY_BIT = 0x4;
+
+	T buffers[3];
+	std::atomic<uint8_t> middle;
+	uint8_t back;
+	uint8_t front;
+
+	TripleBuffer() : middle(1), back(0), front(2) {}
+
+	// writer side: fill the returned slot, then publish it
+	T& beginWrite() {
+		return buffers[back];
+	}
+
+	void publish() {
+		back = middle.exchange(back | DIRTY_BIT, std::memory_order_acq_rel) & INDEX_MASK;
+	}
+
+	// reader side: swaps in the newest published value, returns false when nothing new arrived
+	bool acquire() {
+		if ((middle.load(std::memory_order_relaxed) & DIRTY_BIT) == 0) return false;
+		front = middle.exchange(front, std::memory_order_acq_rel) & INDEX_MASK;
+		return true;
+	}
+
+	const T& read() const {
+		return buffers[front];
+	}
+};
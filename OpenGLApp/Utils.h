@@ -1,5 +1,9 @@
 #pragma once
 #include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
 #include <cstdlib>
 
 #include <glm/glm.hpp>
@@ -9,15 +13,11 @@
 namespace Utils {
 	constexpr float PI = 3.14159f;
 
-	inline float deg2Rad(float deg) {
+	constexpr float deg2Rad(float deg) {
 		return (deg * PI) / 180.0f;
 	}
 
-	inline float RandFloat() {
-		return (float)rand() / (float)RAND_MAX;
-	}
-
-	glm::vec2 getClosestPointOnSegment(glm::vec2 p, glm::vec2 a, glm::vec2 b) {
+	inline glm::vec2 getClosestPointOnSegment(glm::vec2 p, glm::vec2 a, glm::vec2 b) {
 		glm::vec2 ab = b - a;
 		float t = glm::dot(ab, ab);
 		if (t == 0.0f) return a;
@@ -29,4 +29,27 @@ namespace Utils {
 	inline glm::vec2 getPerpendicular(glm::vec2 v) {
 		return glm::vec2(-v.y, v.x);
 	}
+
+	// 64-bit FNV-1a, pass the previous result as seed to hash data in several pieces
+	inline uint64_t hashBytes(const void* data, size_t size, uint64_t seed = 14695981039346656037ull) {
+		const unsigned char* bytes = (const unsigned char*)data;
+		uint64_t hash = seed;
+		for (size_t i = 0; i < size; i++) {
+			hash ^= bytes[i];
+			hash *= 1099511628211ull;
+		}
+		return hash;
+	}
+
+	inline bool readFile(const std::string& path, std::vector<unsigned char>& bytes) {
+		FILE* file = fopen(path.c_str(), "rb");
+		if (file == nullptr) return false;
+		fseek(file, 0, SEEK_END);
+		long size = ftell(file);
+		fseek(file, 0, SEEK_SET);
+		bytes.resize(size > 0 ? size : 0);
+		size_t read = size > 0 ? fread(bytes.data(), 1, size, file) : 0;
+		fclose(file);
+		return read == bytes.size();
+	}
 }
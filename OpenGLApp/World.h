@@ -0,0 +1,1527 @@
+#pragma once
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <type_traits>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "Utils.h"
+#include "JobSystem.h"
+#include "Random.h"
+#include "Scalar.h"
+#include "Integrator.h"
+#include "Narrowphase.h"
+#include "DefaultTable.h"
+
+// physics
+const glm::vec2 GRAVITY = glm::vec2(0.0f, -9.81) * 10.0f;
+const float RESTITUTION = 0.2f;
+const float FLIPPER_HEIGHT = 1.7f;
+const float BORDER_SIZE = Table::BORDER_WIDTH;
+
+// how the game moves balls, see Integrator.h. another one changes every trajectory, so replays
+// and rewind histories recorded with the old one stop matching
+typedef Integrators::SemiImplicitEuler BallIntegrator;
+
+// shapes and collisions are templates over the scalar type (see Scalar.h), the game uses the
+// float instantiations below. fixed point versions are built from the same code
+template <typename T>
+struct CircleT {
+	VecT<T> position;
+	T radius;
+	CircleT(VecT<T> position, T radius): position(position), radius(radius) {}
+};
+
+template <typename T>
+struct BallT : CircleT<T> {
+	VecT<T> velocity;
+	T mass;
+	// handed out by World::createBall, keys the contact solver's impulses across steps
+	uint32_t id;
+	BallT(): CircleT<T>(VecT<T>(), T(0.5f)), velocity(), mass(T(1.0f)), id(0) {}
+	template <typename Integrator = BallIntegrator>
+	void update(T dt) {
+		Integrator::integrate(this->position, velocity, VecT<T>(GRAVITY), dt);
+	}
+};
+
+template <typename T>
+struct ObstacleT : CircleT<T> {
+	T pushAmount;
+	ObstacleT(): CircleT<T>(VecT<T>(), T(0.5f)), pushAmount(T(2.0f)) {}
+	ObstacleT(VecT<T> position, T radius, T pushAmount = T(5.0f)): CircleT<T>(position, radius), pushAmount(pushAmount) {}
+};
+
+template <typename T>
+struct FlipperT {
+	int id;
+
+	VecT<T> position;
+	T radius;
+	T length;
+	T restAngle;
+	T maxRotation;
+	bool isSignPositive;
+	T angularVelocity;
+	T restitution;
+
+	T currentRotation;
+	T currentAngularVelocity;
+	bool isFlipped;
+
+	FlipperT(VecT<T> position, T radius, T length, T restAngle, T maxRotation, T angularVelocity, T restitution, bool positiveSign = true) :
+		id(-1),
+		position(position), radius(radius), length(length), restAngle(restAngle), maxRotation(maxRotation), isSignPositive(positiveSign),
+		angularVelocity(angularVelocity), restitution(restitution),
+		currentRotation(T(0.0f)), currentAngularVelocity(T(0.0f)), isFlipped(false) {}
+
+	void update(T dt) {
+		T prevRotation = currentRotation;
+		if (isFlipped) currentRotation = ScalarMath::min(currentRotation + angularVelocity * dt, maxRotation);
+		else currentRotation = ScalarMath::max(currentRotation - angularVelocity * dt, T(0.0f));
+		currentAngularVelocity = (isSignPositive ? T(1.0f) : T(-1.0f)) * (currentRotation - prevRotation) / dt;
+	}
+
+	VecT<T> getFlipperEnd() const {
+		T angle = restAngle + (isSignPositive ? T(1.0f) : T(-1.0f)) * currentRotation;
+		VecT<T> dir = VecT<T>(ScalarMath::cos(angle), ScalarMath::sin(angle));
+		return position + dir * length;
+	}
+};
+
+typedef CircleT<float> Circle;
+typedef BallT<float> Ball;
+typedef ObstacleT<float> Obstacle;
+typedef FlipperT<float> Flipper;
+
+enum FlipperMouseControlId {
+	LEFT = 0,
+	RIGHT
+};
+
+// bodies as narrowphase shapes (Narrowphase.h). balls, bumpers and enemies are circles, a flipper
+// is a capsule half its radius thick, the border a segment chain as thick as BORDER_SIZE
+template <typename T>
+inline CircleShapeT<T> getShape(const CircleT<T>& circle) {
+	return { circle.position, circle.radius };
+}
+
+template <typename T>
+inline CapsuleShapeT<T> getShape(const FlipperT<T>& flipper) {
+	return { flipper.position, flipper.getFlipperEnd(), flipper.radius * T(0.5f) };
+}
+
+// the scalar type comes from the point type, VecT<T> alone does not give T away
+template <typename Vec, typename T = decltype(ScalarMath::dot(Vec(), Vec()))>
+inline SegmentChainT<T> getShape(const std::vector<Vec>& borderPoints) {
+	return { borderPoints.data(), (int)borderPoints.size(), T(BORDER_SIZE * 0.5f) };
+}
+
+inline BakedChainShape getShape(const TableDescription& table) {
+	return { &table, BORDER_SIZE * 0.5f };
+}
+
+// contact responses, what a contact does to the two bodies, one overload per pair of body types.
+// handleCollision below finds the contact with the kernel for their shapes and hands it over
+template <typename T>
+inline void applyContact(BallT<T>& b1, BallT<T>& b2, const ContactT<T>& contact) {
+	if (contact.distance <= T(0.0001f)) return;
+
+	VecT<T> dir = -contact.normal;
+	T correction = contact.depth / T(2.0f);
+	b1.position += dir * -correction;
+	b2.position += dir * correction;
+
+	T v1 = ScalarMath::dot(b1.velocity, dir);
+	T v2 = ScalarMath::dot(b2.velocity, dir);
+
+	T m1 = b1.mass;
+	T m2 = b2.mass;
+
+	T newV1 = (m1 * v1 + m2 * v2 - m2 * (v1 - v2) * T(RESTITUTION)) / (m1 + m2);
+	T newV2 = (m1 * v1 + m2 * v2 - m1 * (v2 - v1) * T(RESTITUTION)) / (m1 + m2);
+
+	b1.velocity += dir * (newV1 - v1);
+	b2.velocity += dir * (newV2 - v2);
+}
+
+// bumpers kick the ball away at their push speed
+template <typename T>
+inline void applyContact(BallT<T>& ball, const ObstacleT<T>& obstacle, const ContactT<T>& contact) {
+	ball.position += contact.normal * contact.depth;
+
+	T v = ScalarMath::dot(ball.velocity, contact.normal);
+	ball.velocity += contact.normal * (obstacle.pushAmount - v);
+}
+
+// the ball takes the speed of the flipper's surface where it was hit
+template <typename T>
+inline void applyContact(BallT<T>& ball, const FlipperT<T>& flipper, const ContactT<T>& contact) {
+	ball.position += contact.normal * contact.depth;
+
+	VecT<T> r = contact.point;
+	r += contact.normal * flipper.radius;
+	r -= flipper.position;
+	VecT<T> surfaceVelocity = ScalarMath::perpendicular(r);
+	surfaceVelocity *= flipper.currentAngularVelocity;
+
+	T v = ScalarMath::dot(ball.velocity, contact.normal);
+	T newV = ScalarMath::dot(surfaceVelocity, contact.normal);
+
+	ball.velocity += contact.normal * (newV - v);
+}
+
+template <typename T>
+inline void bounceOffBorder(BallT<T>& ball, const ContactT<T>& contact) {
+	ball.position += contact.normal * contact.depth;
+
+	T v = ScalarMath::dot(ball.velocity, contact.normal);
+	T newV = ScalarMath::abs(v) * T(RESTITUTION);
+
+	ball.velocity += contact.normal * (newV - v);
+}
+
+template <typename T>
+inline void applyContact(BallT<T>& ball, const std::vector<VecT<T>>&, const ContactT<T>& contact) {
+	bounceOffBorder(ball, contact);
+}
+
+inline void applyContact(Ball& ball, const TableDescription&, const Contact& contact) {
+	bounceOffBorder(ball, contact);
+}
+
+// a against b through the kernel for their shapes, true when they touched
+template <typename A, typename B>
+inline bool handleCollision(A& a, B& b) {
+	ContactT<typename decltype(getShape(a))::Scalar> contact;
+	if (!collide(getShape(a), getShape(b), contact)) return false;
+	applyContact(a, b, contact);
+	return true;
+}
+
+// a against every body in others, shapes[i] being the shape of others[i]: static bodies are
+// turned into shapes once per step instead of once per pair
+template <typename A, typename B, typename Shape>
+inline void handleCollisions(A& a, const std::vector<B>& others, const std::vector<Shape>& shapes) {
+	for (size_t i = 0; i < others.size(); i++) {
+		ContactT<typename Shape::Scalar> contact;
+		if (collide(getShape(a), shapes[i], contact)) applyContact(a, others[i], contact);
+	}
+}
+
+template <typename B, typename Shape>
+inline void makeShapes(const std::vector<B>& bodies, std::vector<Shape>& shapes) {
+	shapes.resize(bodies.size());
+	for (size_t i = 0; i < bodies.size(); i++) {
+		shapes[i] = getShape(bodies[i]);
+	}
+}
+
+// overlap without a response, for rules that only need to know about a touch
+template <typename A, typename B>
+inline bool isTouching(const A& a, const B& b) {
+	ContactT<typename decltype(getShape(a))::Scalar> contact;
+	return collide(getShape(a), getShape(b), contact) && contact.depth > 0;
+}
+
+template <typename T>
+struct BallCorrectionT {
+	VecT<T> position;
+	VecT<T> velocity;
+};
+
+typedef BallCorrectionT<float> BallCorrection;
+
+// the change the ball pair response applies to b1, without touching either ball
+template <typename T>
+inline bool getBallCollisionResponse(const BallT<T>& b1, const BallT<T>& b2, BallCorrectionT<T>& correction) {
+	ContactT<T> contact;
+	if (!collide(getShape(b1), getShape(b2), contact) || contact.distance <= T(0.0001f)) return false;
+
+	VecT<T> dir = -contact.normal;
+
+	T v1 = ScalarMath::dot(b1.velocity, dir);
+	T v2 = ScalarMath::dot(b2.velocity, dir);
+
+	T m1 = b1.mass;
+	T m2 = b2.mass;
+
+	T newV1 = (m1 * v1 + m2 * v2 - m2 * (v1 - v2) * T(RESTITUTION)) / (m1 + m2);
+
+	correction.position = dir * -(contact.depth / T(2.0f));
+	correction.velocity = dir * (newV1 - v1);
+	return true;
+}
+
+// game
+enum GameState {
+	RUNNING,
+	GAME_OVER
+};
+
+enum SimulationCommand {
+	COMMAND_RESET,
+	COMMAND_SPAWN_BALL,
+	COMMAND_SPAWN_ENEMY,
+	COMMAND_FLIP_LEFT,
+	COMMAND_RELEASE_LEFT,
+	COMMAND_FLIP_RIGHT,
+	COMMAND_RELEASE_RIGHT,
+	COMMAND_SAVE_SNAPSHOT,
+	COMMAND_LOAD_SNAPSHOT
+};
+
+// frame timing of a sprite sheet animation, the sprite itself lives on the render side
+struct FrameAnimation {
+	unsigned int frameCount;
+	unsigned int currentFrame;
+	float timePerFrame;
+	float timer;
+	bool isLooping;
+	FrameAnimation(unsigned int frameCount = 1, float timePerFrame = 0.0f, bool isLooping = true) :
+		frameCount(frameCount), currentFrame(0), timePerFrame(timePerFrame), timer(0.0f), isLooping(isLooping) {}
+
+	void update(float dt) {
+		timer += dt;
+		if (timer > timePerFrame) {
+			timer = 0.0f;
+			if (isLooping) {
+				currentFrame = (currentFrame + 1) % frameCount;
+			}
+			else if (currentFrame < frameCount) {
+				currentFrame++;
+			}
+		}
+	}
+};
+
+const FrameAnimation ENEMY_FLYING_ANIMATION = FrameAnimation(4, 0.1f, true);
+const FrameAnimation ENEMY_DYING_ANIMATION = FrameAnimation(7, 0.05f, false);
+
+struct Enemy : Circle {
+	enum Status {
+		ALIVE,
+		DEAD
+	};
+
+	float speedAbsorption;
+	FrameAnimation flyingAnimation;
+	FrameAnimation dyingAnimation;
+	bool isDead;
+	bool isFacingRight;
+	glm::vec2 velocity;
+	Status status;
+	bool canRemove;
+
+	Enemy(glm::vec2 position, float radius, float pushAmount, bool isFacingRight, glm::vec2 velocity) :
+		Circle(position, radius),
+		speedAbsorption(pushAmount),
+		flyingAnimation(ENEMY_FLYING_ANIMATION), dyingAnimation(ENEMY_DYING_ANIMATION),
+		isDead(false), isFacingRight(isFacingRight), velocity(velocity), status(ALIVE), canRemove(false) {}
+
+	void update(float dt) {
+		switch (status) {
+			case ALIVE:
+				flyingAnimation.update(dt);
+				break;
+			case DEAD:
+				dyingAnimation.update(dt);
+				break;
+		}
+
+		if (isDead) {
+			if (dyingAnimation.currentFrame >= dyingAnimation.frameCount - 1) {
+				canRemove = true;
+			}
+			return;
+		}
+
+
+		position += velocity * dt;
+	}
+
+	void setToDead() {
+		isDead = true;
+		dyingAnimation.currentFrame = 0;
+		status = DEAD;
+	}
+
+	unsigned int getCurrentFrame() const {
+		return status == ALIVE ? flyingAnimation.currentFrame : dyingAnimation.currentFrame;
+	}
+};
+
+// enemies turn around at the border
+inline void applyContact(Enemy& enemy, const TableDescription&, const Contact& contact) {
+	enemy.position += contact.normal * contact.depth;
+	enemy.velocity.x = -enemy.velocity.x;
+}
+
+const int COMBO_TO_SPAWN_BALL = 2;
+const float COMBO_WINDOW = 1.0f;
+const int SCORE_PER_SCORING_INTERVAL = 10;
+const int SCORE_PER_ENEMY = 50;
+const float COMBO_SCORE_MULTIPLIER = 1.5f;
+const float TIME_PER_SCORING_INTERVAL = 5.0f;
+const float SHAKE_DURATION = 0.25f;
+const int COMBO_TO_SHAKE = COMBO_TO_SPAWN_BALL;
+
+// enemy pacing, every TIME_PER_PARAMETERS_UPDATE seconds the interval and speeds are scaled
+struct DifficultySettings {
+	float initialEnemySpawnInterval;
+	float initialEnemyDescendSpeed;
+	float initialEnemyMaxHorizontalSpeed;
+	float enemySpawnIntervalDecreaseRateMultiplier;
+	float enemySpeedIncreaseRateMultiplier;
+	float timePerParametersUpdate;
+	DifficultySettings() :
+		initialEnemySpawnInterval(2.0f), initialEnemyDescendSpeed(5.0f), initialEnemyMaxHorizontalSpeed(1.0f),
+		enemySpawnIntervalDecreaseRateMultiplier(0.95f), enemySpeedIncreaseRateMultiplier(1.05f), timePerParametersUpdate(15.0f) {}
+};
+
+// running totals of one game, read by the batch runner
+struct WorldStats {
+	uint32_t seed;
+	float survivalTime;
+	int score;
+	int ballsSpawned;
+	int enemiesSpawned;
+	int enemiesKilled;
+	WorldStats() : seed(0), survivalTime(0.0f), score(0), ballsSpawned(0), enemiesSpawned(0), enemiesKilled(0) {}
+};
+
+// what the contact solver keeps of a contact between steps: the summed normal impulse, by the ids
+// of the two balls (lower first), or the ball id and CONTACT_KEY_FLIPPER + flipper index or
+// CONTACT_KEY_BORDER
+struct ContactKey {
+	uint32_t a, b;
+
+	bool operator<(const ContactKey& other) const {
+		return a < other.a || (a == other.a && b < other.b);
+	}
+
+	bool operator==(const ContactKey& other) const {
+		return a == other.a && b == other.b;
+	}
+};
+
+struct ContactImpulse {
+	ContactKey key;
+	float impulse;
+};
+
+const uint32_t CONTACT_KEY_FLIPPER = 0xffffff00u;
+const uint32_t CONTACT_KEY_BORDER = 0xffffffffu;
+
+// ball contacts
+// contacts are colored so no two in a color share a ball, each color is then resolved in parallel.
+// past JACOBI_CONTACT_THRESHOLD every contact is solved against the same state instead and
+// each ball applies the average of its corrections, which needs no coloring at all
+struct BallContact {
+	int a, b;
+};
+
+const int MAX_CONTACT_COLORS = 64;
+const int JACOBI_CONTACT_THRESHOLD = 4096;
+const int BALL_JOB_GRAIN = 32;
+const int ENEMY_JOB_GRAIN = 32;
+// from this many balls candidate pairs come from a uniform grid instead of testing every pair.
+// cells are one ball diameter wide, so touching balls are in the same or neighbouring cells.
+// balls spread far apart get larger cells instead of more than BROADPHASE_CELLS_PER_BALL cells each
+const int BROADPHASE_MIN_BALLS = 64;
+const int BROADPHASE_CELLS_PER_BALL = 4;
+
+// sequential impulse solver, World::useContactSolver. instead of one pass that fixes each pair on
+// its own, every contact of a ball (other balls, flippers, the border) is a constraint on the normal
+// velocity. the constraints are swept CONTACT_VELOCITY_ITERATIONS times, each contact adding to its
+// impulse and the sum kept from pulling, then CONTACT_POSITION_ITERATIONS sweeps take out the
+// overlap but CONTACT_SLOP. each contact's impulse is kept for the next step and applied before the
+// first sweep (warm starting), so a resting pile starts every step already holding itself up.
+// bumpers kick rather than hold, they keep their own response
+struct SolverContact {
+	// ball indices, b is -1 for a flipper or the border
+	int a, b;
+	ContactKey key;
+	// moves a out of b
+	glm::vec2 normal;
+	// of b when it is a flipper or the border
+	glm::vec2 surfaceVelocity;
+	// positions when the contact was found, the position sweeps measure from them
+	glm::vec2 startA, startB;
+	float depth;
+	float normalMass;
+	float targetVelocity;
+	float impulse;
+};
+
+const int CONTACT_VELOCITY_ITERATIONS = 4;
+const int CONTACT_POSITION_ITERATIONS = 2;
+const float CONTACT_SLOP = 0.01f;
+const float CONTACT_POSITION_FACTOR = 0.8f;
+// slower approaches come to rest instead of bouncing, above the speed gravity adds in one 1/60 step
+const float CONTACT_BOUNCE_SPEED = 3.0f;
+
+// the plain values of a World, everything but the element arrays and scratch buffers.
+// World derives from it so the members read as before, and a snapshot copies it as one block
+struct WorldState {
+	GameState gameState;
+	float lowestFlipperY;
+	float ballDespawnHeight;
+	glm::vec2 spawnPosLeft, spawnPosRight;
+	int numOfBallsToSpawn;
+	int comboCounter;
+	float comboTimer;
+	float enemySpawnInterval;
+	float enemyDescendSpeed;
+	float enemyMaxHorizontalSpeed;
+	float enemySpawnTimer;
+	float parameterTimer;
+	float scoreIntervalTimer;
+	int score;
+	float shakeTimer;
+	glm::vec3 cameraShake;
+	glm::vec3 overlay;
+
+	DifficultySettings difficulty;
+	WorldStats stats;
+	// gameplay draws (spawns, enemies) and cosmetic draws (camera shake) use separate streams,
+	// so toggling an effect never changes how a seeded game plays out
+	Pcg32 random;
+	Pcg32 effectsRandom;
+
+	// the id createBall gives the next ball
+	uint32_t nextBallId;
+	// the step the contact solver's kept impulses come from
+	float contactCacheDt;
+
+	// steps taken since reset. with hashSteps on, stateHash folds in hashState() after every step
+	uint64_t stepIndex;
+	uint64_t stateHash;
+};
+
+static_assert(std::is_trivially_copyable<WorldState>::value, "WorldState is copied as raw bytes");
+static_assert(std::is_trivially_copyable<Ball>::value, "balls are copied as raw bytes");
+static_assert(std::is_trivially_copyable<Enemy>::value, "enemies are copied as raw bytes");
+static_assert(std::is_trivially_copyable<Flipper>::value, "flippers are copied as raw bytes");
+static_assert(std::is_trivially_copyable<ContactImpulse>::value, "contact impulses are copied as raw bytes");
+
+// a World's dynamic state in one contiguous arena: the WorldState block, then the balls, enemies,
+// flippers and the contact solver's kept impulses back to back. the arena only grows, so saving
+// into a snapshot that was used before does not allocate, and copying one snapshot into another is
+// a single memcpy
+struct WorldSnapshot {
+	static const size_t ALIGNMENT = 16;
+
+	std::vector<unsigned char> arena;
+	size_t size;
+	uint32_t ballCount, enemyCount, flipperCount, contactCount;
+	size_t ballOffset, enemyOffset, flipperOffset, contactOffset;
+
+	WorldSnapshot() : size(0), ballCount(0), enemyCount(0), flipperCount(0), contactCount(0),
+		ballOffset(0), enemyOffset(0), flipperOffset(0), contactOffset(0) {}
+
+	bool isEmpty() const {
+		return size == 0;
+	}
+
+	// keeps the arena for the next layout
+	void clear() {
+		size = 0;
+		ballCount = enemyCount = flipperCount = contactCount = 0;
+	}
+
+	static size_t align(size_t offset) {
+		return (offset + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+	}
+
+	void layout(uint32_t balls, uint32_t enemies, uint32_t flippers, uint32_t contacts) {
+		ballCount = balls;
+		enemyCount = enemies;
+		flipperCount = flippers;
+		contactCount = contacts;
+		ballOffset = align(sizeof(WorldState));
+		enemyOffset = align(ballOffset + ballCount * sizeof(Ball));
+		flipperOffset = align(enemyOffset + enemyCount * sizeof(Enemy));
+		contactOffset = align(flipperOffset + flipperCount * sizeof(Flipper));
+		size = contactOffset + contactCount * sizeof(ContactImpulse);
+		if (arena.size() < size) arena.resize(size);
+	}
+
+	void copyFrom(const WorldSnapshot& other) {
+		layout(other.ballCount, other.enemyCount, other.flipperCount, other.contactCount);
+		memcpy(arena.data(), other.arena.data(), size);
+	}
+
+	template <typename T>
+	const T* at(size_t offset) const {
+		return reinterpret_cast<const T*>(arena.data() + offset);
+	}
+};
+
+// one complete game: the table, everything moving on it, the rules state and its own random
+// stream. nothing in here touches globals, so any number of worlds can run side by side.
+// jobs is optional, without it every loop runs on the calling thread
+struct World : WorldState {
+	std::vector<glm::vec2> borderPoints;
+	std::vector<Ball> balls;
+	std::vector<Obstacle> obstacles;
+	std::vector<Flipper> flippers;
+	std::vector<Enemy> enemies;
+
+	std::vector<float> spawnRolls;
+	JobSystem* jobs;
+	bool hashSteps;
+	// what reset() builds, set it and reset to play another table
+	TableDescription table;
+	// taken by reset() once the table is built, restart() goes back to it
+	WorldSnapshot initialSnapshot;
+	// quick save slot for COMMAND_SAVE_SNAPSHOT / COMMAND_LOAD_SNAPSHOT
+	WorldSnapshot savedSnapshot;
+
+	std::vector<BallContact> ballContacts;
+	std::vector<BallContact> coloredContacts;
+	std::vector<int> contactColorStart;
+	std::vector<std::vector<BallContact>> contactBuckets;
+	// the broadphase grid: balls sorted by cell, where each cell starts in gridBalls, each ball's cell
+	std::vector<int> gridCellStart;
+	std::vector<int> gridBalls;
+	std::vector<int> ballCells;
+	std::vector<int> gridCursor;
+	std::vector<std::vector<int>> gridNeighbours;
+	std::vector<int> ballContactStart;
+	std::vector<int> ballContactList;
+	std::vector<BallCorrection> ballCorrections;
+	// bumpers and flippers as shapes, made at the start of every step
+	std::vector<CircleShape> obstacleShapes;
+	std::vector<CapsuleShape> flipperShapes;
+
+	// ball contacts go through the sequential impulse solver instead of handleBallContacts and the
+	// single pass against flippers and the border. another simulation, replays record the choice
+	bool useContactSolver;
+	std::vector<SolverContact> solverContacts;
+	// impulses of the last step's contacts sorted by key, part of the snapshot so a restored world
+	// warm starts the same way
+	std::vector<ContactImpulse> contactCache;
+	std::vector<ContactImpulse> nextContactCache;
+
+	World(uint32_t seed = 0, const DifficultySettings& difficulty = DifficultySettings(), JobSystem* jobs = nullptr) :
+		jobs(jobs), hashSteps(false), table(Table::getDefault()), useContactSolver(false) {
+		this->difficulty = difficulty;
+		balls.reserve(100);
+		enemies.reserve(100);
+		reset(seed);
+	}
+
+	static const uint64_t GAMEPLAY_STREAM = 0;
+	static const uint64_t EFFECTS_STREAM = 1;
+
+	float randFloat() {
+		return random.nextFloat();
+	}
+
+	template <typename Function>
+	void parallelFor(int count, int grainSize, const Function& function) {
+		if (jobs != nullptr) jobs->parallelFor(count, grainSize, function);
+		else if (count > 0) function(0, count);
+	}
+
+	// rebuilds the playfield from table and starts a new game on it
+	void reset(uint32_t seed) {
+		borderPoints.clear();
+		balls.clear();
+		nextBallId = 0;
+		contactCache.clear();
+		contactCacheDt = 0.0f;
+		flippers.clear();
+		obstacles.clear();
+		enemies.clear();
+
+		overlay = glm::vec3(1.0f);
+		shakeTimer = 0.0f;
+		cameraShake = glm::vec3(0.0f);
+
+		gameState = RUNNING;
+		comboCounter = 0;
+		comboTimer = 0.0f;
+		numOfBallsToSpawn = 0;
+
+		enemySpawnInterval = difficulty.initialEnemySpawnInterval;
+		enemyDescendSpeed = difficulty.initialEnemyDescendSpeed;
+		enemyMaxHorizontalSpeed = difficulty.initialEnemyMaxHorizontalSpeed;
+
+		enemySpawnTimer = 0.0f;
+		parameterTimer = 0.0f;
+
+		scoreIntervalTimer = TIME_PER_SCORING_INTERVAL;
+		score = 0;
+
+		// the collision code reads the border from the baked segments, a table filled in by hand has none yet
+		if (!Table::isBaked(table)) Table::bake(table);
+		const TableTuning& tuning = table.tuning;
+		for (const TablePoint& point : table.border) {
+			borderPoints.push_back(glm::vec2(point.x, point.y));
+		}
+
+		for (const TableBumper& bumper : table.bumpers) {
+			obstacles.push_back(Obstacle(glm::vec2(bumper.x, bumper.y), bumper.radius, bumper.pushAmount));
+		}
+
+		for (int i = 0; i < tuning.initialBalls; i++) {
+			spawnBall();
+		}
+
+		for (const TableFlipper& flipper : table.flippers) {
+			bool isLeft = flipper.side == TABLE_LEFT;
+			flippers.push_back(Flipper(glm::vec2(flipper.x, flipper.y), flipper.radius, flipper.length, flipper.restAngle,
+				flipper.maxRotation, flipper.angularVelocity, flipper.restitution, isLeft));
+			flippers.back().id = isLeft ? LEFT : RIGHT;
+		}
+
+		glm::vec2 offset = glm::vec2(tuning.offset.x, tuning.offset.y);
+		offsetEverythingBy(offset);
+		updateTableLimits();
+
+		saveSnapshot(initialSnapshot);
+		reseed(seed);
+	}
+
+	// lowest flipper, despawn height and spawn points, baked with the table
+	void updateTableLimits() {
+		const TableLimits& limits = table.limits;
+		lowestFlipperY = limits.lowestFlipperY;
+		ballDespawnHeight = limits.ballDespawnHeight;
+		spawnPosLeft = glm::vec2(limits.spawnLeft.x, limits.spawnLeft.y);
+		spawnPosRight = glm::vec2(limits.spawnRight.x, limits.spawnRight.y);
+	}
+
+	// takes an edited version of the table over without a restart, balls and enemies play on. only
+	// what differs is touched: moved border points rebake their segments and refit the tree above
+	// them, changed bumpers and flippers are updated in place, flippers keep their swing. the
+	// snapshots hold the old flippers and limits, so the restart snapshot is taken again by the
+	// next reset and the quick save is dropped
+	void applyTableEdit(const TableDescription& edited, TableEdit& edit) {
+		Table::applyEdit(table, edited, edit);
+		glm::vec2 offset = glm::vec2(table.tuning.offset.x, table.tuning.offset.y);
+
+		if (edit.isBorderRebuilt || !edit.segments.empty()) {
+			borderPoints.resize(table.border.size());
+			for (size_t i = 0; i < table.border.size(); i++) {
+				borderPoints[i] = glm::vec2(table.border[i].x, table.border[i].y);
+				borderPoints[i] += offset;
+			}
+		}
+
+		if (edit.areBumpersRebuilt) obstacles.clear();
+		for (size_t i = 0; i < table.bumpers.size(); i++) {
+			if (!edit.areBumpersRebuilt && !std::binary_search(edit.bumpers.begin(), edit.bumpers.end(), (uint32_t)i)) continue;
+			const TableBumper& bumper = table.bumpers[i];
+			Obstacle obstacle = Obstacle(glm::vec2(bumper.x, bumper.y), bumper.radius, bumper.pushAmount);
+			obstacle.position += offset;
+			if (edit.areBumpersRebuilt) obstacles.push_back(obstacle);
+			else obstacles[i] = obstacle;
+		}
+
+		if (edit.areFlippersRebuilt) flippers.clear();
+		for (size_t i = 0; i < table.flippers.size(); i++) {
+			if (!edit.areFlippersRebuilt && !std::binary_search(edit.flippers.begin(), edit.flippers.end(), (uint32_t)i)) continue;
+			const TableFlipper& description = table.flippers[i];
+			bool isLeft = description.side == TABLE_LEFT;
+			Flipper flipper = Flipper(glm::vec2(description.x, description.y), description.radius, description.length, description.restAngle,
+				description.maxRotation, description.angularVelocity, description.restitution, isLeft);
+			flipper.position += offset;
+			flipper.id = isLeft ? LEFT : RIGHT;
+			if (edit.areFlippersRebuilt) {
+				flippers.push_back(flipper);
+				continue;
+			}
+			flipper.currentRotation = std::min(flippers[i].currentRotation, flipper.maxRotation);
+			flipper.isFlipped = flippers[i].isFlipped;
+			flippers[i] = flipper;
+		}
+
+		updateTableLimits();
+		contactCache.clear();
+		initialSnapshot.clear();
+		savedSnapshot.clear();
+	}
+
+	// same result as reset(seed) as long as the table did not change, without rebuilding it
+	void restart(uint32_t seed) {
+		if (!restoreSnapshot(initialSnapshot)) {
+			reset(seed);
+			return;
+		}
+		reseed(seed);
+	}
+
+	// the seed dependent part of a reset, nothing before it draws random numbers
+	void reseed(uint32_t seed) {
+		random.seed(seed, GAMEPLAY_STREAM);
+		effectsRandom.seed(seed, EFFECTS_STREAM);
+		stats = WorldStats();
+		stats.seed = seed;
+		stepIndex = 0;
+		stateHash = Utils::hashBytes(&seed, sizeof(seed));
+	}
+
+	void saveSnapshot(WorldSnapshot& snapshot) const {
+		snapshot.layout(balls.size(), enemies.size(), flippers.size(), contactCache.size());
+		unsigned char* arena = snapshot.arena.data();
+		memcpy(arena, static_cast<const WorldState*>(this), sizeof(WorldState));
+		memcpy(arena + snapshot.ballOffset, balls.data(), balls.size() * sizeof(Ball));
+		memcpy(arena + snapshot.enemyOffset, enemies.data(), enemies.size() * sizeof(Enemy));
+		memcpy(arena + snapshot.flipperOffset, flippers.data(), flippers.size() * sizeof(Flipper));
+		memcpy(arena + snapshot.contactOffset, contactCache.data(), contactCache.size() * sizeof(ContactImpulse));
+	}
+
+	// the snapshot has to come from a world on the same table, only the flipper count is checked.
+	// the vectors keep their capacity, so restoring does not allocate once they are big enough
+	bool restoreSnapshot(const WorldSnapshot& snapshot) {
+		if (snapshot.isEmpty() || snapshot.flipperCount != flippers.size()) return false;
+		// assigned through the base rather than copied over it, World members may sit in its tail padding
+		static_cast<WorldState&>(*this) = *snapshot.at<WorldState>(0);
+		const Ball* savedBalls = snapshot.at<Ball>(snapshot.ballOffset);
+		balls.assign(savedBalls, savedBalls + snapshot.ballCount);
+		const Enemy* savedEnemies = snapshot.at<Enemy>(snapshot.enemyOffset);
+		enemies.assign(savedEnemies, savedEnemies + snapshot.enemyCount);
+		memcpy(flippers.data(), snapshot.at<Flipper>(snapshot.flipperOffset), flippers.size() * sizeof(Flipper));
+		const ContactImpulse* savedContacts = snapshot.at<ContactImpulse>(snapshot.contactOffset);
+		contactCache.assign(savedContacts, savedContacts + snapshot.contactCount);
+		return true;
+	}
+
+	void offsetEverythingBy(glm::vec2 offset) {
+		for (glm::vec2& point : borderPoints) {
+			point += offset;
+		}
+
+		for (Ball& ball : balls) {
+			ball.position += offset;
+		}
+
+		for (Obstacle& obstacle : obstacles) {
+			obstacle.position += offset;
+		}
+
+		for (Flipper& flipper : flippers) {
+			flipper.position += offset;
+		}
+
+		for (Enemy& enemy : enemies) {
+			enemy.position += offset;
+		}
+	}
+
+	void applyCommand(SimulationCommand command) {
+		if (command == COMMAND_RESET) {
+			// a restart continues the hash chain, one session stays one chain
+			uint64_t previousHash = stateHash;
+			restart(random.nextUInt());
+			stateHash = Utils::hashBytes(&previousHash, sizeof(previousHash), stateHash);
+			return;
+		}
+		if (command == COMMAND_SAVE_SNAPSHOT) {
+			saveSnapshot(savedSnapshot);
+			return;
+		}
+		if (command == COMMAND_LOAD_SNAPSHOT) {
+			restoreSnapshot(savedSnapshot);
+			return;
+		}
+		if (flippers.empty() || gameState == GAME_OVER) return;
+
+		switch (command) {
+			case COMMAND_SPAWN_BALL:
+				spawnBall();
+				break;
+			case COMMAND_SPAWN_ENEMY:
+				spawnEnemy();
+				break;
+			case COMMAND_FLIP_LEFT:
+				setFlipped(LEFT, true);
+				break;
+			case COMMAND_RELEASE_LEFT:
+				setFlipped(LEFT, false);
+				break;
+			case COMMAND_FLIP_RIGHT:
+				setFlipped(RIGHT, true);
+				break;
+			case COMMAND_RELEASE_RIGHT:
+				setFlipped(RIGHT, false);
+				break;
+			default:
+				break;
+		}
+	}
+
+	void setFlipped(int id, bool isFlipped) {
+		for (Flipper& flipper : flippers) {
+			if (flipper.id == id) {
+				flipper.isFlipped = isFlipped;
+			}
+		}
+	}
+
+	// stand-in player for headless runs: a flipper swings up when a ball is within reach of it,
+	// and drops back once fully raised so a ball resting on it gets launched again
+	void autoplay() {
+		for (Flipper& flipper : flippers) {
+			bool ballInReach = false;
+			for (const Ball& ball : balls) {
+				glm::vec2 offset = ball.position - flipper.position;
+				float reach = flipper.length + ball.radius;
+				if (glm::dot(offset, offset) < reach * reach && offset.y < flipper.length * 0.5f) {
+					ballInReach = true;
+					break;
+				}
+			}
+			bool swinging = flipper.isFlipped ? flipper.currentRotation < flipper.maxRotation : flipper.currentRotation == 0.0f;
+			flipper.isFlipped = ballInReach && swinging;
+		}
+	}
+
+	void step(float dt) {
+		updateSimulation(dt);
+		updateGame(dt);
+		endStep();
+	}
+
+	// closes a step, call after updateSimulation and updateGame when not going through step()
+	void endStep() {
+		stepIndex++;
+		if (hashSteps) stateHash = hashState(stateHash);
+	}
+
+	// everything a step reads or changes, field by field so padding never reaches the hash.
+	// the table itself is left out, it does not change after reset
+	uint64_t hashState(uint64_t seed) const {
+		uint64_t hash = seed;
+		auto add = [&hash](const auto& value) {
+			hash = Utils::hashBytes(&value, sizeof(value), hash);
+		};
+
+		add(stepIndex);
+		add(balls.size());
+		for (const Ball& ball : balls) {
+			add(ball.position);
+			add(ball.velocity);
+		}
+		for (const Flipper& flipper : flippers) {
+			add(flipper.currentRotation);
+			add(flipper.currentAngularVelocity);
+			add(flipper.isFlipped);
+		}
+		// empty unless the contact solver runs, so hashes without it stay what they were
+		if (!contactCache.empty()) add(contactCacheDt);
+		for (const ContactImpulse& contact : contactCache) {
+			add(contact.key.a);
+			add(contact.key.b);
+			add(contact.impulse);
+		}
+		add(enemies.size());
+		for (const Enemy& enemy : enemies) {
+			add(enemy.position);
+			add(enemy.velocity);
+			add(enemy.status);
+			add(enemy.flyingAnimation.currentFrame);
+			add(enemy.dyingAnimation.currentFrame);
+		}
+
+		add(gameState);
+		add(numOfBallsToSpawn);
+		add(comboCounter);
+		add(comboTimer);
+		add(enemySpawnInterval);
+		add(enemyDescendSpeed);
+		add(enemyMaxHorizontalSpeed);
+		add(enemySpawnTimer);
+		add(parameterTimer);
+		add(scoreIntervalTimer);
+		add(score);
+		add(shakeTimer);
+		add(random.state);
+		add(effectsRandom.state);
+		return hash;
+	}
+
+	void updateSimulation(float dt) {
+		updateSimulationWith<BallIntegrator>(dt);
+	}
+
+	// the simulation half of a step with balls moved by Integrator, for comparing integrators
+	template <typename Integrator>
+	void updateSimulationWith(float dt) {
+		for (Flipper& flipper : flippers) {
+			flipper.update(dt);
+		}
+
+		int n = balls.size();
+		parallelFor(n, BALL_JOB_GRAIN, [this, dt](int begin, int end) {
+			for (int i = begin; i < end; i++) {
+				balls[i].template update<Integrator>(dt);
+			}
+		});
+
+		makeShapes(obstacles, obstacleShapes);
+		makeShapes(flippers, flipperShapes);
+		if (useContactSolver) {
+			solveContacts(dt);
+			parallelFor(n, BALL_JOB_GRAIN, [this](int begin, int end) {
+				for (int i = begin; i < end; i++) {
+					handleCollisions(balls[i], obstacles, obstacleShapes);
+				}
+			});
+			return;
+		}
+
+		handleBallContacts();
+
+		// static geometry only moves the ball itself, so every ball is independent
+		parallelFor(n, BALL_JOB_GRAIN, [this](int begin, int end) {
+			for (int i = begin; i < end; i++) {
+				Ball& ball = balls[i];
+				handleCollisions(ball, obstacles, obstacleShapes);
+				handleCollisions(ball, flippers, flipperShapes);
+				handleCollision(ball, table);
+			}
+		});
+	}
+
+	// one constraint for a contact of ball a, found with the narrowphase. b is the other ball or
+	// -1, then surfaceVelocity is how fast the flipper or border moves where it was touched.
+	// approaches faster than CONTACT_BOUNCE_SPEED bounce back with restitution
+	void addSolverContact(int a, int b, ContactKey key, const Contact& contact, glm::vec2 surfaceVelocity, float restitution) {
+		SolverContact solverContact;
+		solverContact.a = a;
+		solverContact.b = b;
+		solverContact.key = key;
+		solverContact.normal = contact.normal;
+		solverContact.depth = contact.depth;
+		// a ball behind a border segment goes back through it, the same way the single pass sends it
+		if (contact.depth < 0.0f) {
+			solverContact.normal = -contact.normal;
+			solverContact.depth = -contact.depth;
+		}
+		solverContact.surfaceVelocity = surfaceVelocity;
+		solverContact.startA = balls[a].position;
+		solverContact.startB = b >= 0 ? balls[b].position : glm::vec2(0.0f);
+
+		float inverseMass = 1.0f / balls[a].mass + (b >= 0 ? 1.0f / balls[b].mass : 0.0f);
+		solverContact.normalMass = 1.0f / inverseMass;
+
+		glm::vec2 otherVelocity = b >= 0 ? balls[b].velocity : surfaceVelocity;
+		float approach = glm::dot(balls[a].velocity - otherVelocity, solverContact.normal);
+		solverContact.targetVelocity = approach < -CONTACT_BOUNCE_SPEED ? -restitution * approach : 0.0f;
+
+		// warm start from the impulse the same contact ended the last step with
+		solverContact.impulse = 0.0f;
+		std::vector<ContactImpulse>::const_iterator cached = std::lower_bound(contactCache.begin(), contactCache.end(), key,
+			[](const ContactImpulse& entry, const ContactKey& key) { return entry.key < key; });
+		if (cached != contactCache.end() && cached->key == key) solverContact.impulse = cached->impulse;
+		solverContacts.push_back(solverContact);
+	}
+
+	void applySolverImpulse(const SolverContact& contact, float impulse) {
+		balls[contact.a].velocity += contact.normal * (impulse / balls[contact.a].mass);
+		if (contact.b >= 0) balls[contact.b].velocity -= contact.normal * (impulse / balls[contact.b].mass);
+	}
+
+	// the sequential impulse solver, see SolverContact. gauss-seidel runs in order on this thread,
+	// contacts are found in the same order every time so the result is still bit exact
+	void solveContacts(float dt) {
+		collectBallContacts();
+		solverContacts.clear();
+		for (const BallContact& pair : ballContacts) {
+			Contact contact;
+			if (!collide(getShape(balls[pair.a]), getShape(balls[pair.b]), contact) || contact.distance <= 0.0001f) continue;
+			uint32_t idA = balls[pair.a].id;
+			uint32_t idB = balls[pair.b].id;
+			ContactKey key = { std::min(idA, idB), std::max(idA, idB) };
+			addSolverContact(pair.a, pair.b, key, contact, glm::vec2(0.0f), RESTITUTION);
+		}
+
+		int n = balls.size();
+		for (int i = 0; i < n; i++) {
+			for (size_t f = 0; f < flippers.size(); f++) {
+				Contact contact;
+				if (!collide(getShape(balls[i]), flipperShapes[f], contact)) continue;
+				// the flipper hands the ball its surface speed and does not bounce it, like applyContact
+				const Flipper& flipper = flippers[f];
+				glm::vec2 r = contact.point + contact.normal * flipper.radius - flipper.position;
+				glm::vec2 surfaceVelocity = ScalarMath::perpendicular(r) * flipper.currentAngularVelocity;
+				addSolverContact(i, -1, { balls[i].id, CONTACT_KEY_FLIPPER + (uint32_t)f }, contact, surfaceVelocity, 0.0f);
+			}
+			Contact contact;
+			if (collide(getShape(balls[i]), getShape(table), contact)) {
+				addSolverContact(i, -1, { balls[i].id, CONTACT_KEY_BORDER }, contact, glm::vec2(0.0f), RESTITUTION);
+			}
+		}
+
+		// the kept impulses hold the pile up for the last step's dt, frames folded into a longer
+		// step need proportionally more
+		float warmStartScale = contactCacheDt > 0.0f ? dt / contactCacheDt : 0.0f;
+		for (SolverContact& contact : solverContacts) {
+			contact.impulse *= warmStartScale;
+			applySolverImpulse(contact, contact.impulse);
+		}
+
+		for (int iteration = 0; iteration < CONTACT_VELOCITY_ITERATIONS; iteration++) {
+			for (SolverContact& contact : solverContacts) {
+				glm::vec2 otherVelocity = contact.b >= 0 ? balls[contact.b].velocity : contact.surfaceVelocity;
+				float normalVelocity = glm::dot(balls[contact.a].velocity - otherVelocity, contact.normal);
+				float impulse = contact.normalMass * (contact.targetVelocity - normalVelocity);
+				// contacts push and never pull, the sum stays positive
+				float total = glm::max(contact.impulse + impulse, 0.0f);
+				applySolverImpulse(contact, total - contact.impulse);
+				contact.impulse = total;
+			}
+		}
+
+		// the normal is kept from when the contact was found, how far the balls moved along it since
+		// says how much overlap is left
+		for (int iteration = 0; iteration < CONTACT_POSITION_ITERATIONS; iteration++) {
+			for (const SolverContact& contact : solverContacts) {
+				glm::vec2 moved = balls[contact.a].position - contact.startA;
+				if (contact.b >= 0) moved -= balls[contact.b].position - contact.startB;
+				float depth = contact.depth - glm::dot(moved, contact.normal);
+				float correction = CONTACT_POSITION_FACTOR * (depth - CONTACT_SLOP);
+				if (correction <= 0.0f) continue;
+
+				float push = correction * contact.normalMass;
+				balls[contact.a].position += contact.normal * (push / balls[contact.a].mass);
+				if (contact.b >= 0) balls[contact.b].position -= contact.normal * (push / balls[contact.b].mass);
+			}
+		}
+
+		nextContactCache.clear();
+		for (const SolverContact& contact : solverContacts) {
+			if (contact.impulse > 0.0f) nextContactCache.push_back({ contact.key, contact.impulse });
+		}
+		std::sort(nextContactCache.begin(), nextContactCache.end(),
+			[](const ContactImpulse& a, const ContactImpulse& b) { return a.key < b.key; });
+		contactCache.swap(nextContactCache);
+		contactCacheDt = dt;
+	}
+
+	struct BroadphaseGrid {
+		glm::vec2 origin;
+		float cellSize;
+		int width, height;
+	};
+
+	// sorts the balls into cells, within a cell in index order
+	BroadphaseGrid buildBroadphaseGrid() {
+		int n = balls.size();
+		BroadphaseGrid grid;
+		glm::vec2 low = glm::vec2(FLT_MAX), high = glm::vec2(-FLT_MAX);
+		float maxRadius = 0.0f;
+		for (const Ball& ball : balls) {
+			// a ball that went NaN or infinite touches nothing, it goes into the first cell
+			if (!std::isfinite(ball.position.x) || !std::isfinite(ball.position.y)) continue;
+			low = glm::min(low, ball.position);
+			high = glm::max(high, ball.position);
+			maxRadius = glm::max(maxRadius, ball.radius);
+		}
+		if (low.x > high.x) low = high = glm::vec2(0.0f);
+
+		grid.origin = low;
+		grid.cellSize = glm::max(maxRadius * 2.0f, 0.0001f);
+		glm::vec2 extent = high - low;
+		double cells = ((double)extent.x / grid.cellSize + 1.0) * ((double)extent.y / grid.cellSize + 1.0);
+		double maxCells = (double)n * BROADPHASE_CELLS_PER_BALL;
+		if (cells > maxCells) grid.cellSize *= (float)std::sqrt(cells / maxCells) * 1.01f;
+		grid.width = (int)(extent.x / grid.cellSize) + 1;
+		grid.height = (int)(extent.y / grid.cellSize) + 1;
+
+		int cellCount = grid.width * grid.height;
+		gridCellStart.assign(cellCount + 1, 0);
+		ballCells.resize(n);
+		for (int i = 0; i < n; i++) {
+			glm::vec2 p = balls[i].position;
+			int cell = 0;
+			if (std::isfinite(p.x) && std::isfinite(p.y)) {
+				int x = glm::min((int)((p.x - grid.origin.x) / grid.cellSize), grid.width - 1);
+				int y = glm::min((int)((p.y - grid.origin.y) / grid.cellSize), grid.height - 1);
+				cell = y * grid.width + x;
+			}
+			ballCells[i] = cell;
+			gridCellStart[cell + 1]++;
+		}
+		for (int cell = 0; cell < cellCount; cell++) {
+			gridCellStart[cell + 1] += gridCellStart[cell];
+		}
+		gridBalls.resize(n);
+		// the counting sort keeps the index order inside every cell
+		gridCursor.assign(gridCellStart.begin(), gridCellStart.end() - 1);
+		for (int i = 0; i < n; i++) {
+			gridBalls[gridCursor[ballCells[i]]++] = i;
+		}
+		return grid;
+	}
+
+	// candidate pairs come in the same order either way, (i, j) by i then by j, so the grid
+	// changes nothing but the time it takes
+	void collectBallContacts() {
+		int n = balls.size();
+		int bucketCount = (n + BALL_JOB_GRAIN - 1) / BALL_JOB_GRAIN;
+		if ((int)contactBuckets.size() < bucketCount) contactBuckets.resize(bucketCount);
+
+		bool useGrid = n >= BROADPHASE_MIN_BALLS;
+		BroadphaseGrid grid = {};
+		if (useGrid) {
+			grid = buildBroadphaseGrid();
+			if ((int)gridNeighbours.size() < bucketCount) gridNeighbours.resize(bucketCount);
+		}
+
+		auto addIfTouching = [this](std::vector<BallContact>& contacts, int i, int j) {
+			glm::vec2 dir = balls[j].position - balls[i].position;
+			float reach = balls[i].radius + balls[j].radius;
+			if (glm::dot(dir, dir) <= reach * reach) {
+				contacts.push_back({ i, j });
+			}
+		};
+
+		// one bucket per range of first balls, concatenated in order so the contact list does
+		// not depend on how the ranges were scheduled
+		parallelFor(bucketCount, 1, [&](int begin, int end) {
+			for (int bucket = begin; bucket < end; bucket++) {
+				std::vector<BallContact>& contacts = contactBuckets[bucket];
+				contacts.clear();
+				int last = std::min((bucket + 1) * BALL_JOB_GRAIN, n);
+				for (int i = bucket * BALL_JOB_GRAIN; i < last; i++) {
+					if (!useGrid) {
+						for (int j = i + 1; j < n; j++) {
+							addIfTouching(contacts, i, j);
+						}
+						continue;
+					}
+
+					// the 3x3 cells around ball i, later balls only, sorted back into index order
+					std::vector<int>& neighbours = gridNeighbours[bucket];
+					neighbours.clear();
+					int cellX = ballCells[i] % grid.width;
+					int cellY = ballCells[i] / grid.width;
+					for (int y = std::max(cellY - 1, 0); y <= std::min(cellY + 1, grid.height - 1); y++) {
+						for (int x = std::max(cellX - 1, 0); x <= std::min(cellX + 1, grid.width - 1); x++) {
+							int cell = y * grid.width + x;
+							for (int k = gridCellStart[cell]; k < gridCellStart[cell + 1]; k++) {
+								if (gridBalls[k] > i) neighbours.push_back(gridBalls[k]);
+							}
+						}
+					}
+					std::sort(neighbours.begin(), neighbours.end());
+					for (int j : neighbours) {
+						addIfTouching(contacts, i, j);
+					}
+				}
+			}
+		});
+
+		ballContacts.clear();
+		for (int bucket = 0; bucket < bucketCount; bucket++) {
+			ballContacts.insert(ballContacts.end(), contactBuckets[bucket].begin(), contactBuckets[bucket].end());
+		}
+	}
+
+	void colorBallContacts() {
+		// greedy coloring: every contact takes the lowest color free on both of its balls.
+		// contacts that find no free color land in the extra last color, which runs serially
+		std::vector<uint64_t> usedColors(balls.size(), 0);
+		std::vector<int> contactColors(ballContacts.size());
+		contactColorStart.assign(MAX_CONTACT_COLORS + 2, 0);
+		for (size_t i = 0; i < ballContacts.size(); i++) {
+			const BallContact& contact = ballContacts[i];
+			uint64_t freeColors = ~(usedColors[contact.a] | usedColors[contact.b]);
+			int color = MAX_CONTACT_COLORS;
+			for (int c = 0; c < MAX_CONTACT_COLORS; c++) {
+				if (freeColors & (1ull << c)) {
+					color = c;
+					usedColors[contact.a] |= 1ull << c;
+					usedColors[contact.b] |= 1ull << c;
+					break;
+				}
+			}
+			contactColors[i] = color;
+			contactColorStart[color + 1]++;
+		}
+
+		for (int c = 0; c <= MAX_CONTACT_COLORS; c++) {
+			contactColorStart[c + 1] += contactColorStart[c];
+		}
+		std::vector<int> cursor(contactColorStart.begin(), contactColorStart.end() - 1);
+		coloredContacts.resize(ballContacts.size());
+		for (size_t i = 0; i < ballContacts.size(); i++) {
+			coloredContacts[cursor[contactColors[i]]++] = ballContacts[i];
+		}
+	}
+
+	void solveColoredContacts() {
+		colorBallContacts();
+		for (int color = 0; color < MAX_CONTACT_COLORS; color++) {
+			int first = contactColorStart[color];
+			int count = contactColorStart[color + 1] - first;
+			parallelFor(count, BALL_JOB_GRAIN, [this, first](int begin, int end) {
+				for (int i = first + begin; i < first + end; i++) {
+					handleCollision(balls[coloredContacts[i].a], balls[coloredContacts[i].b]);
+				}
+			});
+		}
+
+		for (int i = contactColorStart[MAX_CONTACT_COLORS]; i < contactColorStart[MAX_CONTACT_COLORS + 1]; i++) {
+			handleCollision(balls[coloredContacts[i].a], balls[coloredContacts[i].b]);
+		}
+	}
+
+	void solveJacobiContacts() {
+		// contacts of every ball, so each ball gathers its own corrections without sharing writes
+		int n = balls.size();
+		ballContactStart.assign(n + 1, 0);
+		for (const BallContact& contact : ballContacts) {
+			ballContactStart[contact.a + 1]++;
+			ballContactStart[contact.b + 1]++;
+		}
+		for (int i = 0; i < n; i++) {
+			ballContactStart[i + 1] += ballContactStart[i];
+		}
+		std::vector<int> cursor(ballContactStart.begin(), ballContactStart.end() - 1);
+		ballContactList.resize(ballContacts.size() * 2);
+		for (const BallContact& contact : ballContacts) {
+			ballContactList[cursor[contact.a]++] = contact.b;
+			ballContactList[cursor[contact.b]++] = contact.a;
+		}
+
+		ballCorrections.resize(n);
+		parallelFor(n, BALL_JOB_GRAIN, [this](int begin, int end) {
+			for (int i = begin; i < end; i++) {
+				BallCorrection total = { glm::vec2(0.0f), glm::vec2(0.0f) };
+				int touching = 0;
+				for (int k = ballContactStart[i]; k < ballContactStart[i + 1]; k++) {
+					BallCorrection correction;
+					if (getBallCollisionResponse(balls[i], balls[ballContactList[k]], correction)) {
+						total.position += correction.position;
+						total.velocity += correction.velocity;
+						touching++;
+					}
+				}
+				if (touching > 1) {
+					total.position /= (float)touching;
+					total.velocity /= (float)touching;
+				}
+				ballCorrections[i] = total;
+			}
+		});
+
+		parallelFor(n, BALL_JOB_GRAIN, [this](int begin, int end) {
+			for (int i = begin; i < end; i++) {
+				balls[i].position += ballCorrections[i].position;
+				balls[i].velocity += ballCorrections[i].velocity;
+			}
+		});
+	}
+
+	void handleBallContacts() {
+		collectBallContacts();
+		if (ballContacts.empty()) return;
+
+		if ((int)ballContacts.size() > JACOBI_CONTACT_THRESHOLD) {
+			solveJacobiContacts();
+		}
+		else {
+			solveColoredContacts();
+		}
+	}
+
+	void updateGame(float dt) {
+		if (gameState == GAME_OVER) {
+			overlay = glm::vec3(0.5f);
+			return;
+		}
+		stats.survivalTime += dt;
+
+		updateEnemies(dt);
+		handleCombos(dt);
+		handleBallSpawn();
+		handleObjectDeletion();
+		handleEnemySpawn(dt);
+		handleUpdateSpawnParameters(dt);
+		handleScore(dt);
+		handleShake(dt);
+		stats.score = score;
+	}
+
+	void updateEnemies(float dt) {
+		// movement and animation ticks first, the interactions below change shared state
+		parallelFor(enemies.size(), ENEMY_JOB_GRAIN, [this, dt](int begin, int end) {
+			for (int i = begin; i < end; i++) {
+				enemies[i].update(dt);
+			}
+		});
+
+		for (Enemy& enemy : enemies) {
+			if (enemy.isDead) continue;
+
+			if (enemy.position.y + enemy.radius < lowestFlipperY) {
+				gameState = GAME_OVER;
+				break;
+			}
+
+			for (Ball& ball : balls) {
+				if (isTouching(enemy, ball)) {
+					glm::vec2 enemyToBall = ball.position - enemy.position;
+					enemyToBall = glm::normalize(enemyToBall);
+					ball.velocity = enemyToBall * (enemy.speedAbsorption * glm::length(ball.velocity));
+					enemy.setToDead();
+					stats.enemiesKilled++;
+					comboTimer = COMBO_WINDOW;
+					incrementCombo();
+					score += comboCounter > 1 ? SCORE_PER_ENEMY * COMBO_SCORE_MULTIPLIER : SCORE_PER_ENEMY;
+					break;
+				}
+			}
+
+			handleCollision(enemy, table);
+		}
+	}
+
+	void handleCombos(float dt) {
+		if (comboTimer > 0.0f) {
+			comboTimer -= dt;
+
+			if (comboTimer <= 0.0f) {
+				comboTimer = 0.0f;
+				comboCounter = 0;
+			}
+		}
+
+		if (comboCounter >= COMBO_TO_SPAWN_BALL) {
+			comboCounter = 0;
+			spawnBall();
+		}
+	}
+
+	void handleBallSpawn() {
+		if (numOfBallsToSpawn <= 0) return;
+
+		// one batched draw for the whole wave, same numbers as drawing per ball
+		spawnRolls.resize(numOfBallsToSpawn);
+		random.fillFloats(spawnRolls.data(), spawnRolls.size());
+		for (float roll : spawnRolls) {
+			Ball ball = createBall();
+			ball.position = roll > 0.5f ? spawnPosRight : spawnPosLeft;
+			balls.push_back(ball);
+			stats.ballsSpawned++;
+		}
+		numOfBallsToSpawn = 0;
+	}
+
+	void handleObjectDeletion() {
+		for (std::vector<Ball>::iterator itr = balls.end(); itr != balls.begin();) {
+			--itr;
+
+			Ball& ball = *itr;
+			if (ball.position.y < ballDespawnHeight) {
+				itr = balls.erase(itr);
+			}
+		}
+		if (balls.empty()) {
+			gameState = GAME_OVER;
+		}
+
+		for (std::vector<Enemy>::iterator itr = enemies.end(); itr != enemies.begin();) {
+			--itr;
+
+			Enemy& enemy = *itr;
+			if (enemy.canRemove) {
+				itr = enemies.erase(itr);
+			}
+		}
+	}
+
+	void spawnBall() {
+		numOfBallsToSpawn++;
+	}
+
+	Ball createBall() {
+		Ball ball;
+		ball.radius = table.tuning.ballRadius;
+		ball.mass = Utils::PI * ball.radius * ball.radius;
+		ball.id = nextBallId++;
+		return ball;
+	}
+
+	void spawnEnemy() {
+		float xMax = spawnPosRight.x;
+		float xMin = spawnPosLeft.x;
+		float y = spawnPosLeft.y;
+		float x = randFloat() * glm::abs(xMax - xMin) + xMin;
+		glm::vec2 spawnPos = glm::vec2(x, y);
+		float velX = randFloat() * 2.0f * enemyMaxHorizontalSpeed - enemyMaxHorizontalSpeed;
+		float velY = -enemyDescendSpeed;
+		glm::vec2 velocity = glm::vec2(velX, velY);
+		bool facingRight = spawnPos.x >= (xMax + xMin) / 2.0f;
+		enemies.push_back(Enemy(spawnPos, 7.5f, 0.25f, facingRight, velocity));
+		stats.enemiesSpawned++;
+	}
+
+	void handleEnemySpawn(float dt) {
+		enemySpawnTimer -= dt;
+
+		if (enemySpawnTimer <= 0.0f) {
+			enemySpawnTimer = enemySpawnInterval;
+			spawnEnemy();
+		}
+	}
+
+	void handleUpdateSpawnParameters(float dt) {
+		parameterTimer -= dt;
+		if (parameterTimer <= 0.0f) {
+			parameterTimer = difficulty.timePerParametersUpdate;
+			enemySpawnInterval *= difficulty.enemySpawnIntervalDecreaseRateMultiplier;
+			enemyDescendSpeed *= difficulty.enemySpeedIncreaseRateMultiplier;
+			enemyMaxHorizontalSpeed *= difficulty.enemySpeedIncreaseRateMultiplier;
+		}
+	}
+
+	void handleScore(float dt) {
+		scoreIntervalTimer -= dt;
+		if (scoreIntervalTimer <= 0.0f) {
+			scoreIntervalTimer = TIME_PER_SCORING_INTERVAL;
+			score += SCORE_PER_SCORING_INTERVAL;
+		}
+	}
+
+	void incrementCombo() {
+		comboCounter++;
+
+		if (comboCounter >= COMBO_TO_SHAKE) {
+			startShake();
+		}
+	}
+
+	void startShake() {
+		shakeTimer = SHAKE_DURATION;
+	}
+
+	void handleShake(float dt) {
+		if (shakeTimer <= 0.0f) return;
+		cameraShake = glm::vec3(
+			effectsRandom.nextFloat(-1.0f, 1.0f),
+			effectsRandom.nextFloat(-1.0f, 1.0f),
+			0.0f
+		);
+		shakeTimer -= dt;
+		if (shakeTimer <= 0.0f) {
+			shakeTimer = 0.0f;
+			endShake();
+		}
+	}
+
+	void endShake() {
+		cameraShake = glm::vec3(0.0f);
+	}
+};
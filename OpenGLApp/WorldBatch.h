@@ -0,0 +1,178 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <vector>
+
+#include "JobSystem.h"
+#include "LockstepWorlds.h"
+#include "World.h"
+
+// headless monte carlo runs: many independent worlds, one job each, played by World::autoplay
+// until game over or maxTime. world i uses seed firstSeed + i and the difficulty variant i % count
+struct BatchSettings {
+	int worldCount;
+	uint32_t firstSeed;
+	float dt;
+	float maxTime;
+	std::vector<DifficultySettings> difficulties;
+	BatchSettings() : worldCount(1000), firstSeed(1), dt(1.0f / 60.0f), maxTime(600.0f), difficulties(1) {}
+};
+
+struct BatchResult {
+	int variant;
+	bool timedOut;
+	WorldStats stats;
+};
+
+struct Distribution {
+	float min, max, mean;
+	float p10, median, p90;
+};
+
+namespace WorldBatch {
+	inline std::vector<BatchResult> run(JobSystem& jobs, const BatchSettings& settings) {
+		std::vector<BatchResult> results(settings.worldCount);
+		int variantCount = std::max((int)settings.difficulties.size(), 1);
+		jobs.parallelFor(settings.worldCount, 1, [&](int begin, int end) {
+			for (int i = begin; i < end; i++) {
+				int variant = i % variantCount;
+				DifficultySettings difficulty = settings.difficulties.empty() ? DifficultySettings() : settings.difficulties[variant];
+				World world(settings.firstSeed + i, difficulty);
+				float time = 0.0f;
+				while (world.gameState == RUNNING && time < settings.maxTime) {
+					world.autoplay();
+					world.step(settings.dt);
+					time += settings.dt;
+				}
+				results[i].variant = variant;
+				results[i].timedOut = world.gameState == RUNNING;
+				results[i].stats = world.stats;
+			}
+		});
+		return results;
+	}
+
+	// physics only episodes on LockstepWorlds, a lane picks up the next episode as soon as its
+	// balls drained or maxTime passed. returns the drain time of every episode
+	template <int LANES>
+	inline std::vector<float> runLockstep(JobSystem& jobs, const BatchSettings& settings) {
+		const int EPISODES_PER_JOB = LANES * 32;
+		std::vector<float> drainTimes(settings.worldCount, 0.0f);
+		int jobCount = (settings.worldCount + EPISODES_PER_JOB - 1) / EPISODES_PER_JOB;
+		jobs.parallelFor(jobCount, 1, [&](int begin, int end) {
+			for (int job = begin; job < end; job++) {
+				int next = job * EPISODES_PER_JOB;
+				int last = std::min(next + EPISODES_PER_JOB, settings.worldCount);
+				LockstepWorlds<LANES> worlds(Table::getDefault().tuning.initialBalls);
+				int laneEpisodes[LANES];
+				int running = 0;
+				for (int lane = 0; lane < LANES; lane++) {
+					if (next < last) {
+						worlds.resetLane(lane, settings.firstSeed + next);
+						laneEpisodes[lane] = next++;
+						running++;
+					}
+					else {
+						worlds.deactivateLane(lane);
+						laneEpisodes[lane] = -1;
+					}
+				}
+
+				while (running > 0) {
+					worlds.autoplay();
+					worlds.step(settings.dt);
+					for (int lane = 0; lane < LANES; lane++) {
+						if (laneEpisodes[lane] < 0) continue;
+						if (worlds.isLaneRunning(lane) && worlds.time[lane] < settings.maxTime) continue;
+
+						drainTimes[laneEpisodes[lane]] = worlds.time[lane];
+						if (next < last) {
+							worlds.resetLane(lane, settings.firstSeed + next);
+							laneEpisodes[lane] = next++;
+						}
+						else {
+							worlds.deactivateLane(lane);
+							laneEpisodes[lane] = -1;
+							running--;
+						}
+					}
+				}
+			}
+		});
+		return drainTimes;
+	}
+
+	inline Distribution summarize(std::vector<float> values) {
+		Distribution distribution = {};
+		if (values.empty()) return distribution;
+
+		std::sort(values.begin(), values.end());
+		double sum = 0.0;
+		for (float value : values) sum += value;
+		size_t last = values.size() - 1;
+		distribution.min = values.front();
+		distribution.max = values.back();
+		distribution.mean = (float)(sum / values.size());
+		distribution.p10 = values[last / 10];
+		distribution.median = values[last / 2];
+		distribution.p90 = values[last - last / 10];
+		return distribution;
+	}
+
+	inline void printDistribution(const char* name, const Distribution& distribution) {
+		printf("  %-16s min %9.1f  p10 %9.1f  median %9.1f  mean %9.1f  p90 %9.1f  max %9.1f\n", name,
+			distribution.min, distribution.p10, distribution.median, distribution.mean, distribution.p90, distribution.max);
+	}
+
+	inline void printReport(const BatchSettings& settings, const std::vector<BatchResult>& results) {
+		int variantCount = std::max((int)settings.difficulties.size(), 1);
+		for (int variant = 0; variant < variantCount; variant++) {
+			std::vector<float> survivalTimes, scores, ballsSpawned, enemiesKilled;
+			int timedOut = 0;
+			for (const BatchResult& result : results) {
+				if (result.variant != variant) continue;
+				survivalTimes.push_back(result.stats.survivalTime);
+				scores.push_back((float)result.stats.score);
+				ballsSpawned.push_back((float)result.stats.ballsSpawned);
+				enemiesKilled.push_back((float)result.stats.enemiesKilled);
+				if (result.timedOut) timedOut++;
+			}
+
+			printf("difficulty %d: %d worlds, %d still running after %.0fs\n", variant, (int)survivalTimes.size(), timedOut, settings.maxTime);
+			printDistribution("survival time", summarize(survivalTimes));
+			printDistribution("score", summarize(scores));
+			printDistribution("balls spawned", summarize(ballsSpawned));
+			printDistribution("enemies killed", summarize(enemiesKilled));
+		}
+	}
+
+	// entry point for --batch-lockstep
+	inline void runLockstepAndReport(JobSystem& jobs, const BatchSettings& settings) {
+		printf("running %d episodes, %d worlds per lane group, on %u threads\n", settings.worldCount, LOCKSTEP_LANES, jobs.getThreadCount());
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		std::vector<float> drainTimes = runLockstep<LOCKSTEP_LANES>(jobs, settings);
+		std::chrono::duration<float> elapsed = std::chrono::steady_clock::now() - start;
+		printDistribution("drain time", summarize(drainTimes));
+		// drained episodes that ended at the same time almost certainly played out the same
+		std::vector<float> drained;
+		for (float drainTime : drainTimes) {
+			if (drainTime < settings.maxTime) drained.push_back(drainTime);
+		}
+		std::sort(drained.begin(), drained.end());
+		int distinct = (int)(std::unique(drained.begin(), drained.end()) - drained.begin());
+		printf("  %d drained with %d distinct drain times, %d still running after %.0fs\n", (int)drained.size(), distinct,
+			settings.worldCount - (int)drained.size(), settings.maxTime);
+		printf("finished in %.2fs\n", elapsed.count());
+	}
+
+	// entry point for --batch, prints the report and the wall time
+	inline void runAndReport(JobSystem& jobs, const BatchSettings& settings) {
+		printf("running %d worlds on %u threads\n", settings.worldCount, jobs.getThreadCount());
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		std::vector<BatchResult> results = run(jobs, settings);
+		std::chrono::duration<float> elapsed = std::chrono::steady_clock::now() - start;
+		printReport(settings, results);
+		printf("finished in %.2fs\n", elapsed.count());
+	}
+}
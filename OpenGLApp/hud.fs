@@ -0,0 +1,11 @@
+#version 330 core
+in vec2 TexCoords;
+in vec4 Tint;
+out vec4 Color;
+
+uniform sampler2D sprite;
+
+void main()
+{
+    Color = Tint * texture(sprite, TexCoords);
+}
\ No newline at end of file
@@ -0,0 +1,15 @@
+#version 330 core
+layout (location = 0) in vec4 vertex; // <vec2 position, vec2 texCoords>
+layout (location = 1) in vec4 vertexColor;
+
+out vec2 TexCoords;
+out vec4 Tint;
+
+uniform mat4 projection;
+
+void main()
+{
+    TexCoords = vertex.zw;
+    Tint = vertexColor;
+    gl_Position = projection * vec4(vertex.xy, 0.0, 1.0);
+}
\ No newline at end of file
@@ -6,16 +6,71 @@
 #include <filesystem.h>
 
 #include "Utils.h"
+#include "Profiler.h"
+#include "AssetPack.h"
+#include "AssetLoader.h"
+#include "ShaderCache.h"
+#include "TripleBuffer.h"
+#include "JobSystem.h"
+#include "Table.h"
+#include "World.h"
+#include "WorldBatch.h"
+#include "Determinism.h"
+#include "FixedPointBench.h"
+#include "IntegratorBench.h"
+#include "ContactBench.h"
+#include "Replay.h"
+#include "RewindHistory.h"
+#include "FlightRecorder.h"
+#include "FileWatcher.h"
+#include "Geometry.h"
 
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 
+#include <algorithm>
+#include <atomic>
+#include <cstring>
 #include <iostream>
 #include <limits>
+#include <mutex>
 #include <thread>
 #include <map>
 #include <vector>
 
+// assets
+// ignore assets.pack and always read loose files, handy while editing resources
+//#define LOOSE_ASSETS
+const char* ASSET_PACK_PATH = "assets.pack";
+// the table to play, compiled with --build-table. without an up to date binary the source is parsed
+const char* TABLE_SOURCE_PATH = "resources/tables/default.table";
+const char* TABLE_BINARY_PATH = "tables/default.ptbl";
+enum ShaderAsset {
+	SHADER_CIRCLE = 0,
+	SHADER_SQUARE,
+	SHADER_TEXTURE,
+	SHADER_ANIMATION,
+	SHADER_HUD,
+	SHADER_COUNT
+};
+
+struct ShaderSource {
+	const char* vertexPath;
+	const char* fragmentPath;
+};
+
+const ShaderSource SHADER_SOURCES[SHADER_COUNT] = {
+	{ "circle.vs", "circle.fs" },
+	{ "square.vs", "square.fs" },
+	{ "texture.vs", "texture.fs" },
+	{ "animation.vs", "animation.fs" },
+	{ "hud.vs", "hud.fs" }
+};
+AssetPack assetPack;
+std::vector<Shader> loadShaders();
+bool buildAssetPack();
+void skipStaleAssets();
+
 void frameBufferSizeCallback(GLFWwindow* window, int width, int height);
 void mouseButtonCallback(GLFWwindow* window, int button, int action, int mods);
 void processInput(GLFWwindow* window);
@@ -35,20 +90,10 @@ void toggleFullscreen(GLFWwindow* window);
 
 // vertex data
 GLuint circleVAO, circleVBO, circleEBO;
-const unsigned int CIRCLE_VERTS_NUM = 362;
-float circleVerts[CIRCLE_VERTS_NUM * 3];
-unsigned int circleIndices[CIRCLE_VERTS_NUM];
-float* initCircleVertexData();
-unsigned int* initCircleIndicesData();
 void initCircleData();
 
 GLuint squareVAO, squareVBO, squareEBO;
 GLuint squareOutlineVAO, squareOutlineVBO, squareOutlineEBO;
-float squareVerts[4 * 3];
-unsigned int squareIndices[6];
-unsigned int outlineIndices[5];
-float* initSquareVertexData();
-unsigned int* initSquareIndicesData();
 void initSquareData();
 
 void initGLData();
@@ -59,98 +104,26 @@ const float WORLD_HEIGHT = 127.5f;
 const float FIX_DT = 1.0f / 60.0f;
 float deltaTime = 0.0f;
 float lastTime  = 0.0f;
-const glm::vec2 GRAVITY = glm::vec2(0.0f, -9.81) * 10.0f;
-const float RESTITUTION = 0.2f;
-const float FLIPPER_HEIGHT = 1.7f;
-const float BORDER_SIZE = 2.5f;
-
-struct Circle {
-	glm::vec2 position;
-	float radius;
-	Circle(glm::vec2 position, float radius): position(position), radius(radius) {}
-};
-
-struct Ball : Circle {
-	glm::vec2 velocity;
-	float mass;
-	Ball(): Circle(glm::vec2(), 0.5f), velocity(), mass(1.0f) {}
-	void update(float dt) {
-		velocity += GRAVITY * dt;
-		position += velocity * dt;
-	}
-};
-
-struct Obstacle : Circle {
-	float pushAmount;
-	Obstacle(): Circle(glm::vec2(), 0.5f), pushAmount(2.0f) {}
-	Obstacle(glm::vec2 position, float radius, float pushAmount = 5.0f): Circle(position, radius), pushAmount(pushAmount) {}
-};
-
-struct Flipper {
-	int id;
-
-	glm::vec2 position;
-	float radius;
-	float length;
-	float restAngle;
-	float maxRotation;
-	bool isSignPositive;
-	float angularVelocity;
-	float restitution;
-
-	float currentRotation;
-	float currentAngularVelocity;
-	bool isFlipped;
-
-	Flipper(glm::vec2 position, float radius, float length, float restAngle, float maxRotation, float angularVelocity, float restitution, bool positiveSign = true) :
-		id(-1),
-		position(position), radius(radius), length(length), restAngle(restAngle), maxRotation(maxRotation), isSignPositive(positiveSign),
-		angularVelocity(angularVelocity), restitution(restitution),
-		currentRotation(0.0f), currentAngularVelocity(0.0f), isFlipped(false) {}
-
-	void update(float dt) {
-		float prevRotation = currentRotation;
-		if (isFlipped) currentRotation = glm::min(currentRotation + angularVelocity * dt, maxRotation);
-		else currentRotation = glm::max(currentRotation - angularVelocity * dt, 0.0f);
-		currentAngularVelocity = (isSignPositive ? 1.0f : -1.0f) * (currentRotation - prevRotation) / dt;
-	}
-
-	glm::vec2 getFlipperEnd() const {
-		float angle = restAngle + (isSignPositive ? 1.0f : -1.0f) * currentRotation;
-		glm::vec2 dir = glm::vec2(glm::cos(angle), glm::sin(angle));
-		return position + dir * length;
-	}
-};
-
-enum FlipperMouseControlId {
-	LEFT = 0,
-	RIGHT
-};
-
-std::vector<glm::vec2> borderPoints;
-std::vector<Ball> balls;
-std::vector<Obstacle> obstacles;
-std::vector<Flipper> flippers;
-
-void resetScene();
-void handleBallCollision(Ball& b1, Ball& b2, float restitution);
-void handleBallObstacleCollision(Ball& ball, Obstacle& obstacle);
-void handleBallFlipperCollision(Ball& ball, Flipper& flipper);
-void handleBallBorderCollision(Ball& ball, std::vector<glm::vec2>& borderPoints);
-void updateSimulation(float dt);
 
 // rendering
 void drawCircle(Shader& shader, glm::vec3 position, float radius, glm::vec3 color);
 void drawSquareLine(Shader& shader, glm::vec3 startPos, glm::vec3 endPos, float radius, glm::vec3 color);
-void renderBalls(Shader& shader);
-void renderObstacles(Shader& shader);
-void renderFlippers(Shader& shader);
-void renderBorder(Shader& shader);
-void renderBackground(float dt);
+struct RenderSnapshot;
+void renderBalls(Shader& shader, const RenderSnapshot& snapshot);
+void renderObstacles(Shader& shader, const RenderSnapshot& snapshot);
+void renderFlippers(Shader& shader, const RenderSnapshot& snapshot);
+void renderBorder(Shader& shader, const RenderSnapshot& snapshot);
+void renderBackground(float dt, const RenderSnapshot& snapshot);
+struct EnemyView;
+void renderEnemy(const EnemyView& enemy, Shader* debugShader);
+void renderEnemies(const RenderSnapshot& snapshot, Shader* debugShader);
 glm::vec3 viewPos = glm::vec3(0.0f);
 
 // debugging
 //#define DRAW_DEBUG
+PerfCounters perfCounters;
+FrameProfiler frameProfiler;
+bool showPerfHud = false;
 void drawSquareOutline(Shader& shader, glm::vec3 startPos, glm::vec3 endPos, float radius);
 void drawCircleOutline(Shader& shader, glm::vec3 position, float radius);
 
@@ -169,7 +142,7 @@ struct Texture {
 		glGenTextures(1, &this->id);
 	}
 
-	void generate(unsigned int width, unsigned int height, unsigned char* data) {
+	void generate(unsigned int width, unsigned int height, const unsigned char* data) {
 		this->width = width;
 		this->height = height;
 		// create Texture
@@ -185,8 +158,23 @@ struct Texture {
 		glBindTexture(GL_TEXTURE_2D, 0);
 	}
 
+	// uploads a preprocessed S3TC block stream from the texture cache
+	void generateCompressed(unsigned int width, unsigned int height, unsigned int format, const unsigned char* data, unsigned int size) {
+		this->width = width;
+		this->height = height;
+		this->internalFormat = format;
+		glBindTexture(GL_TEXTURE_2D, id);
+		glCompressedTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, size, data);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, wrapS);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, wrapT);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filterMin);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filterMax);
+		glBindTexture(GL_TEXTURE_2D, 0);
+	}
+
 	void bind() {
 		glBindTexture(GL_TEXTURE_2D, id);
+		perfCounters.textureBinds++;
 	}
 };
 
@@ -239,27 +227,17 @@ struct Sprite {
 
 		glBindVertexArray(this->quadVAO);
 		glDrawArrays(GL_TRIANGLES, 0, 6);
+		perfCounters.drawCalls++;
 		glBindVertexArray(0);
 	}
 
 	void initRenderData() {
 		unsigned int vbo;
-		float vertices[] = {
-			// pos      // tex
-			0.0f, 1.0f, 0.0f, 1.0f,
-			1.0f, 0.0f, 1.0f, 0.0f,
-			0.0f, 0.0f, 0.0f, 0.0f,
-
-			0.0f, 1.0f, 0.0f, 1.0f,
-			1.0f, 1.0f, 1.0f, 1.0f,
-			1.0f, 0.0f, 1.0f, 0.0f
-		};
-
 		glGenVertexArrays(1, &this->quadVAO);
 		glGenBuffers(1, &vbo);
 
 		glBindBuffer(GL_ARRAY_BUFFER, vbo);
-		glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+		glBufferData(GL_ARRAY_BUFFER, sizeof(Geometry::QUAD_VERTICES), Geometry::QUAD_VERTICES.data(), GL_STATIC_DRAW);
 
 		glBindVertexArray(this->quadVAO);
 		glEnableVertexAttribArray(0);
@@ -308,6 +286,7 @@ struct SquareLineSprite : Sprite {
 
 		glBindVertexArray(this->quadVAO);
 		glDrawArrays(GL_TRIANGLES, 0, 6);
+		perfCounters.drawCalls++;
 		glBindVertexArray(0);
 	}
 };
@@ -361,6 +340,7 @@ struct AnimatedSprite {
 
 		glBindVertexArray(sprite->quadVAO);
 		glDrawArrays(GL_TRIANGLES, 0, 6);
+		perfCounters.drawCalls++;
 		glBindVertexArray(0);
 	}
 
@@ -385,144 +365,238 @@ struct AnimatedSprite {
 	}
 };
 
-Texture loadTextureFromFile(const char* filename, bool hasAlpha);
-void drawTexturedSquareLine(Sprite* sprite, glm::vec3 startPos, glm::vec3 endPos, float radius);
+// collects screen space quads and draws them with one draw call per texture. quads are sorted
+// by texture on flush, so they must not rely on being drawn in the order they were added.
+// used by the perf hud so drawing the counters does not inflate them
+struct SpriteBatch {
+	static const int FLOATS_PER_VERTEX = 8;
+	static const int FLOATS_PER_QUAD = FLOATS_PER_VERTEX * 6;
+	struct DrawRange {
+		GLuint texture;
+		int first;
+		int count;
+	};
 
-// game
-enum GameState {
-	RUNNING,
-	GAME_OVER
-};
+	Shader* shader;
+	GLuint vao, vbo;
+	std::vector<float> vertices;
+	// the texture of every quad in vertices
+	std::vector<GLuint> quadTextures;
+	std::vector<int> order;
+	std::vector<float> sorted;
+	std::vector<DrawRange> ranges;
+	unsigned int drawCalls;
+
+	SpriteBatch(Shader& shader) : shader(&shader), vao(0), vbo(0), drawCalls(0) {
+		glGenVertexArrays(1, &vao);
+		glGenBuffers(1, &vbo);
 
-struct Enemy : Circle {
-	enum Status {
-		ALIVE,
-		DEAD
-	};
+		glBindVertexArray(vao);
+		glBindBuffer(GL_ARRAY_BUFFER, vbo);
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, FLOATS_PER_VERTEX * sizeof(float), (void*)0);
+		glEnableVertexAttribArray(1);
+		glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, FLOATS_PER_VERTEX * sizeof(float), (void*)(4 * sizeof(float)));
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		glBindVertexArray(0);
+	}
 
-	float speedAbsorption;
-	AnimatedSprite flyingSprite;
-	AnimatedSprite dyingSprite;
-	bool isDead;
-	bool isFacingRight;
-	glm::vec2 velocity;
-	Status status;
-	bool canRemove;
-
-	Enemy(glm::vec2 position, float radius, float pushAmount, const AnimatedSprite& flyingSprite, const AnimatedSprite& dyingSprite, bool isFacingRight, glm::vec2 velocity) :
-		Circle(position, radius),
-		speedAbsorption(pushAmount),
-		flyingSprite(flyingSprite), dyingSprite(dyingSprite),
-		isDead(false), isFacingRight(isFacingRight), velocity(velocity), status(ALIVE), canRemove(false) {
-		this->flyingSprite.isFlipped = !isFacingRight;
-		this->dyingSprite.isFlipped = !isFacingRight;
-	}
-
-	Enemy(const Enemy& other): Circle(other.position, other.radius) {
-		this->speedAbsorption = other.speedAbsorption;
-		this->flyingSprite = other.flyingSprite;
-		this->dyingSprite = other.dyingSprite;
-		this->isDead = other.isDead;
-		this->isFacingRight = other.isFacingRight;
-		this->flyingSprite.isFlipped = !this->isFacingRight;
-		this->dyingSprite.isFlipped = !this->isFacingRight;
-		this->velocity = other.velocity;
-		this->status = other.status;
-		this->canRemove = other.canRemove;
+	~SpriteBatch() {
+		glDeleteBuffers(1, &vbo);
+		glDeleteVertexArrays(1, &vao);
 	}
 
-	void update(float dt) {
-		switch (status) {
-			case ALIVE:
-				flyingSprite.update(dt);
-				break;
-			case DEAD:
-				dyingSprite.update(dt);
-				break;
+	void addQuad(GLuint texture, glm::vec2 min, glm::vec2 max, glm::vec4 color) {
+		quadTextures.push_back(texture);
+		const float quad[6][4] = {
+			{ min.x, max.y, 0.0f, 1.0f },
+			{ max.x, min.y, 1.0f, 0.0f },
+			{ min.x, min.y, 0.0f, 0.0f },
+			{ min.x, max.y, 0.0f, 1.0f },
+			{ max.x, max.y, 1.0f, 1.0f },
+			{ max.x, min.y, 1.0f, 0.0f }
+		};
+		for (int i = 0; i < 6; i++) {
+			vertices.insert(vertices.end(), quad[i], quad[i] + 4);
+			vertices.push_back(color.r);
+			vertices.push_back(color.g);
+			vertices.push_back(color.b);
+			vertices.push_back(color.a);
 		}
+	}
 
-		if (isDead) {
-			if (dyingSprite.currentFrame >= dyingSprite.frameCount - 1) {
-				canRemove = true;
+	// position is the center of the quad, same as Sprite::drawSprite
+	void addSprite(GLuint texture, glm::vec2 position, glm::vec2 size, glm::vec4 color) {
+		addQuad(texture, position - 0.5f * size, position + 0.5f * size, color);
+	}
+
+	void flush(const glm::mat4& projection) {
+		drawCalls = 0;
+		if (quadTextures.empty()) return;
+
+		// group the quads by texture, in the order they were added within a texture
+		int quadCount = quadTextures.size();
+		order.resize(quadCount);
+		for (int i = 0; i < quadCount; i++) order[i] = i;
+		std::stable_sort(order.begin(), order.end(), [this](int a, int b) { return quadTextures[a] < quadTextures[b]; });
+		sorted.resize(vertices.size());
+		ranges.clear();
+		for (int i = 0; i < quadCount; i++) {
+			int quad = order[i];
+			memcpy(&sorted[i * FLOATS_PER_QUAD], &vertices[quad * FLOATS_PER_QUAD], FLOATS_PER_QUAD * sizeof(float));
+			if (ranges.empty() || ranges.back().texture != quadTextures[quad]) {
+				ranges.push_back({ quadTextures[quad], i * 6, 0 });
 			}
-			return;
+			ranges.back().count += 6;
 		}
 
+		shader->use();
+		shader->setMat4("projection", projection);
+
+		glBindVertexArray(vao);
+		glBindBuffer(GL_ARRAY_BUFFER, vbo);
+		glBufferData(GL_ARRAY_BUFFER, sorted.size() * sizeof(float), sorted.data(), GL_STREAM_DRAW);
 
-		position += velocity * dt;
+		glActiveTexture(GL_TEXTURE0);
+		for (const DrawRange& range : ranges) {
+			glBindTexture(GL_TEXTURE_2D, range.texture);
+			glDrawArrays(GL_TRIANGLES, range.first, range.count);
+			drawCalls++;
+		}
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		glBindVertexArray(0);
+
+		vertices.clear();
+		quadTextures.clear();
 	}
+};
 
-	void setToDead() {
-		isDead = true;
-		dyingSprite.currentFrame = 0;
-		status = DEAD;
+// the border as one static buffer drawn in a single call, the quads drawTexturedSquareLine would
+// draw one segment at a time, baked by the table compiler
+struct BorderMesh {
+	GLuint vao, vbo;
+	int vertexCount;
+
+	BorderMesh() : vao(0), vbo(0), vertexCount(0) {}
+
+	void upload(const std::vector<TableMeshVertex>& vertices) {
+		if (vao == 0) {
+			glGenVertexArrays(1, &vao);
+			glGenBuffers(1, &vbo);
+			glBindVertexArray(vao);
+			glBindBuffer(GL_ARRAY_BUFFER, vbo);
+			glEnableVertexAttribArray(0);
+			glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(TableMeshVertex), (void*)0);
+			glBindVertexArray(0);
+		}
+		glBindBuffer(GL_ARRAY_BUFFER, vbo);
+		glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(TableMeshVertex), vertices.data(), GL_STATIC_DRAW);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		vertexCount = vertices.size();
 	}
 
-	void draw() {
-		switch (status) {
-			case ALIVE:
-				flyingSprite.drawSprite(glm::vec3(position, 0.0f), glm::vec3(radius * 2.0f), 0.0f, glm::vec3(1.0f));
-				break;
-			case DEAD:
-				dyingSprite.drawSprite(glm::vec3(position, 0.0f), glm::vec3(radius * 2.0f), 0.0f, glm::vec3(1.0f));
-				break;
-			}
+	// uploads only the quads of the segments an edit changed, runs of neighbours in one call
+	void update(const std::vector<TableMeshVertex>& vertices, const TableEdit& edit) {
+		if (edit.isBorderRebuilt || (int)vertices.size() != vertexCount) {
+			upload(vertices);
+			return;
+		}
+		glBindBuffer(GL_ARRAY_BUFFER, vbo);
+		for (size_t i = 0; i < edit.segments.size();) {
+			size_t end = i + 1;
+			while (end < edit.segments.size() && edit.segments[end] == edit.segments[end - 1] + 1) end++;
+			size_t first = edit.segments[i] * 6;
+			size_t count = (end - i) * 6;
+			glBufferSubData(GL_ARRAY_BUFFER, first * sizeof(TableMeshVertex), count * sizeof(TableMeshVertex), &vertices[first]);
+			i = end;
+		}
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
 	}
+
+	// with the sprite's shader and texture, the mesh is in world space and already tiled
+	void draw(Sprite& sprite) {
+		if (vertexCount == 0) return;
+		Shader* shader = sprite.shader;
+		shader->use();
+		glm::mat4 projection = glm::ortho(
+			-(WORLD_WIDTH / 2.0f), (WORLD_WIDTH / 2.0f),
+			-(WORLD_HEIGHT / 2.0f), (WORLD_HEIGHT / 2.0f),
+			-1.0f, 1.0f
+		);
+		shader->setMat4("view", glm::translate(glm::mat4(1.0f), -viewPos));
+		shader->setMat4("model", glm::mat4(1.0f));
+		shader->setMat4("projection", projection);
+		shader->setBool("enableTiling", false);
+		shader->setVec3("color", sprite.overrideOverlay ? glm::vec3(1.0f) : globalOverlay);
+
+		glActiveTexture(GL_TEXTURE0);
+		sprite.texture.bind();
+		glBindVertexArray(vao);
+		glDrawArrays(GL_TRIANGLES, 0, vertexCount);
+		perfCounters.drawCalls++;
+		glBindVertexArray(0);
+	}
+};
+
+BorderMesh borderMesh;
+
+// textures are decoded by the asset loader in this order, so a decoded image handle is its TextureAsset
+enum TextureAsset {
+	TEXTURE_BACKGROUND = 0,
+	TEXTURE_STONE,
+	TEXTURE_PINBALL,
+	TEXTURE_FLIPPER,
+	TEXTURE_SAND,
+	TEXTURE_ENEMY_FLYING,
+	TEXTURE_ENEMY_DYING,
+	TEXTURE_NUMBER0,
+	TEXTURE_NUMBER1,
+	TEXTURE_NUMBER2,
+	TEXTURE_NUMBER3,
+	TEXTURE_NUMBER4,
+	TEXTURE_NUMBER5,
+	TEXTURE_NUMBER6,
+	TEXTURE_NUMBER7,
+	TEXTURE_NUMBER8,
+	TEXTURE_NUMBER9,
+	TEXTURE_GAMEOVER,
+	TEXTURE_TUTORIAL,
+	TEXTURE_COUNT
+};
+
+struct TextureSource {
+	const char* path;
+	bool hasAlpha;
+};
+
+const TextureSource TEXTURE_SOURCES[TEXTURE_COUNT] = {
+	{ "resources/background.png", false },
+	{ "resources/stone.png", true },
+	{ "resources/pinball.png", true },
+	{ "resources/flipper.png", true },
+	{ "resources/sand.png", true },
+	{ "resources/enemy_flying.png", true },
+	{ "resources/enemy_dying.png", true },
+	{ "resources/numbers/number0.png", true },
+	{ "resources/numbers/number1.png", true },
+	{ "resources/numbers/number2.png", true },
+	{ "resources/numbers/number3.png", true },
+	{ "resources/numbers/number4.png", true },
+	{ "resources/numbers/number5.png", true },
+	{ "resources/numbers/number6.png", true },
+	{ "resources/numbers/number7.png", true },
+	{ "resources/numbers/number8.png", true },
+	{ "resources/numbers/number9.png", true },
+	{ "resources/gameover.png", true },
+	{ "resources/tutorial.png", true }
 };
 
-bool checkCircleCollision(Circle& c1, Circle& c2);
-void handleEnemyBorderCollision(Enemy& enemy, std::vector<glm::vec2>& borderPoints);
-void updateGame(float dt);
-void updateEnemies(float dt);
-void handleCombos(float dt);
-void handleBallSpawn();
-void handleObjectDeletion();
-void renderEnemy(Enemy& enemy, Shader* debugShader);
-void renderEnemies(Shader* debugShader);
-void spawnBall();
-Ball createBall();
-void spawnEnemy();
-void handleEnemySpawn(float dt);
-void handleUpdateSpawnParameters(float dt);
-void handleScore(float dt);
-void incrementCombo();
-
-std::vector<Enemy> enemies;
-GameState gameState = RUNNING;
-float lowestFlipperY = FLT_MAX;
-float ballDespawnHeight = FLT_MAX;
-glm::vec2 spawnPosLeft, spawnPosRight;
-int numOfBallsToSpawn = 0;
-const float INITIAL_ENEMY_SPAWN_INTERVAL = 2.0f;
-const float INITIAL_ENEMY_DESCEND_SPEED = 5.0f;
-const float INITIAL_ENEMY_MAX_HORIZONTAL_SPEED = 1.0f;
-const int INITTIAL_BALL_COUNT = 1;
-const int COMBO_TO_SPAWN_BALL = 2;
-const float MINIMUM_ENEMY_SPAWN_INTERVAL = 0.5f;
-const float ENEMY_SPAWN_INTERVAL_DECREASE_RATE_MULTIPLIER = 0.95f;
-const float ENEMY_SPEED_INCREASE_RATE_MULTIPLIER = 1.05f;
-const float TIME_PER_PARAMETERS_UPDATE = 15.0f;
-const float COMBO_WINDOW = 1.0f;
-const int SCORE_PER_SCORING_INTERVAL = 10;
-const int SCORE_PER_ENEMY = 50;
-const float COMBO_SCORE_MULTIPLIER = 1.5f;
-const float TIME_PER_SCORING_INTERVAL = 5.0f;
-int comboCounter = 0;
-float comboTimer = 0.0f;
-float enemySpawnInterval = INITIAL_ENEMY_SPAWN_INTERVAL;
-float enemyDescendSpeed = INITIAL_ENEMY_DESCEND_SPEED;
-float enemyMaxHorizontalSpeed = INITIAL_ENEMY_MAX_HORIZONTAL_SPEED;
-float enemySpawnTimer = 0.0f;
-float parameterTimer = 0.0f;
-float scoreIntervalTimer = 0.0f;
-int score = 0;
-
-void startShake();
-void handleShake(float dt);
-void endShake();
-float shakeTimer = 0.0f;
-const float SHAKE_DURATION = 0.25f;
-const int COMBO_TO_SHAKE = COMBO_TO_SPAWN_BALL;
+// upload decoded textures through a pixel buffer object instead of client memory
+//#define PBO_TEXTURE_UPLOAD
+void requestTextures(AssetLoader& loader);
+std::vector<Texture> uploadTextures(AssetLoader& loader);
+void createTexture(Texture& texture, const DecodedImage& image, GLuint pbo);
+void drawTexturedSquareLine(Sprite* sprite, glm::vec3 startPos, glm::vec3 endPos, float radius);
 
 enum ObjectType {
 	BALL,
@@ -539,7 +613,7 @@ enum AnimatedObject {
 Sprite* objectToSprite[4];
 AnimatedSprite* objectToAnimatedSprite[2];
 AnimatedSprite* backgroundPtr = nullptr;
-const float BORDER_SPRITE_SCALE = 0.1f;
+const float BORDER_SPRITE_SCALE = Table::BORDER_UV_SCALE;
 
 // text object
 std::map<char, Sprite*> charToNumberSprite;
@@ -549,6 +623,15 @@ struct NumberText {
 	bool overrideOverlay;
 	NumberText(): value(0), overrideOverlay(false) {}
 	NumberText(int value): value(value), overrideOverlay(false) {}
+	void drawTextBatched(SpriteBatch& batch, glm::vec3 position, float size, glm::vec4 color = glm::vec4(1.0f)) {
+		std::string strValue = std::to_string(value);
+		glm::vec2 textPos = glm::vec2(position);
+		for (char c : strValue) {
+			batch.addSprite(charToNumberSprite.at(c)->texture.id, textPos, glm::vec2(size), color);
+			textPos.x += DEFAULT_TEXT_GAP * size;
+		}
+	}
+
 	void drawText(glm::vec3 position, float size, float rotation = 0.0f) {
 		std::string strValue = std::to_string(value);
 		int length = strValue.length();
@@ -568,21 +651,230 @@ struct NumberText {
 NumberText scoreText;
 const glm::vec3 SCORE_TEXT_POSITION = glm::vec3(-105.0f, 50.0f, 0.0f);
 const float SCORE_TEXT_SIZE = 10.0f;
-const glm::vec2 WORLD_OFFSET = glm::vec2(25.0f, 0.0f);
-void renderScoreText();
-void offsetEverythingBy(glm::vec2 offset);
+void renderScoreText(const RenderSnapshot& snapshot);
 
 void renderGameOver();
 void renderTutorial();
-void renderText();
+void renderText(const RenderSnapshot& snapshot);
 Sprite* gameoverSpritePtr = nullptr;
 Sprite* tutorialSpritePtr = nullptr;
 
+// perf hud
+void captureFrameCounters(const RenderSnapshot& snapshot);
+void renderPerfHud(const RenderSnapshot& snapshot);
+SpriteBatch* hudBatchPtr = nullptr;
+Texture* whiteTexturePtr = nullptr;
+const glm::vec3 PERF_HUD_POSITION = glm::vec3(-108.0f, 40.0f, 0.0f);
+const float PERF_HUD_TEXT_SIZE = 3.0f;
+const float PERF_HUD_ROW_GAP = 4.0f;
+const glm::vec2 PERF_HUD_GRAPH_POSITION = glm::vec2(-110.0f, -62.0f);
+const float PERF_HUD_GRAPH_BAR_WIDTH = 0.5f;
+const float PERF_HUD_GRAPH_HEIGHT_PER_MS = 1.5f;
+const glm::vec4 PHASE_COLORS[PHASE_COUNT] = {
+	glm::vec4(0.6f, 0.6f, 1.0f, 1.0f),	// input
+	glm::vec4(1.0f, 0.5f, 0.2f, 1.0f),	// simulation
+	glm::vec4(1.0f, 1.0f, 0.3f, 1.0f),	// game
+	glm::vec4(0.3f, 1.0f, 0.4f, 1.0f),	// render
+	glm::vec4(0.3f, 0.6f, 1.0f, 1.0f),	// hud
+	glm::vec4(0.5f, 0.5f, 0.5f, 1.0f)	// swap
+};
+
+// simulation thread
+// steps the simulation on its own thread one frame ahead of rendering,
+// comment out to run both on the main thread
+#define SIMULATION_THREAD
+// fixed FIX_DT steps in a controlled float environment, bit identical for the same seed and
+// inputs (see Determinism.h). prints the rolling state hash once per simulated second
+//#define DETERMINISTIC_SIMULATION
+// also caps the substeps a long frame is split into without it
+const int MAX_FIXED_STEPS_PER_FRAME = 8;
+// frames up to this much longer than FIX_DT still run as one step
+const float SUBSTEP_SLACK = 1.05f;
+const uint64_t FIXED_STEPS_PER_HASH_REPORT = 60;
+float simulationAccumulator = 0.0f;
+// writes every session to replays/, play one back with --replay <file>
+#define RECORD_REPLAY
+ReplayRecorder replayRecorder;
+// keeps the last 10 minutes of play, F6 pauses and scrubs through them with the arrow keys
+#define REWIND_HISTORY
+const int REWIND_FAST_STEPS = 10;
+const glm::vec3 REWIND_OVERLAY = glm::vec3(0.6f, 0.7f, 1.0f);
+RewindHistory rewindHistory(600.0f, FIX_DT);
+// keeps the last 30 s of every step and writes them to flightrecords/ when something looks wrong,
+// print one with --flight-record <file>
+#define FLIGHT_RECORDER
+FlightRecorder flightRecorder;
+// reloads resources/tables/default.table whenever it is saved, balls and enemies play on
+#define TABLE_HOT_RELOAD
+// balls, flippers and the border through the sequential impulse solver (World::useContactSolver),
+// piles of balls settle instead of jittering. recorded in replays
+//#define CONTACT_SOLVER
+FileWatcher tableWatcher;
+// the main thread's copy of the table, the border mesh follows it
+TableDescription renderTable;
+std::mutex tableMutex;
+TableDescription pendingTable;
+bool hasPendingTable = false;
+void reloadTable();
+void applyPendingTable();
+World world;
+
+struct CircleView {
+	glm::vec2 position;
+	float radius;
+};
+
+struct FlipperView {
+	glm::vec2 start;
+	glm::vec2 end;
+	float radius;
+};
+
+struct EnemyView {
+	glm::vec2 position;
+	float radius;
+	Enemy::Status status;
+	unsigned int frame;
+	bool isFacingRight;
+};
+
+// everything the renderer needs from one simulation step, copied out so the
+// render thread never touches the live world. vectors keep their capacity between steps
+struct RenderSnapshot {
+	std::vector<CircleView> balls;
+	std::vector<CircleView> obstacles;
+	std::vector<FlipperView> flippers;
+	#ifdef DRAW_DEBUG
+	// only the debug outlines need the border, the mesh has its own copy
+	std::vector<glm::vec2> borderPoints;
+	#endif
+	std::vector<EnemyView> enemies;
+	GameState gameState;
+	int score;
+	glm::vec3 viewPos;
+	glm::vec3 overlay;
+	float simulationTime;
+	float gameTime;
+	RenderSnapshot() : gameState(RUNNING), score(0), viewPos(0.0f), overlay(1.0f), simulationTime(0.0f), gameTime(0.0f) {}
+};
+
+TripleBuffer<RenderSnapshot> renderSnapshots;
+std::mutex commandMutex;
+std::vector<SimulationCommand> pendingCommands;
+std::vector<SimulationCommand> executingCommands;
+std::atomic<uint64_t> simulationTicks(0);
+std::atomic<float> pendingSimulationTime(0.0f);
+std::atomic<bool> simulationRunning(false);
+std::atomic<bool> rewindRequested(false);
+std::atomic<int> rewindScrubSteps(0);
+void queueCommand(SimulationCommand command);
+bool applyCommands();
+bool updateRewind();
+void runSimulationStep(float dt);
+void stepWorld(float dt, float& simulationTime, float& gameTime);
+void writeRenderSnapshot(RenderSnapshot& snapshot);
+void requestSimulationStep(float dt);
+void simulationThreadLoop();
+
+// jobs
+// run every job inline in submission order, for reproducible runs and debugging
+//#define DETERMINISTIC_JOBS
+JobSystem jobSystem;
+const int SNAPSHOT_JOB_GRAIN = 64;
+
 // controls
 std::map<unsigned, bool> keyDownMap;
 bool getKeyDown(GLFWwindow* window, unsigned int key);
 
-int main() {
+int main(int argc, char** argv) {
+	stbi_set_flip_vertically_on_load(true);
+	TextureCache::cacheDirectory = FileSystem::getPath("cache/textures");
+
+	// tools
+	if (argc > 1 && strcmp(argv[1], "--build-pack") == 0) {
+		return buildAssetPack() ? 0 : -1;
+	}
+	// --build-table [source] [output]
+	if (argc > 1 && strcmp(argv[1], "--build-table") == 0) {
+		std::string source = argc > 2 ? argv[2] : FileSystem::getPath(TABLE_SOURCE_PATH);
+		std::string output = argc > 3 ? argv[3] : FileSystem::getPath(TABLE_BINARY_PATH);
+		return Table::build(source, output) ? 0 : -1;
+	}
+	// --batch [worlds] [seconds] [first seed]
+	if (argc > 1 && strcmp(argv[1], "--batch") == 0) {
+		BatchSettings settings;
+		if (argc > 2) settings.worldCount = atoi(argv[2]);
+		if (argc > 3) settings.maxTime = (float)atof(argv[3]);
+		if (argc > 4) settings.firstSeed = (uint32_t)strtoul(argv[4], nullptr, 10);
+		jobSystem.start();
+		WorldBatch::runAndReport(jobSystem, settings);
+		jobSystem.stop();
+		return 0;
+	}
+	// --determinism-check [seconds] [seed]
+	if (argc > 1 && strcmp(argv[1], "--determinism-check") == 0) {
+		float seconds = argc > 2 ? (float)atof(argv[2]) : 60.0f;
+		uint32_t seed = argc > 3 ? (uint32_t)strtoul(argv[3], nullptr, 10) : 1;
+		jobSystem.workerSetup = Determinism::setupFloatEnvironment;
+		jobSystem.start();
+		bool identical = Determinism::runCheck(jobSystem, seed, seconds, FIX_DT);
+		jobSystem.stop();
+		return identical ? 0 : -1;
+	}
+	// --flight-record <file>
+	if (argc > 2 && strcmp(argv[1], "--flight-record") == 0) {
+		return FlightRecord::print(argv[2]) ? 0 : -1;
+	}
+	// --replay <file>
+	if (argc > 2 && strcmp(argv[1], "--replay") == 0) {
+		jobSystem.workerSetup = Determinism::setupFloatEnvironment;
+		jobSystem.start();
+		bool matched = Replay::play(argv[2], &jobSystem);
+		jobSystem.stop();
+		return matched ? 0 : -1;
+	}
+	// --fixed-bench [balls] [steps]
+	if (argc > 1 && strcmp(argv[1], "--fixed-bench") == 0) {
+		int ballCount = argc > 2 ? atoi(argv[2]) : 64;
+		int steps = argc > 3 ? atoi(argv[3]) : 2000;
+		FixedPointBench::runAndReport(ballCount, steps);
+		return 0;
+	}
+	// --integrator-bench [balls] [steps]
+	if (argc > 1 && strcmp(argv[1], "--integrator-bench") == 0) {
+		int ballCount = argc > 2 ? atoi(argv[2]) : 64;
+		int steps = argc > 3 ? atoi(argv[3]) : 2000;
+		IntegratorBench::runAndReport(ballCount, steps);
+		return 0;
+	}
+	// --contact-bench [balls]
+	if (argc > 1 && strcmp(argv[1], "--contact-bench") == 0) {
+		ContactBench::runAndReport(argc > 2 ? atoi(argv[2]) : 64);
+		return 0;
+	}
+	// --batch-lockstep [episodes] [seconds] [first seed]
+	if (argc > 1 && strcmp(argv[1], "--batch-lockstep") == 0) {
+		BatchSettings settings;
+		if (argc > 2) settings.worldCount = atoi(argv[2]);
+		if (argc > 3) settings.maxTime = (float)atof(argv[3]);
+		if (argc > 4) settings.firstSeed = (uint32_t)strtoul(argv[4], nullptr, 10);
+		jobSystem.start();
+		WorldBatch::runLockstepAndReport(jobSystem, settings);
+		jobSystem.stop();
+		return 0;
+	}
+
+	#ifndef LOOSE_ASSETS
+	if (!assetPack.open(FileSystem::getPath(ASSET_PACK_PATH))) {
+		std::cout << "No asset pack found, loading loose files" << std::endl;
+	}
+	skipStaleAssets();
+	#endif
+
+	// decode textures on worker threads while the context is created and the shaders compile
+	AssetLoader assetLoader(assetPack.isOpen() ? &assetPack : nullptr);
+	requestTextures(assetLoader);
+
 	glfwInit();
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
@@ -609,26 +901,29 @@ int main() {
 		std::cout << "Failed to initialize GLAD" << std::endl;
 		return -1;
 	}
+	assetLoader.setCompression(glfwExtensionSupported("GL_EXT_texture_compression_s3tc"));
 
 
 	glfwSetFramebufferSizeCallback(window, frameBufferSizeCallback);
 	glfwSetMouseButtonCallback(window, mouseButtonCallback);
 
-	srand(time(NULL));
-
 	// init gl
-	Shader circleShader("circle.vs", "circle.fs");
-	Shader squareShader("square.vs", "square.fs");
-	Shader textureShader("texture.vs", "texture.fs");
-	Shader animationShader("animation.vs", "animation.fs");
+	ShaderCache::cacheDirectory = FileSystem::getPath("cache/shaders");
+	ShaderCache::init((GLADloadproc)glfwGetProcAddress);
+	std::vector<Shader> shaders = loadShaders();
+	Shader circleShader = shaders[SHADER_CIRCLE];
+	Shader squareShader = shaders[SHADER_SQUARE];
+	Shader textureShader = shaders[SHADER_TEXTURE];
+	Shader animationShader = shaders[SHADER_ANIMATION];
 	initGLData();
 
-	stbi_set_flip_vertically_on_load(true);
 	glEnable(GL_BLEND);
 	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
+	std::vector<Texture> textures = uploadTextures(assetLoader);
+
 	// init sprite
-	Sprite background = Sprite(textureShader, loadTextureFromFile((FileSystem::getPath("resources/background.png").c_str()), false));
+	Sprite background = Sprite(textureShader, textures[TEXTURE_BACKGROUND]);
 	AnimatedSprite backgroundAnimation = AnimatedSprite(animationShader, background);
 	backgroundAnimation.frameCount = 16;
 	backgroundAnimation.timePerFrame = 0.16;
@@ -636,45 +931,45 @@ int main() {
 	backgroundAnimation.isFlipped = true;
 	backgroundPtr = &backgroundAnimation;
 
-	SquareLineSprite borderSprite = SquareLineSprite(textureShader, loadTextureFromFile((FileSystem::getPath("resources/stone.png").c_str()), true));
+	SquareLineSprite borderSprite = SquareLineSprite(textureShader, textures[TEXTURE_STONE]);
 	borderSprite.useTiling = true;
 	borderSprite.spriteScale = BORDER_SPRITE_SCALE;
 	objectToSprite[BORDER] = &borderSprite;
 
-	Sprite pinballSprite = Sprite(textureShader, loadTextureFromFile((FileSystem::getPath("resources/pinball.png").c_str()), true));
+	Sprite pinballSprite = Sprite(textureShader, textures[TEXTURE_PINBALL]);
 	objectToSprite[BALL] = &pinballSprite;
 
-	SquareLineSprite flipperSprite = SquareLineSprite(textureShader, loadTextureFromFile((FileSystem::getPath("resources/flipper.png").c_str()), true));
+	SquareLineSprite flipperSprite = SquareLineSprite(textureShader, textures[TEXTURE_FLIPPER]);
 	objectToSprite[FLIPPER] = &flipperSprite;
 
-	Sprite obstacleSprite = Sprite(textureShader, loadTextureFromFile((FileSystem::getPath("resources/sand.png").c_str()), true));
+	Sprite obstacleSprite = Sprite(textureShader, textures[TEXTURE_SAND]);
 	objectToSprite[OBSTACLE] = &obstacleSprite;
 
-	Sprite enemyFlyingSprite = Sprite(textureShader, loadTextureFromFile((FileSystem::getPath("resources/enemy_flying.png").c_str()), true));
+	Sprite enemyFlyingSprite = Sprite(textureShader, textures[TEXTURE_ENEMY_FLYING]);
 	AnimatedSprite enemyFlying = AnimatedSprite(animationShader, enemyFlyingSprite);
-	enemyFlying.frameCount = 4;
-	enemyFlying.timePerFrame = 0.1f;
-	enemyFlying.isLooping = true;
+	enemyFlying.frameCount = ENEMY_FLYING_ANIMATION.frameCount;
+	enemyFlying.timePerFrame = ENEMY_FLYING_ANIMATION.timePerFrame;
+	enemyFlying.isLooping = ENEMY_FLYING_ANIMATION.isLooping;
 	objectToAnimatedSprite[FLYING_ENEMY] = &enemyFlying;
 	
-	Sprite enemyDyingSprite = Sprite(textureShader, loadTextureFromFile((FileSystem::getPath("resources/enemy_dying.png").c_str()), true));
+	Sprite enemyDyingSprite = Sprite(textureShader, textures[TEXTURE_ENEMY_DYING]);
 	AnimatedSprite enemyDying = AnimatedSprite(animationShader, enemyDyingSprite);
-	enemyDying.frameCount = 7;
-	enemyDying.timePerFrame = 0.05f;
-	enemyDying.isLooping = false;
+	enemyDying.frameCount = ENEMY_DYING_ANIMATION.frameCount;
+	enemyDying.timePerFrame = ENEMY_DYING_ANIMATION.timePerFrame;
+	enemyDying.isLooping = ENEMY_DYING_ANIMATION.isLooping;
 	objectToAnimatedSprite[DYING_ENEMY] = &enemyDying;
 
 	// init text sprite
-	Sprite number0 = Sprite(textureShader, loadTextureFromFile((FileSystem::getPath("resources/numbers/number0.png").c_str()), true));
-	Sprite number1 = Sprite(textureShader, loadTextureFromFile((FileSystem::getPath("resources/numbers/number1.png").c_str()), true));
-	Sprite number2 = Sprite(textureShader, loadTextureFromFile((FileSystem::getPath("resources/numbers/number2.png").c_str()), true));
-	Sprite number3 = Sprite(textureShader, loadTextureFromFile((FileSystem::getPath("resources/numbers/number3.png").c_str()), true));
-	Sprite number4 = Sprite(textureShader, loadTextureFromFile((FileSystem::getPath("resources/numbers/number4.png").c_str()), true));
-	Sprite number5 = Sprite(textureShader, loadTextureFromFile((FileSystem::getPath("resources/numbers/number5.png").c_str()), true));
-	Sprite number6 = Sprite(textureShader, loadTextureFromFile((FileSystem::getPath("resources/numbers/number6.png").c_str()), true));
-	Sprite number7 = Sprite(textureShader, loadTextureFromFile((FileSystem::getPath("resources/numbers/number7.png").c_str()), true));
-	Sprite number8 = Sprite(textureShader, loadTextureFromFile((FileSystem::getPath("resources/numbers/number8.png").c_str()), true));
-	Sprite number9 = Sprite(textureShader, loadTextureFromFile((FileSystem::getPath("resources/numbers/number9.png").c_str()), true));
+	Sprite number0 = Sprite(textureShader, textures[TEXTURE_NUMBER0]);
+	Sprite number1 = Sprite(textureShader, textures[TEXTURE_NUMBER1]);
+	Sprite number2 = Sprite(textureShader, textures[TEXTURE_NUMBER2]);
+	Sprite number3 = Sprite(textureShader, textures[TEXTURE_NUMBER3]);
+	Sprite number4 = Sprite(textureShader, textures[TEXTURE_NUMBER4]);
+	Sprite number5 = Sprite(textureShader, textures[TEXTURE_NUMBER5]);
+	Sprite number6 = Sprite(textureShader, textures[TEXTURE_NUMBER6]);
+	Sprite number7 = Sprite(textureShader, textures[TEXTURE_NUMBER7]);
+	Sprite number8 = Sprite(textureShader, textures[TEXTURE_NUMBER8]);
+	Sprite number9 = Sprite(textureShader, textures[TEXTURE_NUMBER9]);
 	charToNumberSprite['0'] = &number0;
 	charToNumberSprite['1'] = &number1;
 	charToNumberSprite['2'] = &number2;
@@ -687,42 +982,139 @@ int main() {
 	charToNumberSprite['9'] = &number9;
 	scoreText.overrideOverlay = true;
 
-	Sprite gameoverSprite = Sprite(textureShader, loadTextureFromFile((FileSystem::getPath("resources/gameover.png").c_str()), true));
+	Sprite gameoverSprite = Sprite(textureShader, textures[TEXTURE_GAMEOVER]);
 	gameoverSprite.overrideOverlay = true;
 	gameoverSpritePtr = &gameoverSprite;
 
-	Sprite tutorialSprite = Sprite(textureShader, loadTextureFromFile((FileSystem::getPath("resources/tutorial.png").c_str()), true));
+	Sprite tutorialSprite = Sprite(textureShader, textures[TEXTURE_TUTORIAL]);
 	tutorialSpritePtr = &tutorialSprite;
 
-	enemies.reserve(100);
-	balls.reserve(100);
-	resetScene();
+	// init perf hud
+	Shader hudShader = shaders[SHADER_HUD];
+	SpriteBatch hudBatch = SpriteBatch(hudShader);
+	hudBatchPtr = &hudBatch;
+	Texture whiteTexture;
+	whiteTexture.internalFormat = GL_RGBA;
+	whiteTexture.imageFormat = GL_RGBA;
+	unsigned char whitePixel[4] = { 255, 255, 255, 255 };
+	whiteTexture.generate(1, 1, whitePixel);
+	whiteTexturePtr = &whiteTexture;
+
+	world.jobs = &jobSystem;
+	if (!Table::load(FileSystem::getPath(TABLE_SOURCE_PATH), FileSystem::getPath(TABLE_BINARY_PATH), world.table)) {
+		std::cout << "Using the built-in default table" << std::endl;
+		world.table = Table::getDefault();
+	}
+	world.reset((uint32_t)time(NULL));
+	#ifdef CONTACT_SOLVER
+	world.useContactSolver = true;
+	#endif
+	renderTable = world.table;
+	borderMesh.upload(renderTable.borderMesh);
+	#ifdef TABLE_HOT_RELOAD
+	tableWatcher.start(FileSystem::getPath(TABLE_SOURCE_PATH));
+	#endif
+	flightRecorder.directory = FileSystem::getPath("flightrecords");
+	#ifdef RECORD_REPLAY
+	#ifdef DETERMINISTIC_SIMULATION
+	float replayDt = FIX_DT;
+	#else
+	float replayDt = 0.0f;
+	#endif
+	std::string replayPath = FileSystem::getPath("replays/session-" + std::to_string((long long)time(NULL)) + ".replay");
+	uint16_t replayFlags = world.useContactSolver ? REPLAY_CONTACT_SOLVER : 0;
+	if (replayRecorder.start(replayPath, world.stats.seed, replayDt, replayFlags, world.table)) {
+		world.hashSteps = true;
+	}
+	#endif
+	#ifdef DETERMINISTIC_SIMULATION
+	std::cout << "Deterministic simulation, seed " << world.stats.seed << std::endl;
+	world.hashSteps = true;
+	jobSystem.workerSetup = Determinism::setupFloatEnvironment;
+	#ifndef SIMULATION_THREAD
+	Determinism::setupFloatEnvironment();
+	#endif
+	#endif
+	writeRenderSnapshot(renderSnapshots.beginWrite());
+	renderSnapshots.publish();
+
+	#ifdef DETERMINISTIC_JOBS
+	jobSystem.start(0, true);
+	#else
+	jobSystem.start();
+	#endif
+
+	#ifdef SIMULATION_THREAD
+	simulationRunning = true;
+	std::thread simulationThread(simulationThreadLoop);
+	#endif
+
 	while (!glfwWindowShouldClose(window)) {
+		perfCounters = PerfCounters();
+		Shader::uniformUploads = 0;
+
+		frameProfiler.beginPhase();
 		processInput(window);
+		#ifdef TABLE_HOT_RELOAD
+		reloadTable();
+		#endif
+		frameProfiler.endPhase(PHASE_INPUT);
 
 		float currentTime = (float)glfwGetTime();
 		deltaTime = currentTime - lastTime;
 		lastTime = currentTime;
 
 		// update
-		updateSimulation(deltaTime);
-		updateGame(deltaTime);
+		#ifdef SIMULATION_THREAD
+		// the next step runs while this frame draws the newest finished one
+		requestSimulationStep(deltaTime);
+		#else
+		runSimulationStep(deltaTime);
+		#endif
+
+		bool newSnapshot = renderSnapshots.acquire();
+		const RenderSnapshot& snapshot = renderSnapshots.read();
+		viewPos = snapshot.viewPos;
+		globalOverlay = snapshot.overlay;
+		// a frame that redraws the previous snapshot did not pay for its step again
+		frameProfiler.current.phaseTimes[PHASE_SIMULATION] = newSnapshot ? snapshot.simulationTime : 0.0f;
+		frameProfiler.current.phaseTimes[PHASE_GAME] = newSnapshot ? snapshot.gameTime : 0.0f;
 
 		// render
+		frameProfiler.beginPhase();
 		glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
 		glClear(GL_COLOR_BUFFER_BIT);
-		renderBackground(deltaTime);
-		renderEnemies(&circleShader);
-		renderBalls(circleShader);
-		renderObstacles(circleShader);
-		renderFlippers(squareShader);
-		renderBorder(squareShader);
-		renderText();
+		renderBackground(deltaTime, snapshot);
+		renderEnemies(snapshot, &circleShader);
+		renderBalls(circleShader, snapshot);
+		renderObstacles(circleShader, snapshot);
+		renderFlippers(squareShader, snapshot);
+		renderBorder(squareShader, snapshot);
+		renderText(snapshot);
+		frameProfiler.endPhase(PHASE_RENDER);
+
+		if (showPerfHud) {
+			frameProfiler.beginPhase();
+			renderPerfHud(snapshot);
+			frameProfiler.endPhase(PHASE_HUD);
+		}
 
+		frameProfiler.beginPhase();
 		glfwSwapBuffers(window);
 		glfwPollEvents();
+		frameProfiler.endPhase(PHASE_SWAP);
+		frameProfiler.endFrame(deltaTime);
 	}
 
+	#ifdef SIMULATION_THREAD
+	simulationRunning = false;
+	simulationTicks++;
+	simulationTicks.notify_one();
+	simulationThread.join();
+	#endif
+	replayRecorder.finish(world.stateHash);
+	jobSystem.stop();
+
 	return 0; 
 }
 
@@ -731,36 +1123,18 @@ void frameBufferSizeCallback(GLFWwindow* window, int width, int height) {
 }
 
 void mouseButtonCallback(GLFWwindow* window, int button, int action, int mods) {
-	if (flippers.empty() || gameState == GAME_OVER) return;
-
 	if (button == GLFW_MOUSE_BUTTON_LEFT && action == GLFW_PRESS) {
-		for (Flipper& flipper : flippers) {
-			if (flipper.id == LEFT) {
-				flipper.isFlipped = true;
-			}
-		}
+		queueCommand(COMMAND_FLIP_LEFT);
 	}
 	else if (button == GLFW_MOUSE_BUTTON_LEFT && action == GLFW_RELEASE) {
-		for (Flipper& flipper : flippers) {
-			if (flipper.id == LEFT) {
-				flipper.isFlipped = false;
-			}
-		}
+		queueCommand(COMMAND_RELEASE_LEFT);
 	}
 
 	if (button == GLFW_MOUSE_BUTTON_RIGHT && action == GLFW_PRESS) {
-		for (Flipper& flipper : flippers) {
-			if (flipper.id == RIGHT) {
-				flipper.isFlipped = true;
-			}
-		}
+		queueCommand(COMMAND_FLIP_RIGHT);
 	}
 	else if (button == GLFW_MOUSE_BUTTON_RIGHT && action == GLFW_RELEASE) {
-		for (Flipper& flipper : flippers) {
-			if (flipper.id == RIGHT) {
-				flipper.isFlipped = false;
-			}
-		}
+		queueCommand(COMMAND_RELEASE_RIGHT);
 	}
 }
 
@@ -770,17 +1144,37 @@ void processInput(GLFWwindow* window) {
 	}
 
 	if (getKeyDown(window, GLFW_KEY_R)) {
-		resetScene();
+		queueCommand(COMMAND_RESET);
+	}
+
+	// quick save and load of the whole world
+	if (getKeyDown(window, GLFW_KEY_F5)) {
+		queueCommand(COMMAND_SAVE_SNAPSHOT);
+	}
+
+	if (getKeyDown(window, GLFW_KEY_F9)) {
+		queueCommand(COMMAND_LOAD_SNAPSHOT);
+	}
+
+	// rewind: F6 pauses and resumes, the arrows step back and forward while paused, shift for 10 steps
+	if (getKeyDown(window, GLFW_KEY_F6)) {
+		rewindRequested = !rewindRequested;
+	}
+
+	if (rewindRequested) {
+		int steps = glfwGetKey(window, GLFW_KEY_LEFT_SHIFT) == GLFW_PRESS ? REWIND_FAST_STEPS : 1;
+		if (glfwGetKey(window, GLFW_KEY_LEFT) == GLFW_PRESS) rewindScrubSteps -= steps;
+		if (glfwGetKey(window, GLFW_KEY_RIGHT) == GLFW_PRESS) rewindScrubSteps += steps;
 	}
 
 	// cheats
 	if (getKeyDown(window, GLFW_KEY_SPACE)) {
 		if (glfwGetKey(window, GLFW_KEY_B) == GLFW_PRESS) {
-			spawnBall();
+			queueCommand(COMMAND_SPAWN_BALL);
 		}
 
 		if (glfwGetKey(window, GLFW_KEY_E) == GLFW_PRESS) {
-			spawnEnemy();
+			queueCommand(COMMAND_SPAWN_ENEMY);
 		}
 	}
 
@@ -788,6 +1182,11 @@ void processInput(GLFWwindow* window) {
 	if (getKeyDown(window, GLFW_KEY_F11)) {
 		toggleFullscreen(window);
 	}
+
+	// toggle perf hud
+	if (getKeyDown(window, GLFW_KEY_F3)) {
+		showPerfHud = !showPerfHud;
+	}
 }
 
 void toggleFullscreen(GLFWwindow* window) {
@@ -802,101 +1201,37 @@ void toggleFullscreen(GLFWwindow* window) {
 	}
 }
 
-float* initCircleVertexData() {
-	circleVerts[0] = 0.0f;
-	circleVerts[1] = 0.0f;
-	circleVerts[2] = 0.0f;
-	for (int i = 1; i < CIRCLE_VERTS_NUM; i++) {
-		circleVerts[i * 3] = cos(Utils::deg2Rad(i));
-		circleVerts[i * 3 + 1] = sin(Utils::deg2Rad(i));;
-		circleVerts[i * 3 + 2] = 0.0f;
-	}
-
-	return circleVerts;
-}
-
-unsigned int* initCircleIndicesData() {
-	for (int i = 0; i < CIRCLE_VERTS_NUM; i++) {
-		circleIndices[i] = i;
-	}
-
-	return circleIndices;
-}
-
-float* initSquareVertexData(){
-	squareVerts[0] = 0.0f;
-	squareVerts[1] = -0.5f;
-	squareVerts[2] = 0.0f;
-
-	squareVerts[3] = 1.0f;
-	squareVerts[4] = -0.5f;
-	squareVerts[5] = 0.0f;
-
-	squareVerts[6] = 1.0f;
-	squareVerts[7] = 0.5f;
-	squareVerts[8] = 0.0f;
-
-	squareVerts[9] = 0.0f;
-	squareVerts[10] = 0.5;
-	squareVerts[11] = 0.0f;
-	
-	return squareVerts;
-}
-
-unsigned int* initSquareIndicesData() {
-	squareIndices[0] = 0;
-	squareIndices[1] = 1;
-	squareIndices[2] = 2;
-	squareIndices[3] = 0;
-	squareIndices[4] = 2;
-	squareIndices[5] = 3;
-
-	outlineIndices[0] = 0;
-	outlineIndices[1] = 1;
-	outlineIndices[2] = 2;
-	outlineIndices[3] = 3;
-	outlineIndices[4] = 0;
-
-	return squareIndices;
-}
-
 void initCircleData() {
-	initCircleVertexData();
-	initCircleIndicesData();
-
 	glGenVertexArrays(1, &circleVAO);
 	glBindVertexArray(circleVAO);
 
 	glGenBuffers(1, &circleVBO);
 	glBindBuffer(GL_ARRAY_BUFFER, circleVBO);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(float) * CIRCLE_VERTS_NUM * 3, circleVerts, GL_STATIC_DRAW);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(Geometry::CIRCLE_VERTICES), Geometry::CIRCLE_VERTICES.data(), GL_STATIC_DRAW);
 
 	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
 	glEnableVertexAttribArray(0);
 
 	glGenBuffers(1, &circleEBO);
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, circleEBO);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(unsigned int) * CIRCLE_VERTS_NUM, circleIndices, GL_STATIC_DRAW);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(Geometry::CIRCLE_INDICES), Geometry::CIRCLE_INDICES.data(), GL_STATIC_DRAW);
 }
 
 void initSquareData() {
-	initSquareVertexData();
-	initSquareIndicesData();
-
 	// square
 	glGenVertexArrays(1, &squareVAO);
 	glBindVertexArray(squareVAO);
 
 	glGenBuffers(1, &squareVBO);
 	glBindBuffer(GL_ARRAY_BUFFER, squareVBO);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(float) * 4 * 3, squareVerts, GL_STATIC_DRAW);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(Geometry::SQUARE_VERTICES), Geometry::SQUARE_VERTICES.data(), GL_STATIC_DRAW);
 
 	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
 	glEnableVertexAttribArray(0);
 
 	glGenBuffers(1, &squareEBO);
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, squareEBO);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(unsigned int) * 6, squareIndices, GL_STATIC_DRAW);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(Geometry::SQUARE_INDICES), Geometry::SQUARE_INDICES.data(), GL_STATIC_DRAW);
 
 	// square outline
 	glGenVertexArrays(1, &squareOutlineVAO);
@@ -904,14 +1239,14 @@ void initSquareData() {
 
 	glGenBuffers(1, &squareOutlineVBO);
 	glBindBuffer(GL_ARRAY_BUFFER, squareOutlineVBO);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(float) * 4 * 3, squareVerts, GL_STATIC_DRAW);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(Geometry::SQUARE_VERTICES), Geometry::SQUARE_VERTICES.data(), GL_STATIC_DRAW);
 
 	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
 	glEnableVertexAttribArray(0);
 
 	glGenBuffers(1, &squareOutlineEBO);
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, squareOutlineEBO);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(unsigned int) * 5, outlineIndices, GL_STATIC_DRAW);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(Geometry::OUTLINE_INDICES), Geometry::OUTLINE_INDICES.data(), GL_STATIC_DRAW);
 }
 
 void initGLData() {
@@ -935,7 +1270,8 @@ void drawCircle(Shader& shader, glm::vec3 position, float radius, glm::vec3 colo
 	shader.setVec3("color", color);
 
 	glBindVertexArray(circleVAO);
-	glDrawElements(GL_TRIANGLE_FAN, CIRCLE_VERTS_NUM, GL_UNSIGNED_INT, 0);
+	glDrawElements(GL_TRIANGLE_FAN, Geometry::CIRCLE_VERTEX_COUNT, GL_UNSIGNED_INT, 0);
+	perfCounters.drawCalls++;
 }
 
 void drawSquareLine(Shader& shader, glm::vec3 startPos, glm::vec3 endPos, float radius, glm::vec3 color) {
@@ -963,37 +1299,38 @@ void drawSquareLine(Shader& shader, glm::vec3 startPos, glm::vec3 endPos, float
 
 	glBindVertexArray(squareVAO);
 	glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+	perfCounters.drawCalls++;
 }
 
-void renderBalls(Shader& shader) {
-	for (const Ball& ball : balls) {
+void renderBalls(Shader& shader, const RenderSnapshot& snapshot) {
+	for (const CircleView& ball : snapshot.balls) {
 		//drawCircle(shader, glm::vec3(ball.position, 0.0f), ball.radius, glm::vec3(1.0f));
 		objectToSprite[BALL]->drawSprite(glm::vec3(ball.position, 0.0f), glm::vec3(2.0f * ball.radius), 0.0f, glm::vec3(1.0f), true);
 	}
 
 	#ifdef DRAW_DEBUG
-	for (const Ball& ball : balls) {
+	for (const CircleView& ball : snapshot.balls) {
 		drawCircleOutline(shader, glm::vec3(ball.position, 0.0f), ball.radius);
 	}
 	#endif
 }
 
-void renderObstacles(Shader& shader) {
-	for (const Obstacle& obstacle : obstacles) {
+void renderObstacles(Shader& shader, const RenderSnapshot& snapshot) {
+	for (const CircleView& obstacle : snapshot.obstacles) {
 		//drawCircle(shader, glm::vec3(obstacle.position, 0.0f), obstacle.radius, glm::vec3(1.0f, 1.0f, 0.0f));
 		objectToSprite[OBSTACLE]->drawSprite(glm::vec3(obstacle.position, 0.0f), glm::vec3(2.0f * obstacle.radius), 0.0f, glm::vec3(1.0f));
 	}
 
 	#ifdef DRAW_DEBUG
-	for (const Obstacle& obstacle : obstacles) {
+	for (const CircleView& obstacle : snapshot.obstacles) {
 		drawCircleOutline(shader, glm::vec3(obstacle.position, 0.0f), obstacle.radius);
 	}
 	#endif
 }
-void renderFlippers(Shader& shader) {
-	for (const Flipper& flipper : flippers) {
-		glm::vec3 startPos = glm::vec3(flipper.position, 0.0f);
-		glm::vec3 endPos = glm::vec3(flipper.getFlipperEnd(), 0.0f);
+void renderFlippers(Shader& shader, const RenderSnapshot& snapshot) {
+	for (const FlipperView& flipper : snapshot.flippers) {
+		glm::vec3 startPos = glm::vec3(flipper.start, 0.0f);
+		glm::vec3 endPos = glm::vec3(flipper.end, 0.0f);
 		//drawSquareLine(shader, startPos, endPos, flipper.radius, glm::vec3(1.0f, 0.0f, 0.0f));
 
 		if (startPos.x < endPos.x) {
@@ -1009,31 +1346,32 @@ void renderFlippers(Shader& shader) {
 	}
 
 	#ifdef DRAW_DEBUG
-	for (const Flipper& flipper : flippers) {
-		glm::vec3 startPos = glm::vec3(flipper.position, 0.0f);
-		glm::vec3 endPos = glm::vec3(flipper.getFlipperEnd(), 0.0f);
+	for (const FlipperView& flipper : snapshot.flippers) {
+		glm::vec3 startPos = glm::vec3(flipper.start, 0.0f);
+		glm::vec3 endPos = glm::vec3(flipper.end, 0.0f);
 		drawSquareOutline(shader, startPos, endPos, flipper.radius);
 	}
 	#endif
 }
 
-void renderBackground(float dt) {
+void renderBackground(float dt, const RenderSnapshot& snapshot) {
 	backgroundPtr->drawSprite(glm::vec3(-25.0f, 0.0f, 0.0f), glm::vec3(276.0f), 0.0f, glm::vec3(0.5f));
-	if (gameState != GAME_OVER) {
+	if (snapshot.gameState != GAME_OVER) {
 		backgroundPtr->update(dt);
 	}
 }
 
-void renderBorder(Shader& shader) {
-	int n = borderPoints.size();
-	for (int i = 0; i < n; i++) {
-		glm::vec3 startPos = glm::vec3(borderPoints[i], 0.0f);
-		glm::vec3 endPos = glm::vec3(borderPoints[(i + 1) % n], 0.0f);
-		//drawSquareLine(shader, startPos, endPos, BORDER_SIZE, glm::vec3(1.0f, 1.0f, 1.0f));
-		drawTexturedSquareLine(objectToSprite[BORDER], startPos, endPos, BORDER_SIZE);
-	}
+// the shader and snapshot are only for the debug outlines
+#ifdef DRAW_DEBUG
+void renderBorder(Shader& shader, const RenderSnapshot& snapshot) {
+#else
+void renderBorder(Shader&, const RenderSnapshot&) {
+#endif
+	borderMesh.draw(*objectToSprite[BORDER]);
 
 	#ifdef DRAW_DEBUG
+	const std::vector<glm::vec2>& borderPoints = snapshot.borderPoints;
+	int n = borderPoints.size();
 	for (int i = 0; i < n; i++) {
 		glm::vec3 startPos = glm::vec3(borderPoints[i], 0.0f);
 		glm::vec3 endPos = glm::vec3(borderPoints[(i + 1) % n], 0.0f);
@@ -1067,6 +1405,7 @@ void drawSquareOutline(Shader& shader, glm::vec3 startPos, glm::vec3 endPos, flo
 
 	glBindVertexArray(squareOutlineVAO);
 	glDrawElements(GL_LINE_STRIP, 5, GL_UNSIGNED_INT, 0);
+	perfCounters.drawCalls++;
 }
 
 void drawCircleOutline(Shader& shader, glm::vec3 position, float radius) {
@@ -1082,253 +1421,8 @@ void drawCircleOutline(Shader& shader, glm::vec3 position, float radius) {
 	shader.setVec3("color", glm::vec3(0.0f, 1.0f, 0.0f));
 
 	glBindVertexArray(circleVAO);
-	glDrawElements(GL_LINES, CIRCLE_VERTS_NUM, GL_UNSIGNED_INT, 0);
-}
-
-void resetScene() {
-	borderPoints.clear();
-	balls.clear();
-	flippers.clear();
-	obstacles.clear();
-	enemies.clear();
-
-	globalOverlay = glm::vec3(1.0f);
-
-	gameState = RUNNING;
-	comboCounter = 0;
-	numOfBallsToSpawn = 0;
-
-	enemySpawnInterval = INITIAL_ENEMY_SPAWN_INTERVAL;
-	enemyDescendSpeed = INITIAL_ENEMY_DESCEND_SPEED;
-	enemyMaxHorizontalSpeed = INITIAL_ENEMY_MAX_HORIZONTAL_SPEED;
-
-	enemySpawnTimer = 0.0f;
-	parameterTimer = 0.0f;
-
-	scoreIntervalTimer = TIME_PER_SCORING_INTERVAL;
-	score = 0;
-
-	borderPoints.push_back(glm::vec2(-75.0f, 75.0f));
-	borderPoints.push_back(glm::vec2(-75.0f, -5.0f));
-	borderPoints.push_back(glm::vec2(-60.0f, -20.0f));
-	borderPoints.push_back(glm::vec2(-45.0f, -32.0f));
-	borderPoints.push_back(glm::vec2(-32.0f, -40.0f));
-	borderPoints.push_back(glm::vec2(-20.0f, -50.0f));
-	borderPoints.push_back(glm::vec2(-20.0f, -200.0f));
-	borderPoints.push_back(glm::vec2(20.0f, -200.0f));
-	borderPoints.push_back(glm::vec2(20.0f, -50.0f));
-	borderPoints.push_back(glm::vec2(32.0f, -40.0f));
-	borderPoints.push_back(glm::vec2(45.0f, -32.0f));
-	borderPoints.push_back(glm::vec2(60.0f, -20.0f));
-	borderPoints.push_back(glm::vec2(75.0f, -5.0f));
-	borderPoints.push_back(glm::vec2(75.0f, 75.0f));
-
-	obstacles.push_back(Obstacle(glm::vec2(-35.0f, 18.0f), 7.0f));
-	obstacles.push_back(Obstacle(glm::vec2(12.0f, 50.0f), 5.0f));
-	obstacles.push_back(Obstacle(glm::vec2(-20.0f, 40.0f), 4.0f));
-	obstacles.push_back(Obstacle(glm::vec2(40.0f, 30.0f), 10.0f));
-
-	for (int i = 0; i < INITTIAL_BALL_COUNT; i++) {
-		spawnBall();
-	}
-
-	float radius = 1.5f;
-	float length = 16.0f;
-	float maxRotation = Utils::deg2Rad(50.0f);
-	float restAngle = Utils::deg2Rad(10.0f);
-	float upperRestAngle = Utils::deg2Rad(30.0f);
-	float angularVelocity = 12.0f;
-	float restitution = 0.2f;
-
-	glm::vec2 leftPivot = glm::vec2(-20.0f, -50.0f);
-	glm::vec2 rightPivot = glm::vec2(20.0f, -50.0f);
-	glm::vec2 upperLeftPivot = glm::vec2(-75.0f, -5.0f);
-	glm::vec2 upperRightPivot = glm::vec2(75.0f, -5.0f);
-
-	flippers.push_back(Flipper(leftPivot, radius, length, -restAngle, maxRotation, angularVelocity, restitution));
-	flippers.push_back(Flipper(rightPivot,radius, length, Utils::PI + restAngle, maxRotation, angularVelocity, restitution, false));
-	flippers.push_back(Flipper(upperLeftPivot, radius, length, -upperRestAngle, maxRotation, angularVelocity, restitution));
-	flippers.push_back(Flipper(upperRightPivot, radius, length, Utils::PI + upperRestAngle, maxRotation, angularVelocity, restitution, false));
-
-	flippers[0].id = flippers[2].id = LEFT;
-	flippers[1].id = flippers[3].id = RIGHT;
-
-	offsetEverythingBy(WORLD_OFFSET);
-
-	// enemies
-	//AnimatedSprite& enemyFlying = *objectToAnimatedSprite[FLYING_ENEMY];
-	//AnimatedSprite& enemyDying = *objectToAnimatedSprite[DYING_ENEMY];
-	//Enemy testEnemy1(glm::vec2(-20.0f, 0.0f), 7.5f, 0.75f, enemyFlying, enemyDying, true, glm::vec2(0.0f, -2.0f));
-	//Enemy testEnemy2(glm::vec2(0.0f, 0.0f), 7.5f, 0.75f, enemyFlying, enemyDying, true, glm::vec2(0.0f, -2.0f));
-	//Enemy testEnemy3(glm::vec2(20.0f, 0.0f), 7.5f, 0.75f, enemyFlying, enemyDying, true, glm::vec2(0.0f, -2.0f));
-
-	//Enemy testEnemy4(glm::vec2(-10.0f, 12.0f), 7.5f, 0.75f, enemyFlying, enemyDying, true, glm::vec2(0.0f, -2.0f));
-	//Enemy testEnemy5(glm::vec2(1.0f, 12.0f), 7.5f, 0.75f, enemyFlying, enemyDying, true, glm::vec2(0.0f, -2.0f));
-	//Enemy testEnemy6(glm::vec2(10.0f, 12.0f), 7.5f, 0.75f, enemyFlying, enemyDying, true, glm::vec2(0.0f, -2.0f));
-
-	//enemies.push_back(testEnemy1);
-	//enemies.push_back(testEnemy2);
-	//enemies.push_back(testEnemy3);
-	//enemies.push_back(testEnemy4);
-	//enemies.push_back(testEnemy5);
-	//enemies.push_back(testEnemy6);
-
-	lowestFlipperY = FLT_MAX;
-	for (Flipper& flipper : flippers) {
-		lowestFlipperY = glm::min(flipper.position.y, lowestFlipperY);
-	}
-
-	ballDespawnHeight = FLT_MAX;
-	float lowestPoint = FLT_MAX;
-	float secondLowestPoint = FLT_MAX;
-	for (glm::vec2& point : borderPoints) {
-		if (point.y < lowestPoint) {
-			secondLowestPoint = lowestPoint;
-			lowestPoint = point.y;
-		}
-	}
-	ballDespawnHeight = (lowestPoint + secondLowestPoint) / 2.0f;
-
-	float highestY = std::numeric_limits<float>::lowest();
-	float leftmost = FLT_MAX;
-	float rightmost = std::numeric_limits<float>::lowest();
-	for (glm::vec2& point : borderPoints) {
-		highestY = std::max(point.y, highestY);
-		leftmost = std::min(point.x, leftmost);
-		rightmost = std::max(point.x, rightmost);
-	}
-	spawnPosLeft = glm::vec2(leftmost + BORDER_SIZE, highestY - BORDER_SIZE);
-	spawnPosRight = glm::vec2(rightmost + BORDER_SIZE, highestY - BORDER_SIZE);
-}
-
-void handleBallCollision(Ball& b1, Ball& b2, float restitution) {
-	glm::vec2 dir = b2.position - b1.position;
-	float distance = glm::length(dir);
-	if (distance <= 0.0001f || distance > b1.radius + b2.radius) return;
-
-	dir = glm::normalize(dir);
-
-	float correction = (b1.radius + b2.radius - distance) / 2.0f;
-	b1.position += dir * -correction;
-	b2.position += dir * correction;
-
-	float v1 = glm::dot(b1.velocity, dir);
-	float v2 = glm::dot(b2.velocity, dir);
-
-	float m1 = b1.mass;
-	float m2 = b2.mass;
-
-	float newV1 = (m1 * v1 + m2 * v2 - m2 * (v1 - v2) * restitution) / (m1 + m2);
-	float newV2 = (m1 * v1 + m2 * v2 - m1 * (v2 - v1) * restitution) / (m1 + m2);
-
-	b1.velocity += dir * (newV1 - v1);
-	b2.velocity += dir * (newV2 - v2);
-}
-
-void handleBallObstacleCollision(Ball& ball, Obstacle& obstacle) {
-	glm::vec2 dir = ball.position - obstacle.position;
-	float distance = glm::length(dir);
-	if (distance == 0.0f || distance > ball.radius + obstacle.radius) return;
-
-	dir = glm::normalize(dir);
-
-	float correction = ball.radius + obstacle.radius - distance;
-	ball.position += dir * correction;
-
-	float v = glm::dot(ball.velocity, dir);
-	ball.velocity += dir * (obstacle.pushAmount - v);
-}
-
-void handleBallFlipperCollision(Ball& ball, Flipper& flipper) {
-	glm::vec2 closest = Utils::getClosestPointOnSegment(ball.position, flipper.position, flipper.getFlipperEnd());
-	glm::vec2 dir = ball.position - closest;
-	float distance = glm::length(dir);
-	if (distance == 0.0f || distance > ball.radius + flipper.radius * 0.5f) return;
-
-	dir = glm::normalize(dir);
-
-	float correction = ball.radius + flipper.radius * 0.5f - distance;
-	ball.position += dir * correction;
-
-	glm::vec2 r = closest;
-	r += dir * flipper.radius;
-	r -= flipper.position;
-	glm::vec2 surfaceVelocity = Utils::getPerpendicular(r);
-	surfaceVelocity *= flipper.currentAngularVelocity;
-
-	float v = glm::dot(ball.velocity, dir);
-	float newV = glm::dot(surfaceVelocity, dir);
-
-	ball.velocity += dir * (newV - v);
-}
-
-void handleBallBorderCollision(Ball& ball, std::vector<glm::vec2>& borderPoints) {
-	if (borderPoints.size() < 3) return;
-
-	glm::vec2 d, closest, ab;
-	glm::vec2 normal = glm::vec2();
-	float minDist = 0.0f;
-	int n = borderPoints.size();
-	for (int i = 0; i < n; i++) {
-		glm::vec2 a = borderPoints[i];
-		glm::vec2 b = borderPoints[(i + 1) % n];
-		glm::vec2 c = Utils::getClosestPointOnSegment(ball.position, a, b);
-		d = ball.position - c;
-		float distance = glm::length(d);
-		if (i == 0 || distance < minDist) {
-			minDist = distance;
-			closest = c;
-			ab = b - a;
-			normal = Utils::getPerpendicular(ab);
-		}
-	}
-
-	d = ball.position - closest;
-	float distance = glm::length(d);
-	if (distance == 0.0f) {
-		d = normal;
-		distance = glm::length(normal);
-	}
-	d = glm::normalize(d);
-
-	if (glm::dot(d, normal) >= 0.0f) {
-		if (distance > ball.radius + BORDER_SIZE * 0.5f) return;
-
-		ball.position += d * (ball.radius - distance + BORDER_SIZE * 0.5f);
-	}
-	else {
-		ball.position += d * -(distance + ball.radius - BORDER_SIZE * 0.5f);
-	}
-
-	float v = glm::dot(ball.velocity, d);
-	float newV = glm::abs(v) * RESTITUTION;
-
-	ball.velocity += d * (newV - v);
-}
-
-void updateSimulation(float dt) {
-	for (Flipper& flipper : flippers) {
-		flipper.update(dt);
-	}
-
-	int n = balls.size();
-	for (int i = 0; i < n; i++) {
-		Ball& ball = balls[i];
-		ball.update(dt);
-
-		for (int j = i + 1; j < n; j++) {
-			Ball& otherBall = balls[j];
-			handleBallCollision(ball, otherBall, RESTITUTION);
-		}
-
-		for (Obstacle& obstacle : obstacles)
-			handleBallObstacleCollision(ball, obstacle);
-
-		for (Flipper& flipper : flippers)
-			handleBallFlipperCollision(ball, flipper);
-
-		handleBallBorderCollision(ball, borderPoints);
-	}
+	glDrawElements(GL_LINES, Geometry::CIRCLE_VERTEX_COUNT, GL_UNSIGNED_INT, 0);
+	perfCounters.drawCalls++;
 }
 
 bool getKeyDown(GLFWwindow* window, unsigned int key) {
@@ -1353,306 +1447,532 @@ bool getKeyDown(GLFWwindow* window, unsigned int key) {
 	}
 }
 
-Texture loadTextureFromFile(const char* filename, bool hasAlpha) {
-	Texture texture;
-	if (hasAlpha) {
-		texture.internalFormat = GL_RGBA;
-		texture.imageFormat = GL_RGBA;
+void requestTextures(AssetLoader& loader) {
+	for (int i = 0; i < TEXTURE_COUNT; i++) {
+		loader.requestImage(TEXTURE_SOURCES[i].path, TEXTURE_SOURCES[i].hasAlpha);
 	}
-	int width, height, nrChannels;
-	unsigned char* data = stbi_load(filename, &width, &height, &nrChannels, 0);
-	texture.generate(width, height, data);
-	stbi_image_free(data);
-	return texture;
 }
 
-void drawTexturedSquareLine(Sprite* sprite, glm::vec3 startPos, glm::vec3 endPos, float radius) {
-	glm::vec2 startToEnd = endPos - startPos;
-	float length = glm::length(startToEnd);
-	glm::vec2 dir = glm::normalize(startToEnd);
-	float angle = glm::atan(dir.y, dir.x);
+std::vector<Texture> uploadTextures(AssetLoader& loader) {
+	std::vector<Texture> textures(TEXTURE_COUNT);
+	bool supportsS3TC = loader.isCompressing();
+	GLuint pbo = 0;
+	#ifdef PBO_TEXTURE_UPLOAD
+	glGenBuffers(1, &pbo);
+	#endif
 
-	sprite->drawSprite(startPos, glm::vec3(length, radius, 0.0f), angle, glm::vec3(1.0f), true);
-}
+	// upload in completion order so the gl thread never waits on a slow image while others are ready
+	while (loader.hasPending()) {
+		DecodedImage image = loader.waitNext();
+		// decoded for S3TC before the driver was known to lack it, a worker redoes it as raw pixels
+		if (image.compressedFormat != 0 && !supportsS3TC) {
+			loader.requestAgain(image.handle);
+			continue;
+		}
+		createTexture(textures[image.handle], image, pbo);
+	}
 
-bool checkCircleCollision(Circle& c1, Circle& c2) {
-	float distance = glm::length(c1.position - c2.position);
-	return distance < (c1.radius + c2.radius);
+	#ifdef PBO_TEXTURE_UPLOAD
+	glDeleteBuffers(1, &pbo);
+	#endif
+	return textures;
 }
 
-void handleEnemyBorderCollision(Enemy& enemy, std::vector<glm::vec2>& borderPoints) {
-	if (borderPoints.size() < 3) return;
-
-	glm::vec2 d, closest, ab;
-	glm::vec2 normal = glm::vec2();
-	float minDist = 0.0f;
-	int n = borderPoints.size();
-	for (int i = 0; i < n; i++) {
-		glm::vec2 a = borderPoints[i];
-		glm::vec2 b = borderPoints[(i + 1) % n];
-		glm::vec2 c = Utils::getClosestPointOnSegment(enemy.position, a, b);
-		d = enemy.position - c;
-		float distance = glm::length(d);
-		if (i == 0 || distance < minDist) {
-			minDist = distance;
-			closest = c;
-			ab = b - a;
-			normal = Utils::getPerpendicular(ab);
-		}
+void createTexture(Texture& texture, const DecodedImage& image, GLuint pbo) {
+	if (image.hasAlpha) {
+		texture.internalFormat = GL_RGBA;
+		texture.imageFormat = GL_RGBA;
 	}
 
-	d = enemy.position - closest;
-	float distance = glm::length(d);
-	if (distance == 0.0f) {
-		d = normal;
-		distance = glm::length(normal);
+	const unsigned char* data = image.bytes();
+	if (pbo != 0 && data != nullptr) {
+		// orphan the buffer so the driver does not stall on the previous upload
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+		glBufferData(GL_PIXEL_UNPACK_BUFFER, image.size(), nullptr, GL_STREAM_DRAW);
+		void* mapped = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, image.size(), GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+		if (mapped != nullptr) {
+			memcpy(mapped, data, image.size());
+		}
+		// the buffer contents are undefined when unmapping fails, upload from client memory then
+		if (mapped != nullptr && glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER) == GL_TRUE) {
+			// with a pixel unpack buffer bound the data pointer is an offset into it
+			data = nullptr;
+		}
+		else {
+			std::cout << "ERROR::TEXTURE::PBO_MAP_FAILED, uploading from client memory" << std::endl;
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		}
 	}
-	d = glm::normalize(d);
 
-	if (glm::dot(d, normal) >= 0.0f) {
-		if (distance > enemy.radius + BORDER_SIZE * 0.5f) return;
-
-		enemy.position += d * (enemy.radius - distance + BORDER_SIZE * 0.5f);
+	if (image.compressedFormat != 0) {
+		texture.generateCompressed(image.width, image.height, image.compressedFormat, data, image.size());
 	}
 	else {
-		enemy.position += d * -(distance + enemy.radius - BORDER_SIZE * 0.5f);
+		texture.generate(image.width, image.height, data);
 	}
 
-	enemy.velocity.x = -enemy.velocity.x;
-}
-
-void updateGame(float dt) {
-	if (gameState == GAME_OVER) {
-		globalOverlay = glm::vec3(0.5f);
-		return;
+	if (pbo != 0) {
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
 	}
-
-	updateEnemies(dt);
-	handleCombos(dt);
-	handleBallSpawn();
-	handleObjectDeletion();
-	handleEnemySpawn(dt);
-	handleUpdateSpawnParameters(dt);
-	handleScore(dt);
-	handleShake(dt);
 }
 
-void updateEnemies(float dt) {
-	for (Enemy& enemy : enemies) {
-		enemy.update(dt);
-
-		if (enemy.isDead) continue;
-
-		if (enemy.position.y + enemy.radius < lowestFlipperY) {
-			gameState = GAME_OVER;
-			break;
-		}
-
-		for (Ball& ball : balls) {
-			if (checkCircleCollision(enemy, ball)) {
-				glm::vec2 enemyToBall = ball.position - enemy.position;
-				enemyToBall = glm::normalize(enemyToBall);
-				ball.velocity = enemyToBall * (enemy.speedAbsorption * glm::length(ball.velocity));
-				enemy.setToDead();
-				comboTimer = COMBO_WINDOW;
-				incrementCombo();
-				score += comboCounter > 1 ? SCORE_PER_ENEMY * COMBO_SCORE_MULTIPLIER : SCORE_PER_ENEMY;
-				break;
+std::vector<Shader> loadShaders() {
+	// sources come straight from the pack mapping, the lengths stand in for the missing terminators.
+	// loose files are read into looseSources, which has to outlive the compile
+	std::vector<std::vector<unsigned char>> looseSources;
+	looseSources.reserve(SHADER_COUNT * 2);
+	auto getSource = [&looseSources](const char* path, const char*& code, int& length) {
+		AssetBlob blob = assetPack.find(path);
+		if (!blob.isValid()) {
+			looseSources.emplace_back();
+			if (!Utils::readFile(path, looseSources.back())) {
+				std::cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ: " << path << std::endl;
 			}
+			blob = AssetBlob(looseSources.back().data(), looseSources.back().size());
 		}
+		code = (const char*)blob.data;
+		length = (int)blob.size;
+	};
 
-		handleEnemyBorderCollision(enemy, borderPoints);
+	std::vector<ShaderCache::ProgramSource> sources(SHADER_COUNT);
+	for (int i = 0; i < SHADER_COUNT; i++) {
+		sources[i].name = std::string(SHADER_SOURCES[i].vertexPath) + "+" + SHADER_SOURCES[i].fragmentPath;
+		getSource(SHADER_SOURCES[i].vertexPath, sources[i].vertexCode, sources[i].vertexLength);
+		getSource(SHADER_SOURCES[i].fragmentPath, sources[i].fragmentCode, sources[i].fragmentLength);
 	}
+	return ShaderCache::loadPrograms(sources);
 }
 
-void handleCombos(float dt) {
-	if (comboTimer > 0.0f) {
-		comboTimer -= dt;
-
-		if (comboTimer <= 0.0f) {
-			comboTimer = 0.0f;
-			comboCounter = 0;
+// loose files edited after the pack was built win over their packed copy
+void skipStaleAssets() {
+	int staleCount = 0;
+	for (int i = 0; i < TEXTURE_COUNT; i++) {
+		std::string name = TEXTURE_SOURCES[i].path;
+		std::string sourcePath = FileSystem::getPath(name);
+		if (assetPack.skipIfStale(name, sourcePath)) {
+			assetPack.skipIfStale(name + ".tex", sourcePath);
+			std::cout << "Asset pack is older than " << name << ", using the loose file" << std::endl;
+			staleCount++;
 		}
 	}
-
-	if (comboCounter >= COMBO_TO_SPAWN_BALL) {
-		comboCounter = 0;
-		spawnBall();
+	for (const ShaderSource& source : SHADER_SOURCES) {
+		for (const char* shaderFile : { source.vertexPath, source.fragmentPath }) {
+			if (assetPack.skipIfStale(shaderFile, shaderFile)) {
+				std::cout << "Asset pack is older than " << shaderFile << ", using the loose file" << std::endl;
+				staleCount++;
+			}
+		}
 	}
+	if (staleCount > 0) std::cout << "Rerun --build-pack to bring the asset pack up to date" << std::endl;
 }
 
-void handleBallSpawn() {
-	while (numOfBallsToSpawn > 0) {
-		Ball ball = createBall();
-		ball.position = Utils::RandFloat() > 0.5f ? spawnPosRight : spawnPosLeft;
-		balls.push_back(ball);
-		numOfBallsToSpawn--;
-	}
-}
+// packs every texture, both as the source png and as a preprocessed texture cache entry,
+// together with the shader sources into ASSET_PACK_PATH
+bool buildAssetPack() {
+	std::vector<AssetPack::Input> inputs;
+	for (int i = 0; i < TEXTURE_COUNT; i++) {
+		AssetPack::Input source;
+		source.name = TEXTURE_SOURCES[i].path;
+		std::string sourcePath = FileSystem::getPath(source.name);
+		if (!Utils::readFile(sourcePath, source.bytes)) {
+			std::cout << "ERROR::ASSET_PACK::FAILED_TO_READ: " << sourcePath << std::endl;
+			return false;
+		}
 
-void handleObjectDeletion() {
-	for (std::vector<Ball>::iterator itr = balls.end(); itr != balls.begin();) {
-		--itr;
+		DecodedImage image;
+		image.hasAlpha = TEXTURE_SOURCES[i].hasAlpha;
+		if (!TextureCache::build(source.bytes.data(), source.bytes.size(), image, true)) {
+			std::cout << "ERROR::ASSET_PACK::FAILED_TO_DECODE: " << sourcePath << std::endl;
+			return false;
+		}
+		AssetPack::Input preprocessed;
+		preprocessed.name = source.name + ".tex";
+		preprocessed.bytes = TextureCache::serialize(image, Utils::hashBytes(source.bytes.data(), source.bytes.size()), source.bytes.size(), TextureCache::getSourceTime(sourcePath));
+
+		inputs.push_back(std::move(source));
+		inputs.push_back(std::move(preprocessed));
+	}
 
-		Ball& ball = *itr;
-		if (ball.position.y < ballDespawnHeight) {
-			itr = balls.erase(itr);
+	for (const ShaderSource& source : SHADER_SOURCES) {
+		for (const char* shaderFile : { source.vertexPath, source.fragmentPath }) {
+			AssetPack::Input shader;
+			shader.name = shaderFile;
+			if (!Utils::readFile(shaderFile, shader.bytes)) {
+				std::cout << "ERROR::ASSET_PACK::FAILED_TO_READ: " << shaderFile << std::endl;
+				return false;
+			}
+			inputs.push_back(std::move(shader));
 		}
 	}
-	if (balls.empty()) {
-		gameState = GAME_OVER;
+
+	std::string packPath = FileSystem::getPath(ASSET_PACK_PATH);
+	if (!AssetPack::build(packPath, inputs)) {
+		std::cout << "ERROR::ASSET_PACK::FAILED_TO_WRITE: " << packPath << std::endl;
+		return false;
 	}
+	std::cout << "Wrote " << inputs.size() << " assets to " << packPath << std::endl;
+	return true;
+}
 
-	for (std::vector<Enemy>::iterator itr = enemies.end(); itr != enemies.begin();) {
-		--itr;
+void drawTexturedSquareLine(Sprite* sprite, glm::vec3 startPos, glm::vec3 endPos, float radius) {
+	glm::vec2 startToEnd = endPos - startPos;
+	float length = glm::length(startToEnd);
+	glm::vec2 dir = glm::normalize(startToEnd);
+	float angle = glm::atan(dir.y, dir.x);
 
-		Enemy& enemy = *itr;
-		if (enemy.canRemove) {
-			itr = enemies.erase(itr);
-		}
-	}
+	sprite->drawSprite(startPos, glm::vec3(length, radius, 0.0f), angle, glm::vec3(1.0f), true);
 }
 
-void renderEnemy(Enemy& enemy, Shader* debugShader = nullptr) {
-	enemy.draw();
+void renderEnemy(const EnemyView& enemy, Shader* debugShader = nullptr) {
+	// a copy of the template, which the simulation thread reads when spawning enemies
+	AnimatedSprite sprite = *objectToAnimatedSprite[enemy.status == Enemy::ALIVE ? FLYING_ENEMY : DYING_ENEMY];
+	sprite.isFlipped = !enemy.isFacingRight;
+	sprite.setFrame(enemy.frame);
+	sprite.drawSprite(glm::vec3(enemy.position, 0.0f), glm::vec3(enemy.radius * 2.0f), 0.0f, glm::vec3(1.0f));
 	#ifdef DRAW_DEBUG
 	if (debugShader != nullptr)
 		drawCircleOutline(*debugShader, glm::vec3(enemy.position, 0.0f), enemy.radius);
 	#endif
 }
 
-void renderEnemies(Shader* debugShader = nullptr) {
-	for (Enemy& enemy : enemies) {
+void renderEnemies(const RenderSnapshot& snapshot, Shader* debugShader = nullptr) {
+	for (const EnemyView& enemy : snapshot.enemies) {
 		renderEnemy(enemy, debugShader);
 	}
 }
 
-void spawnBall() {
-	numOfBallsToSpawn++;
+void renderScoreText(const RenderSnapshot& snapshot) {
+	scoreText.value = snapshot.score;
+	scoreText.drawText(SCORE_TEXT_POSITION, SCORE_TEXT_SIZE);
 }
 
-Ball createBall() {
-	Ball ball;
-	ball.radius = 2.0f;
-	ball.mass = Utils::PI * ball.radius * ball.radius;
-	return ball;
+void renderGameOver() {
+	gameoverSpritePtr->drawSprite(glm::vec3(0.0f), glm::vec3(100.0f), 0.0f);
 }
 
-void spawnEnemy() {
-	AnimatedSprite& enemyFlying = *objectToAnimatedSprite[FLYING_ENEMY];
-	AnimatedSprite& enemyDying = *objectToAnimatedSprite[DYING_ENEMY];
-	float xMax = spawnPosRight.x;
-	float xMin = spawnPosLeft.x;
-	float y = spawnPosLeft.y;
-	float x = Utils::RandFloat() * glm::abs(xMax - xMin) + xMin;
-	glm::vec2 spawnPos = glm::vec2(x, y);
-	float velX = Utils::RandFloat() * 2.0f * enemyMaxHorizontalSpeed - enemyMaxHorizontalSpeed;
-	float velY = -enemyDescendSpeed;
-	glm::vec2 velocity = glm::vec2(velX, velY);
-	bool facingRight = spawnPos.x >= (xMax + xMin) / 2.0f;
-	//bool facingRight = Utils::RandFloat() > 0.5f;
-	//bool facingRight = true;
-	Enemy enemy(spawnPos, 7.5f, 0.25f, enemyFlying, enemyDying, facingRight, velocity);
-	enemies.push_back(enemy);
+void renderTutorial() {
+	tutorialSpritePtr->drawSprite(glm::vec3(-80.0f, -35.0f, 0.0f), glm::vec3(50.0f), 0.0f);
 }
 
-void handleEnemySpawn(float dt) {
-	enemySpawnTimer -= dt;
-
-	if (enemySpawnTimer <= 0.0f) {
-		enemySpawnTimer = enemySpawnInterval;
-		spawnEnemy();
+void renderText(const RenderSnapshot& snapshot) {
+	if (snapshot.gameState == GAME_OVER) {
+		renderGameOver();
 	}
-}
+	renderScoreText(snapshot);
 
-void handleUpdateSpawnParameters(float dt) {
-	parameterTimer -= dt;
-	if (parameterTimer <= 0.0f) {
-		parameterTimer = TIME_PER_PARAMETERS_UPDATE;
-		enemySpawnInterval *= ENEMY_SPAWN_INTERVAL_DECREASE_RATE_MULTIPLIER;
-		enemyDescendSpeed *= ENEMY_SPEED_INCREASE_RATE_MULTIPLIER;
-		enemyMaxHorizontalSpeed *= ENEMY_SPEED_INCREASE_RATE_MULTIPLIER;
+	// the perf hud takes the place of the tutorial panel, it is drawn after the render phase
+	if (!showPerfHud) {
+		renderTutorial();
 	}
 }
 
-void handleScore(float dt) {
-	scoreIntervalTimer -= dt;
-	if (scoreIntervalTimer <= 0.0f) {
-		scoreIntervalTimer = TIME_PER_SCORING_INTERVAL;
-		score += SCORE_PER_SCORING_INTERVAL;
-	}
+void captureFrameCounters(const RenderSnapshot& snapshot) {
+	frameProfiler.current.counters = perfCounters;
+	frameProfiler.current.counters.uniformUploads = Shader::uniformUploads;
+	frameProfiler.current.ballCount = snapshot.balls.size();
+	frameProfiler.current.enemyCount = snapshot.enemies.size();
 }
 
-void incrementCombo() {
-	comboCounter++;
-		
-	if (comboCounter >= COMBO_TO_SHAKE) {
-		startShake();
+void renderPerfHud(const RenderSnapshot& snapshot) {
+	// everything drawn after this point belongs to the hud and is left out of the counters
+	captureFrameCounters(snapshot);
+
+	const FrameStats& stats = frameProfiler.last;
+	SpriteBatch& batch = *hudBatchPtr;
+	const glm::vec4 white = glm::vec4(1.0f);
+
+	// one row per counter, phase rows are tagged with the color used in the graph
+	struct HudRow {
+		int value;
+		glm::vec4 color;
+	};
+	HudRow rows[] = {
+		{ (int)(stats.frameTime * 1000000.0f), white },
+		{ (int)(stats.phaseTimes[PHASE_INPUT] * 1000000.0f), PHASE_COLORS[PHASE_INPUT] },
+		{ (int)(stats.phaseTimes[PHASE_SIMULATION] * 1000000.0f), PHASE_COLORS[PHASE_SIMULATION] },
+		{ (int)(stats.phaseTimes[PHASE_GAME] * 1000000.0f), PHASE_COLORS[PHASE_GAME] },
+		{ (int)(stats.phaseTimes[PHASE_RENDER] * 1000000.0f), PHASE_COLORS[PHASE_RENDER] },
+		{ (int)(stats.phaseTimes[PHASE_HUD] * 1000000.0f), PHASE_COLORS[PHASE_HUD] },
+		{ (int)(stats.phaseTimes[PHASE_SWAP] * 1000000.0f), PHASE_COLORS[PHASE_SWAP] },
+		{ (int)stats.ballCount, glm::vec4(0.8f, 0.8f, 1.0f, 1.0f) },
+		{ (int)stats.enemyCount, glm::vec4(1.0f, 0.4f, 0.4f, 1.0f) },
+		{ (int)stats.counters.drawCalls, glm::vec4(0.4f, 1.0f, 1.0f, 1.0f) },
+		{ (int)stats.counters.uniformUploads, glm::vec4(1.0f, 0.4f, 1.0f, 1.0f) },
+		{ (int)stats.counters.textureBinds, glm::vec4(1.0f, 0.8f, 0.6f, 1.0f) }
+	};
+
+	NumberText rowText;
+	glm::vec3 rowPos = PERF_HUD_POSITION;
+	for (const HudRow& row : rows) {
+		glm::vec2 swatchPos = glm::vec2(rowPos) - glm::vec2(PERF_HUD_TEXT_SIZE, 0.0f);
+		batch.addSprite(whiteTexturePtr->id, swatchPos, glm::vec2(PERF_HUD_TEXT_SIZE * 0.5f), row.color);
+		rowText.value = row.value;
+		rowText.drawTextBatched(batch, rowPos, PERF_HUD_TEXT_SIZE, row.color);
+		rowPos.y -= PERF_HUD_ROW_GAP;
+	}
+
+	// frame time graph, one stacked bar per frame with the 60 fps budget as a line
+	for (int i = 0; i < FrameProfiler::HISTORY_SIZE; i++) {
+		const FrameStats& frame = frameProfiler.getHistory(i);
+		float x = PERF_HUD_GRAPH_POSITION.x + i * PERF_HUD_GRAPH_BAR_WIDTH;
+		float y = PERF_HUD_GRAPH_POSITION.y;
+		for (int phase = 0; phase < PHASE_COUNT; phase++) {
+			float height = frame.phaseTimes[phase] * 1000.0f * PERF_HUD_GRAPH_HEIGHT_PER_MS;
+			batch.addQuad(whiteTexturePtr->id, glm::vec2(x, y), glm::vec2(x + PERF_HUD_GRAPH_BAR_WIDTH, y + height), PHASE_COLORS[phase]);
+			y += height;
+		}
 	}
-}
+	float budgetY = PERF_HUD_GRAPH_POSITION.y + FIX_DT * 1000.0f * PERF_HUD_GRAPH_HEIGHT_PER_MS;
+	float graphWidth = FrameProfiler::HISTORY_SIZE * PERF_HUD_GRAPH_BAR_WIDTH;
+	batch.addQuad(whiteTexturePtr->id, glm::vec2(PERF_HUD_GRAPH_POSITION.x, budgetY), glm::vec2(PERF_HUD_GRAPH_POSITION.x + graphWidth, budgetY + 0.2f), white);
 
-void renderScoreText() {
-	scoreText.value = score;
-	scoreText.drawText(SCORE_TEXT_POSITION, SCORE_TEXT_SIZE);
+	glm::mat4 projection = glm::ortho(
+		-(WORLD_WIDTH / 2.0f), (WORLD_WIDTH / 2.0f),
+		-(WORLD_HEIGHT / 2.0f), (WORLD_HEIGHT / 2.0f),
+		-1.0f, 1.0f
+	);
+	batch.flush(projection);
 }
 
-void renderGameOver() {
-	gameoverSpritePtr->drawSprite(glm::vec3(0.0f), glm::vec3(100.0f), 0.0f);
+void queueCommand(SimulationCommand command) {
+	std::lock_guard<std::mutex> lock(commandMutex);
+	pendingCommands.push_back(command);
 }
 
-void renderTutorial() {
-	tutorialSpritePtr->drawSprite(glm::vec3(-80.0f, -35.0f, 0.0f), glm::vec3(50.0f), 0.0f);
-}
+// true when there was anything to apply
+bool applyCommands() {
+	{
+		std::lock_guard<std::mutex> lock(commandMutex);
+		std::swap(pendingCommands, executingCommands);
+	}
 
-void renderText() {
-	if (gameState == GAME_OVER) {
-		renderGameOver();
+	bool applied = !executingCommands.empty();
+	for (SimulationCommand command : executingCommands) {
+		replayRecorder.recordCommand(command);
+		world.applyCommand(command);
 	}
-	renderScoreText();
-	renderTutorial();
+	executingCommands.clear();
+	return applied;
 }
 
-void offsetEverythingBy(glm::vec2 offset) {
-	for (glm::vec2& point : borderPoints) {
-		point += offset;
+// rewind state, only touched on the simulation thread
+bool isRewinding = false;
+uint64_t rewindStep = 0;
+
+// true while the simulation is paused in the history. commands queued meanwhile wait for the resume
+bool updateRewind() {
+	#ifdef REWIND_HISTORY
+	if (rewindRequested && !isRewinding && !rewindHistory.isEmpty()) {
+		isRewinding = true;
+		rewindStep = rewindHistory.newestStep();
+		rewindScrubSteps = 0;
+		// a jump back in time cannot go into a replay, the recording ends with the last step played
+		replayRecorder.stop(world.stateHash);
+	}
+	if (!isRewinding) return false;
+
+	if (!rewindRequested) {
+		// play goes on from the frame on screen, the steps after it are gone
+		rewindHistory.truncateAfter(rewindStep);
+		simulationAccumulator = 0.0f;
+		isRewinding = false;
+		return false;
 	}
 
-	for (Ball& ball : balls) {
-		ball.position += offset;
+	int64_t target = (int64_t)rewindStep + rewindScrubSteps.exchange(0);
+	target = std::max(target, (int64_t)rewindHistory.oldestStep());
+	target = std::min(target, (int64_t)rewindHistory.newestStep());
+	if ((uint64_t)target != rewindStep && rewindHistory.restore((uint64_t)target, world)) {
+		rewindStep = (uint64_t)target;
 	}
+	return true;
+	#else
+	return false;
+	#endif
+}
 
-	for (Obstacle& obstacle : obstacles) {
-		obstacle.position += offset;
+// main thread: parses the saved source, brings the border mesh up to it and hands it to the simulation.
+// a source that does not parse leaves the last good table in play
+void reloadTable() {
+	if (!tableWatcher.poll()) return;
+	FrameProfiler::Clock::time_point start = FrameProfiler::Clock::now();
+	std::vector<unsigned char> bytes;
+	TableDescription edited;
+	if (!Utils::readFile(tableWatcher.path, bytes) || !Table::parse(std::string(bytes.begin(), bytes.end()), edited, tableWatcher.path)) {
+		std::cout << "Table not reloaded, playing on the last good one" << std::endl;
+		return;
 	}
 
-	for (Flipper& flipper : flippers) {
-		flipper.position += offset;
+	TableEdit edit;
+	Table::applyEdit(renderTable, edited, edit);
+	if (edit.isEmpty()) return;
+	borderMesh.update(renderTable.borderMesh, edit);
+	{
+		std::lock_guard<std::mutex> lock(tableMutex);
+		pendingTable = std::move(edited);
+		hasPendingTable = true;
 	}
 
-	for (Enemy& enemy : enemies) {
-		enemy.position += offset;
+	std::chrono::duration<float, std::milli> elapsed = FrameProfiler::Clock::now() - start;
+	if (edit.isBorderRebuilt) printf("Reloaded table in %.2f ms, border rebuilt", elapsed.count());
+	else printf("Reloaded table in %.2f ms, %d border segments and %d tree nodes", elapsed.count(), (int)edit.segments.size(), (int)edit.refitNodes);
+	printf(", %d bumpers, %d flippers changed\n", edit.areBumpersRebuilt ? (int)renderTable.bumpers.size() : (int)edit.bumpers.size(),
+		edit.areFlippersRebuilt ? (int)renderTable.flippers.size() : (int)edit.flippers.size());
+}
+
+// simulation thread: the edit lands between two steps like a command. a replay cannot carry it and
+// the history before it is on the old table, so the recording ends and the history starts over
+void applyPendingTable() {
+	TableDescription edited;
+	{
+		std::lock_guard<std::mutex> lock(tableMutex);
+		if (!hasPendingTable) return;
+		std::swap(edited, pendingTable);
+		hasPendingTable = false;
+	}
+	TableEdit edit;
+	world.applyTableEdit(edited, edit);
+	replayRecorder.stop(world.stateHash);
+	#ifdef REWIND_HISTORY
+	rewindHistory.clear();
+	#endif
+}
+
+void runSimulationStep(float dt) {
+	RenderSnapshot& snapshot = renderSnapshots.beginWrite();
+	float simulationTime = 0.0f;
+	float gameTime = 0.0f;
+
+	#ifdef TABLE_HOT_RELOAD
+	// waits while rewinding, the edit applies once play goes on
+	if (!isRewinding) applyPendingTable();
+	#endif
+
+	if (updateRewind()) {
+		writeRenderSnapshot(snapshot);
+		snapshot.overlay *= REWIND_OVERLAY;
+		renderSnapshots.publish();
+		return;
+	}
+
+	#ifdef DETERMINISTIC_SIMULATION
+	// frame time only decides how many steps run, the world never sees anything but FIX_DT.
+	// a long stall is capped instead of being caught up all at once
+	simulationAccumulator = std::min(simulationAccumulator + dt, FIX_DT * MAX_FIXED_STEPS_PER_FRAME);
+	while (simulationAccumulator >= FIX_DT) {
+		simulationAccumulator -= FIX_DT;
+		stepWorld(FIX_DT, simulationTime, gameTime);
+		if (world.stepIndex % FIXED_STEPS_PER_HASH_REPORT == 0) {
+			Determinism::printStepHash(world.stepIndex, world.stateHash);
+		}
 	}
+	#else
+	// a hitch, or frames folded together by the simulation thread, would otherwise be one long
+	// step that lets a fast ball through the border. equal substeps of at most FIX_DT, give or
+	// take vsync jitter, and a long stall is capped like in the deterministic path
+	float frameTime = std::min(dt, FIX_DT * MAX_FIXED_STEPS_PER_FRAME);
+	int substeps = std::max((int)std::ceil(frameTime / (FIX_DT * SUBSTEP_SLACK)), 1);
+	float substep = frameTime / substeps;
+	for (int i = 0; i < substeps; i++) {
+		stepWorld(substep, simulationTime, gameTime);
+	}
+	#endif
+	#ifdef FLIGHT_RECORDER
+	flightRecorder.checkFrameTime(dt);
+	#endif
+
+	writeRenderSnapshot(snapshot);
+	snapshot.simulationTime = simulationTime;
+	snapshot.gameTime = gameTime;
+	renderSnapshots.publish();
 }
 
-void startShake(){
-	shakeTimer = SHAKE_DURATION;
+// commands only ever land between two steps, so they are tied to a step index
+void stepWorld(float dt, float& simulationTime, float& gameTime) {
+	replayRecorder.recordDt(dt);
+	// only the rewind history needs to know
+	[[maybe_unused]] bool hadInput = applyCommands();
+
+	FrameProfiler::Clock::time_point start = FrameProfiler::Clock::now();
+	world.updateSimulation(dt);
+	FrameProfiler::Clock::time_point simulated = FrameProfiler::Clock::now();
+	world.updateGame(dt);
+	world.endStep();
+	replayRecorder.endStep();
+	#ifdef REWIND_HISTORY
+	rewindHistory.record(world, dt, hadInput);
+	#endif
+	#ifdef FLIGHT_RECORDER
+	flightRecorder.record(world, dt);
+	#endif
+	FrameProfiler::Clock::time_point updated = FrameProfiler::Clock::now();
+
+	simulationTime += std::chrono::duration<float>(simulated - start).count();
+	gameTime += std::chrono::duration<float>(updated - simulated).count();
 }
 
-void handleShake(float dt){
-	if (shakeTimer <= 0.0f) return;
-	glm::vec3 shakeOffset = glm::vec3(
-		2.0f * Utils::RandFloat() - 1.0f,
-		2.0f * Utils::RandFloat() - 1.0f,
-		0.0f
-	);
-	viewPos = shakeOffset;
-	shakeTimer -= dt;
-	if (shakeTimer <= 0.0f) {
-		shakeTimer = 0.0f;
-		endShake();
+void writeRenderSnapshot(RenderSnapshot& snapshot) {
+	const std::vector<Ball>& balls = world.balls;
+	snapshot.balls.resize(balls.size());
+	jobSystem.parallelFor(balls.size(), SNAPSHOT_JOB_GRAIN, [&snapshot, &balls](int begin, int end) {
+		for (int i = begin; i < end; i++) {
+			snapshot.balls[i] = { balls[i].position, balls[i].radius };
+		}
+	});
+
+	snapshot.obstacles.clear();
+	for (const Obstacle& obstacle : world.obstacles) {
+		snapshot.obstacles.push_back({ obstacle.position, obstacle.radius });
 	}
+
+	snapshot.flippers.clear();
+	// the end from the sine table, close enough to draw. collisions use getFlipperEnd
+	for (const Flipper& flipper : world.flippers) {
+		float angle = flipper.restAngle + (flipper.isSignPositive ? 1.0f : -1.0f) * flipper.currentRotation;
+		glm::vec2 direction(Geometry::SINE_TABLE.cos(angle), Geometry::SINE_TABLE.sin(angle));
+		snapshot.flippers.push_back({ flipper.position, flipper.position + direction * flipper.length, flipper.radius });
+	}
+
+	#ifdef DRAW_DEBUG
+	snapshot.borderPoints.assign(world.borderPoints.begin(), world.borderPoints.end());
+	#endif
+
+	const std::vector<Enemy>& enemies = world.enemies;
+	snapshot.enemies.resize(enemies.size());
+	jobSystem.parallelFor(enemies.size(), SNAPSHOT_JOB_GRAIN, [&snapshot, &enemies](int begin, int end) {
+		for (int i = begin; i < end; i++) {
+			const Enemy& enemy = enemies[i];
+			snapshot.enemies[i] = { enemy.position, enemy.radius, enemy.status, enemy.getCurrentFrame(), enemy.isFacingRight };
+		}
+	});
+
+	snapshot.gameState = world.gameState;
+	snapshot.score = world.score;
+	snapshot.viewPos = world.cameraShake;
+	snapshot.overlay = world.overlay;
+	snapshot.simulationTime = 0.0f;
+	snapshot.gameTime = 0.0f;
 }
 
-void endShake(){
-	viewPos = glm::vec3(0.0f);
+void requestSimulationStep(float dt) {
+	pendingSimulationTime.fetch_add(dt);
+	simulationTicks++;
+	simulationTicks.notify_one();
+}
+
+void simulationThreadLoop() {
+	#ifdef DETERMINISTIC_SIMULATION
+	Determinism::setupFloatEnvironment();
+	#endif
+	uint64_t handledTicks = 0;
+	while (true) {
+		simulationTicks.wait(handledTicks);
+		if (!simulationRunning) return;
+		handledTicks = simulationTicks.load();
+
+		// frames requested while the last step was still running are folded into this one
+		float dt = pendingSimulationTime.exchange(0.0f);
+		if (dt <= 0.0f) continue;
+		runSimulationStep(dt);
+	}
 }
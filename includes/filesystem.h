@@ -27,11 +27,17 @@ private:
     //return root;
 
       static std::string root = [] {
+#ifdef _WIN32
           char buffer[4096];
           size_t len = 0;
 
           if (getenv_s(&len, buffer, sizeof(buffer), "LOGL_ROOT_PATH") == 0 && len > 0)
               return std::string(buffer);
+#else
+          char const * envRoot = getenv("LOGL_ROOT_PATH");
+          if (envRoot != nullptr && envRoot[0] != '\0')
+              return std::string(envRoot);
+#endif
 
           return std::string(logl_root ? logl_root : "");
           }();